@@ -0,0 +1,343 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "../spreden.h"
+#include "../dstruct/pool.h"
+#include "../dstruct/vector.h"
+#include "algorithms.h"
+#include "../profile/profile.h"
+#include "../dstruct/mem.h"
+
+static const struct algorithm builtin[] = {
+	{ "bt",            bt_rate,            bt_rate_weeks,
+	  bt_rate_overlay,     bt_probability },
+	{ "bt-mov",        bt_mov_rate,        bt_mov_rate_weeks,
+	  bt_mov_rate_overlay, bt_probability },
+	{ "elo",           elo_rate,           elo_rate_weeks,
+	  elo_rate_overlay,    NULL },
+	{ "massey",        massey_rate,        NULL,
+	  massey_rate_overlay, NULL },
+	{ "massey-window", massey_window_rate, massey_window_rate_weeks,
+	  NULL,                NULL },
+	{ "sos",           sos_rate,           NULL,
+	  NULL,                NULL },
+	{ "sos-deep",      sos_deep_rate,      NULL,
+	  NULL,                NULL }
+};
+
+#define NUM_BUILTIN (sizeof(builtin) / sizeof(builtin[0]))
+
+/*
+ * rate_job is one algorithm over a run of weeks of a db, or of
+ * the db seen through an overlay
+ *
+ * the weeks are rated in parallel into r, one ratings per
+ * week starting at first
+ */
+struct rate_job {
+	const struct db *db;
+	const struct db_overlay *overlay;
+	const struct algorithm *algo;
+	unsigned int first;
+	struct ratings *r;
+	atomic_int error;
+};
+
+
+/* helper functions */
+
+/* qsort has no context argument, so the ratings being sorted go here */
+static const struct ratings *sort_ratings;
+
+static int compare_teams(const void *a, const void *b)
+{
+	double ra = sort_ratings->team[*(const int *)a];
+	double rb = sort_ratings->team[*(const int *)b];
+
+	return (ra < rb) - (ra > rb);
+}
+
+static void print_ranking(const struct db *db, const char *algo,
+			  unsigned int week, const struct ratings *r)
+{
+	int order[DB_MAX_TEAMS];
+	unsigned int i;
+
+	for (i = 0; i < r->num_teams; i++)
+		order[i] = i;
+
+	sort_ratings = r;
+	qsort(order, r->num_teams, sizeof(int), compare_teams);
+
+	printf("%s %s %d week %d\n", db->sport, algo,
+	       db->weeks[week].id.year, db->weeks[week].id.week);
+	for (i = 0; i < r->num_teams; i++) {
+		printf("%4u  %-*s %8.3f\n", i + 1, TEAM_NAME_MAX,
+		       db_team_name(db, order[i]), r->team[order[i]]);
+	}
+	printf("home advantage %.3f\n\n", r->home_adv);
+}
+
+
+/* add the ratings of weeks first..last to algo's history in dir */
+static int save_history(const char *dir, const struct db *db,
+			const char *algo, unsigned int first,
+			unsigned int last, const struct ratings *r)
+{
+	struct rating_history h;
+	unsigned int w;
+	int err = 0;
+
+	if (history_open(&h, dir, db->sport, algo, true) < 0)
+		return -1;
+
+	for (w = first; w <= last && !err; w++) {
+		if (history_append(&h, db, w, r[w - first].home_adv,
+				   r[w - first].team) < 0)
+			err = -2;
+	}
+
+	history_close(&h);
+	return err;
+}
+
+/* rate weeks [begin, end) as one piece of the parallel for */
+static void rate_piece(void *arg, unsigned int begin, unsigned int end)
+{
+	struct rate_job *job = arg;
+	const struct algorithm *algo = job->algo;
+	const struct db *db = job->db;
+	struct prof_scope scope;
+	struct trace_span span;
+	unsigned int w;
+
+	/* the whole piece in one call, so it can carry state across weeks */
+	if (algo->rate_weeks || job->overlay) {
+		prof_begin(&scope, PROF_ALGORITHMS);
+		trace_begin(&span, "algorithm", "%s %s %d week %d to %d week %d",
+			    db->sport, algo->name,
+			    db->weeks[begin].id.year, db->weeks[begin].id.week,
+			    db->weeks[end-1].id.year, db->weeks[end-1].id.week);
+		if (job->overlay) {
+			if (algo->rate_overlay(job->overlay, begin, end - 1,
+					       &job->r[begin - job->first]) < 0)
+				atomic_store(&job->error, 1);
+		} else if (algo->rate_weeks(db, begin, end - 1,
+					    &job->r[begin - job->first]) < 0) {
+			atomic_store(&job->error, 1);
+		}
+		trace_end(&span);
+		prof_end(&scope);
+		prof_count(PROF_ALGORITHM_RUNS, end - begin);
+		return;
+	}
+
+	for (w = begin; w < end && !atomic_load(&job->error); w++) {
+		prof_begin(&scope, PROF_ALGORITHMS);
+		trace_begin(&span, "algorithm", "%s %s %d week %d",
+			    db->sport, algo->name,
+			    db->weeks[w].id.year, db->weeks[w].id.week);
+		if (algo->rate(db, w, &job->r[w - job->first]) < 0)
+			atomic_store(&job->error, 1);
+		trace_end(&span);
+		prof_end(&scope);
+		prof_count(PROF_ALGORITHM_RUNS, 1);
+	}
+}
+
+static int run_job(struct pool *pool, struct rate_job *job,
+		   unsigned int last)
+{
+	atomic_init(&job->error, 0);
+
+	/*
+	 * pieces of weeks are independent, so any order works;
+	 * within a piece, rate_weeks goes in order
+	 */
+	pool_parallel_for(pool, job->first, last + 1, 1, rate_piece, job);
+
+	return atomic_load(&job->error) ? -1 : 0;
+}
+
+
+/* api functions */
+
+const struct algorithm *algo_find(const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < NUM_BUILTIN; i++) {
+		if (strcmp(builtin[i].name, name) == 0)
+			return &builtin[i];
+	}
+
+	return NULL;
+}
+
+/* the i-th builtin algorithm, or NULL past the end */
+const struct algorithm *algo_builtin(unsigned int i)
+{
+	if (i >= NUM_BUILTIN)
+		return NULL;
+
+	return &builtin[i];
+}
+
+/*
+ * rate weeks first..last of db with algo into out[0..], splitting
+ * the weeks across the pool
+ */
+int algo_rate_weeks(struct pool *pool, const struct db *db,
+		    const struct algorithm *algo, unsigned int first,
+		    unsigned int last, struct ratings *out)
+{
+	struct rate_job job;
+
+	job.db = db;
+	job.overlay = NULL;
+	job.algo = algo;
+	job.first = first;
+	job.r = out;
+
+	return run_job(pool, &job, last);
+}
+
+/* algo_rate_weeks() of the games seen through o */
+int algo_rate_overlay(struct pool *pool, const struct db_overlay *o,
+		      const struct algorithm *algo, unsigned int first,
+		      unsigned int last, struct ratings *out)
+{
+	struct rate_job job;
+
+	if (!algo->rate_overlay) {
+		fprintf(stderr, "%s: %s cannot rate what-if games\n",
+			progname, algo->name);
+		return -1;
+	}
+
+	job.db = o->base;
+	job.overlay = o;
+	job.algo = algo;
+	job.first = first;
+	job.r = out;
+
+	return run_job(pool, &job, last);
+}
+
+/*
+ * set o up over db with the games of the rc's what-if file, or
+ * with no changes if there is none
+ */
+int algo_what_if(const struct rc *rc, const struct db *db,
+		 struct db_overlay *o)
+{
+	overlay_init(o, db);
+	if (!rc->what_if_file)
+		return 0;
+
+	if (overlay_read(o, rc->what_if_file) < 0) {
+		overlay_free(o);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* make sure every algorithm in the rc exists before doing any work */
+int algo_check(const struct rc *rc)
+{
+	const struct vector *names = &rc->user_algorithms;
+	unsigned int i;
+
+	for (i = 0; i < names->length; i++) {
+		if (!algo_find(VECTOR_AT(names, char *, i))) {
+			fprintf(stderr, "%s: unknown algorithm '%s'\n",
+				progname, VECTOR_AT(names, char *, i));
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * rank every sport's teams with each algorithm for the target
+ * weeks, keeping the ratings in the rating history if there is
+ * one; with a what-if file, the teams are ranked on the games
+ * as changed by it instead
+ */
+int algo_rank(struct state *s)
+{
+	const struct vector *names = &s->rc.user_algorithms;
+	const struct algorithm *algo;
+	struct db_overlay what_if;
+	struct ratings *r;
+	struct db *db;
+	unsigned int first, last;
+	unsigned int i, j, w;
+	int err = 0;
+
+	if (algo_check(&s->rc) < 0)
+		return -1;
+
+	if (s->rc.what_if_file && s->rc.history_dir) {
+		fprintf(stderr, "%s: what-if ratings are not kept in the rating history\n",
+			progname);
+		return -1;
+	}
+
+	for (i = 0; i < s->num_dbs && !err; i++) {
+		db = s->dbs[i];
+		if (db_week_range(db, &s->rc.target_begin, &s->rc.target_end,
+				  &first, &last) < 0) {
+			fprintf(stderr, "%s: no target weeks loaded for %s\n",
+				progname, db->sport);
+			err = -3;
+			break;
+		}
+
+		if (algo_what_if(&s->rc, db, &what_if) < 0) {
+			err = -6;
+			break;
+		}
+
+		r = mem_alloc(MEM_ALGORITHMS,
+			      (last - first + 1) * sizeof(struct ratings));
+		if (!r) {
+			fprintf(stderr, "%s: malloc failed\n", progname);
+			overlay_free(&what_if);
+			return -2;
+		}
+
+		for (j = 0; j < names->length && !err; j++) {
+			algo = algo_find(VECTOR_AT(names, char *, j));
+			if (s->rc.what_if_file)
+				err = algo_rate_overlay(&s->pool, &what_if, algo,
+							first, last, r);
+			else
+				err = algo_rate_weeks(&s->pool, db, algo, first,
+						      last, r);
+			if (err < 0) {
+				err = -4;
+				break;
+			}
+
+			for (w = first; w <= last; w++)
+				print_ranking(db, algo->name, w, &r[w - first]);
+
+			if (s->rc.history_dir &&
+			    save_history(s->rc.history_dir, db, algo->name,
+					 first, last, r) < 0) {
+				err = -5;
+				break;
+			}
+		}
+
+		mem_free(r);
+		overlay_free(&what_if);
+	}
+
+	return err;
+}
@@ -0,0 +1,346 @@
+#ifndef ALGORITHMS_H
+#define ALGORITHMS_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "../spreden.h"
+#include "../database/database.h"
+#include "../dstruct/csr.h"
+
+#define LSQ_DEFAULT_TOLERANCE  1e-9
+
+/* most algorithms an ensemble can combine */
+#define ENSEMBLE_MAX_COMPONENTS  16
+
+/* deepest strength of schedule level; 1 is opponents' record */
+#define SOS_MAX_LEVELS  4
+
+/* longest sport,algorithm,year,week lead of a matrix csv line */
+#define MATRIX_CSV_KEY  (2 * TEAM_NAME_MAX + 32)
+
+/*
+ * ratings is the output of one algorithm for one week
+ *
+ * the predicted margin of a game is
+ * team[home] - team[away] + home_adv (unless neutral)
+ */
+struct ratings {
+	unsigned int num_teams;
+	double home_adv;
+	double team[DB_MAX_TEAMS];
+};
+
+struct algorithm {
+	const char *name;
+	/* rate using every game through the end of last_week */
+	int (*rate)(const struct db *db, unsigned int last_week,
+		    struct ratings *out);
+	/*
+	 * optional; rate weeks first..last into out[0..], for
+	 * algorithms that are cheaper a week at a time in order
+	 */
+	int (*rate_weeks)(const struct db *db, unsigned int first,
+			  unsigned int last, struct ratings *out);
+	/*
+	 * optional; rate_weeks() over the games seen through an
+	 * overlay, for rating what-if changes to the db
+	 */
+	int (*rate_overlay)(const struct db_overlay *o, unsigned int first,
+			    unsigned int last, struct ratings *out);
+	/*
+	 * optional; the chance the home team wins g, for algorithms
+	 * whose ratings are of a win probability model
+	 */
+	double (*probability)(const struct ratings *r, const struct game *g);
+};
+
+/* most parameters a tunable algorithm has */
+#define TUNE_MAX_PARAMS  4
+
+/*
+ * tunable is an algorithm whose parameters spreden tune can
+ * search; value holds the ones the builtin algorithm uses, and
+ * rate_weeks rates weeks first..last with param[] instead
+ */
+struct tunable {
+	const char *name;
+	unsigned int num_params;
+	const char *param[TUNE_MAX_PARAMS];
+	double value[TUNE_MAX_PARAMS];
+	int (*rate_weeks)(const struct db *db, unsigned int first,
+			  unsigned int last, const double *param,
+			  struct ratings *out);
+};
+
+/*
+ * lsq is a least squares linear rating model that can take
+ * single game changes without a full solve; see linear.c
+ */
+struct lsq {
+	unsigned int num_teams;
+	unsigned int dim;
+	/* m - normal matrix, dim x dim */
+	double *m;
+	/* inv - inverse of m, valid when solved */
+	double *inv;
+	double *b;
+	double *x;
+	double *work;
+	bool solved;
+	/* tolerance - relative residual that forces a full solve */
+	double tolerance;
+	/* mov_cap - margins are cut to this many points, 0 for none */
+	double mov_cap;
+	unsigned int updates;
+	/* stats */
+	unsigned long full_solves;
+	unsigned long rank_one_updates;
+};
+
+/* algorithms.c */
+extern const struct algorithm *algo_find(const char *name);
+extern const struct algorithm *algo_builtin(unsigned int i);
+extern int algo_rate_weeks(struct pool *pool, const struct db *db,
+			   const struct algorithm *algo, unsigned int first,
+			   unsigned int last, struct ratings *out);
+extern int algo_rate_overlay(struct pool *pool, const struct db_overlay *o,
+			     const struct algorithm *algo, unsigned int first,
+			     unsigned int last, struct ratings *out);
+extern int algo_what_if(const struct rc *rc, const struct db *db,
+			struct db_overlay *o);
+extern int algo_check(const struct rc *rc);
+extern int algo_rank(struct state *s);
+
+/* linear.c */
+extern int lsq_init(struct lsq *l, unsigned int num_teams);
+extern void lsq_free(struct lsq *l);
+extern void lsq_reset(struct lsq *l);
+extern void lsq_scale(struct lsq *l, double f);
+extern void lsq_accumulate(struct lsq *l, const struct game *g, double w);
+extern void lsq_accumulate_h2h(struct lsq *l, const struct h2h *h, double w);
+extern void lsq_accumulate_pack(struct lsq *l, const struct game_pack *p,
+				unsigned int first, unsigned int last, double w);
+extern int lsq_solve(struct lsq *l);
+extern int lsq_add(struct lsq *l, const struct game *g, double w);
+extern int lsq_remove(struct lsq *l, const struct game *g, double w);
+extern int lsq_modify(struct lsq *l, const struct game *old,
+		      const struct game *g, double w);
+extern double lsq_residual(const struct lsq *l);
+extern int lsq_refresh(struct lsq *l);
+extern void lsq_ratings(const struct lsq *l, struct ratings *out);
+extern int cholesky(double *a, unsigned int d);
+extern void cholesky_solve(const double *f, unsigned int d, double *x);
+
+/*
+ * lsq_window is an lsq over a window of weeks that moves forward
+ * a week at a time; see window.c
+ */
+struct lsq_window {
+	struct lsq lsq;
+	/* size - weeks kept, or 0 for every week so far */
+	unsigned int size;
+	/* decay - weight a week loses each week it ages, 1 for none */
+	double decay;
+	/* weeks [begin, end) are in the system */
+	unsigned int begin;
+	unsigned int end;
+};
+
+/* where one game's off diagonal Hessian entries are in bt's pattern */
+struct bt_slots {
+	unsigned int home_away;
+	unsigned int away_home;
+	unsigned int home_hfa;
+	unsigned int hfa_home;
+	unsigned int away_hfa;
+	unsigned int hfa_away;
+};
+
+/*
+ * bt is a Bradley-Terry model being fit with Newton's method;
+ * see bt.c
+ */
+struct bt {
+	unsigned int num_teams;
+	unsigned int dim;
+	int mov_cap;
+	/* prior - ridge on every rating */
+	double prior;
+	/* games - the games being fit, of weeks [0, num_weeks) */
+	struct game *games;
+	unsigned int num_games;
+	unsigned int max_games;
+	unsigned int num_weeks;
+	/* played[i] - teams i has played; hosted - teams in a non-neutral game */
+	struct bitset played[DB_MAX_TEAMS];
+	struct bitset hosted;
+	/* hessian - of minus the log likelihood, dim x dim */
+	struct csr hessian;
+	/* pattern_changed - played or hosted grew since hessian was laid out */
+	bool pattern_changed;
+	/* diag[i] - index in hessian of entry i, i */
+	unsigned int *diag;
+	/* slots[k] - games[k]'s entries in hessian, for k < num_slotted */
+	struct bt_slots *slots;
+	unsigned int num_slotted;
+	/* x - the ratings, then the home advantage */
+	double *x;
+	double *trial;
+	double *grad;
+	double *step;
+	double *work;
+	/* warm - x holds the last fit */
+	bool warm;
+	unsigned int iterations;
+};
+
+/*
+ * sos holds strength of schedule levels for one week: level[0]
+ * is each team's record, level[1] its opponents', level[2] its
+ * opponents' opponents' and so on; see sos.c
+ */
+struct sos {
+	unsigned int num_teams;
+	unsigned int num_levels;
+	double level[SOS_MAX_LEVELS][DB_MAX_TEAMS];
+};
+
+/* bt.c */
+extern const struct tunable bt_tunable;
+extern int bt_init(struct bt *m, unsigned int num_teams, int mov_cap);
+extern void bt_free(struct bt *m);
+extern int bt_fit(struct bt *m, const struct db_overlay *o,
+		  unsigned int last_week);
+extern void bt_ratings(const struct bt *m, struct ratings *out);
+extern double bt_probability(const struct ratings *r, const struct game *g);
+extern int bt_rate(const struct db *db, unsigned int last_week,
+		   struct ratings *out);
+extern int bt_rate_weeks(const struct db *db, unsigned int first,
+			 unsigned int last, struct ratings *out);
+extern int bt_mov_rate(const struct db *db, unsigned int last_week,
+		       struct ratings *out);
+extern int bt_mov_rate_weeks(const struct db *db, unsigned int first,
+			     unsigned int last, struct ratings *out);
+extern int bt_rate_overlay(const struct db_overlay *o, unsigned int first,
+			   unsigned int last, struct ratings *out);
+extern int bt_mov_rate_overlay(const struct db_overlay *o,
+			       unsigned int first, unsigned int last,
+			       struct ratings *out);
+extern int bt_rate_params(const struct db *db, unsigned int first,
+			  unsigned int last, const double *param,
+			  struct ratings *out);
+
+/* elo.c */
+extern const struct tunable elo_tunable;
+extern int elo_rate(const struct db *db, unsigned int last_week,
+		    struct ratings *out);
+extern int elo_rate_weeks(const struct db *db, unsigned int first,
+			  unsigned int last, struct ratings *out);
+extern int elo_rate_params(const struct db *db, unsigned int first,
+			   unsigned int last, const double *param,
+			   struct ratings *out);
+extern int elo_rate_overlay(const struct db_overlay *o, unsigned int first,
+			    unsigned int last, struct ratings *out);
+
+/*
+ * forecast is one algorithm's ratings after each of a run of
+ * weeks, for predicting the week after each; see ensemble.c
+ */
+struct forecast {
+	const struct algorithm *algo;
+	unsigned int first;
+	unsigned int num_weeks;
+	/* r - num_weeks ratings, r[0] after week first */
+	struct ratings *r;
+	int err;
+};
+
+/* ensemble is a weighted sum of algorithms' predicted margins */
+struct ensemble {
+	unsigned int num_components;
+	const struct algorithm *algo[ENSEMBLE_MAX_COMPONENTS];
+	double weight[ENSEMBLE_MAX_COMPONENTS];
+};
+
+/*
+ * pair_matrix is every team's predicted margin and win chance
+ * hosting every other team; see matrix.c
+ */
+struct pair_matrix {
+	unsigned int num_teams;
+	double home_adv;
+	/* scale - turns a margin into a logit */
+	double scale;
+	/* margin, prob - num_teams x num_teams, row team at home */
+	float *margin;
+	float *prob;
+	/* csv - the text of each block of rows, if made for csv */
+	unsigned int num_blocks;
+	char **csv;
+	size_t *csv_len;
+	/* csv_key - what every csv line starts with; see matrix_label() */
+	char csv_key[MATRIX_CSV_KEY];
+};
+
+/* ensemble.c */
+extern int forecast_range(const struct rc *rc, const struct db *db,
+			  unsigned int *first, unsigned int *last);
+extern double forecast_margin(const struct forecast *f, const struct game *g,
+			      unsigned int w);
+extern double forecast_probability(const struct forecast *f,
+				   const struct game *g, unsigned int w);
+extern int ensemble_fit(struct ensemble *e, const struct db *db,
+			const struct forecast *f, unsigned int first,
+			unsigned int last);
+extern int ensemble_read(struct ensemble *e, const char *path,
+			 const char *sport, const struct rc *rc);
+
+/* matrix.c */
+extern int matrix_init(struct pair_matrix *m, unsigned int num_teams,
+		       bool csv);
+extern void matrix_free(struct pair_matrix *m);
+extern void matrix_label(struct pair_matrix *m, const struct db *db,
+			 const char *algo, const struct week_id *week);
+extern double matrix_scale(const struct db *db, const struct ratings *r,
+			   unsigned int last_week);
+extern void matrix_compute(struct pair_matrix *m, struct pool *pool,
+			   const struct db *db, const struct ratings *r,
+			   double scale);
+extern int matrix_write_binary(FILE *stream, const struct pair_matrix *m,
+			       const struct db *db, const char *algo,
+			       const struct week_id *week);
+extern int matrix_write_csv_header(FILE *stream);
+extern int matrix_write_csv(FILE *stream, const struct pair_matrix *m);
+
+/* window.c */
+extern int window_init(struct lsq_window *win, unsigned int num_teams,
+		       unsigned int size, double decay);
+extern void window_free(struct lsq_window *win);
+extern int window_push(struct lsq_window *win, const struct db *db,
+		       unsigned int week);
+extern int window_ratings(struct lsq_window *win, struct ratings *out);
+
+/* massey.c */
+extern const struct tunable massey_tunable;
+extern int massey_rate(const struct db *db, unsigned int last_week,
+		       struct ratings *out);
+extern int massey_rate_overlay(const struct db_overlay *o, unsigned int first,
+			       unsigned int last, struct ratings *out);
+extern int massey_rate_params(const struct db *db, unsigned int first,
+			      unsigned int last, const double *param,
+			      struct ratings *out);
+extern int massey_window_rate(const struct db *db, unsigned int last_week,
+			      struct ratings *out);
+extern int massey_window_rate_weeks(const struct db *db, unsigned int first,
+				    unsigned int last, struct ratings *out);
+
+/* sos.c */
+extern int sos_compute(const struct db *db, unsigned int last_week,
+		       unsigned int num_levels, struct sos *out);
+extern int sos_rate(const struct db *db, unsigned int last_week,
+		    struct ratings *out);
+extern int sos_deep_rate(const struct db *db, unsigned int last_week,
+			 struct ratings *out);
+
+#endif
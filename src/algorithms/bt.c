@@ -0,0 +1,624 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#include "../spreden.h"
+#include "../dstruct/csr.h"
+#include "../dstruct/mem.h"
+#include "../profile/profile.h"
+#include "algorithms.h"
+
+/*
+ * Bradley-Terry paired comparisons with a home advantage
+ *
+ * the home team wins a game with probability
+ *
+ *   p = 1 / (1 + exp(-(r[home] - r[away] + h)))
+ *
+ * where h is left out for neutral games. the ratings maximize
+ * the log likelihood of the outcomes less a small ridge,
+ *
+ *   sum y log p + (1 - y) log (1 - p) - prior |x|^2 / 2
+ *
+ * with y = 1, 0 or 1/2 for a home win, loss or tie. with a
+ * margin cap, y instead moves linearly from 0 to 1 as the home
+ * margin goes from -cap to cap, so a blowout counts no more
+ * than a win by cap points
+ *
+ * the fit is Newton's method: the Hessian is as sparse as the
+ * schedule, so each step is a preconditioned conjugate gradient
+ * solve over it in csr form. fitting one week after another
+ * starts from the last week's ratings, which are only a few
+ * steps from the new ones
+ */
+
+/* ridge on every rating; keeps unbeaten teams finite */
+#define BT_PRIOR            0.05
+
+/* margin cap of the bt-mov algorithm, in points */
+#define BT_MOV_CAP            21
+
+/* Newton stops when no rating moves more than this */
+#define BT_TOLERANCE        1e-8
+#define BT_MAX_ITERATIONS     50
+
+/* step halvings tried before giving up on a step */
+#define BT_MAX_HALVINGS       30
+
+/* objective changes below this, relative, are rounding */
+#define BT_OBJECTIVE_SLACK  1e-13
+
+/* conjugate gradient stops at this relative residual */
+#define BT_CG_TOLERANCE    1e-12
+
+enum bt_param {
+	BT_PARAM_PRIOR,
+	BT_PARAM_CAP
+};
+
+const struct tunable bt_tunable = {
+	.name = "bt",
+	.num_params = 2,
+	.param = { "prior", "cap" },
+	.value = { BT_PRIOR, 0.0 },
+	.rate_weeks = bt_rate_params
+};
+
+
+/* helper functions */
+
+static double game_outcome(const struct game *g, int mov_cap)
+{
+	int margin = g->home_score - g->away_score;
+
+	if (mov_cap <= 0)
+		return (margin > 0) ? 1.0 : (margin < 0) ? 0.0 : 0.5;
+
+	if (margin > mov_cap)
+		margin = mov_cap;
+	else if (margin < -mov_cap)
+		margin = -mov_cap;
+
+	return 0.5 + 0.5 * (double)margin / mov_cap;
+}
+
+/* log 1 / (1 + exp(-z)) without overflow */
+static double log_sigmoid(double z)
+{
+	if (z > 0)
+		return -log1p(exp(-z));
+
+	return z - log1p(exp(z));
+}
+
+static double game_logit(const struct bt *m, const struct game *g,
+			 const double *x)
+{
+	double z = x[g->home_team] - x[g->away_team];
+
+	if (!g->neutral)
+		z += x[m->num_teams];
+
+	return z;
+}
+
+static double objective(const struct bt *m, const double *x)
+{
+	const struct game *g;
+	double f = 0.0;
+	double y, z;
+	unsigned int i, k;
+
+	for (k = 0; k < m->num_games; k++) {
+		g = &m->games[k];
+		y = game_outcome(g, m->mov_cap);
+		z = game_logit(m, g, x);
+		f += y * log_sigmoid(z) + (1.0 - y) * log_sigmoid(-z);
+	}
+
+	for (i = 0; i < m->dim; i++)
+		f -= 0.5 * m->prior * x[i] * x[i];
+
+	return f;
+}
+
+/* the index in the hessian of entry (row, col), which is in the pattern */
+static unsigned int find_slot(const struct bt *m, unsigned int row,
+			      unsigned int col)
+{
+	const unsigned int *cols = m->hessian.cols;
+	unsigned int lo = m->hessian.row_begin[row];
+	unsigned int hi = m->hessian.row_begin[row + 1];
+	unsigned int mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (cols[mid] < col)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	assert(lo < m->hessian.row_begin[row + 1] && cols[lo] == col);
+	return lo;
+}
+
+/*
+ * one row of the pattern, in column order: the columns in set,
+ * the diagonal, and the home advantage if hfa
+ */
+static int push_row(struct bt *m, unsigned int row, const struct bitset *set,
+		    bool hfa)
+{
+	bool diag = false;
+	int j;
+
+	for (j = bitset_next(set, 0); j >= 0; j = bitset_next(set, j + 1)) {
+		if (!diag && (unsigned int)j > row) {
+			m->diag[row] = m->hessian.nnz;
+			if (csr_push(&m->hessian, row, 0.0) < 0)
+				return -1;
+			diag = true;
+		}
+		if (csr_push(&m->hessian, j, 0.0) < 0)
+			return -1;
+	}
+
+	if (!diag) {
+		m->diag[row] = m->hessian.nnz;
+		if (csr_push(&m->hessian, row, 0.0) < 0)
+			return -1;
+	}
+
+	if (hfa && csr_push(&m->hessian, m->num_teams, 0.0) < 0)
+		return -1;
+
+	return csr_end_row(&m->hessian);
+}
+
+/*
+ * lay out the Hessian for the games being fit: the diagonal,
+ * every pair that has played and every team with a home or
+ * away game against the home advantage. the pattern only
+ * changes when a game brings in a new pair or the first
+ * non-neutral game of a team, and then every game's slots are
+ * found again; otherwise only the new games' are
+ */
+static int build_structure(struct bt *m)
+{
+	const unsigned int n = m->num_teams;
+	const unsigned int hfa = n;
+	struct bt_slots *sl;
+	const struct game *g;
+	unsigned int i, k;
+
+	if (m->pattern_changed) {
+		csr_clear(&m->hessian);
+		for (i = 0; i < n; i++) {
+			if (push_row(m, i, &m->played[i],
+				     bitset_test(&m->hosted, i)) < 0)
+				return -1;
+		}
+		if (push_row(m, hfa, &m->hosted, false) < 0)
+			return -1;
+
+		m->pattern_changed = false;
+		m->num_slotted = 0;
+	}
+
+	for (k = m->num_slotted; k < m->num_games; k++) {
+		g = &m->games[k];
+		sl = &m->slots[k];
+		sl->home_away = find_slot(m, g->home_team, g->away_team);
+		sl->away_home = find_slot(m, g->away_team, g->home_team);
+		if (g->neutral)
+			continue;
+		sl->home_hfa = find_slot(m, g->home_team, hfa);
+		sl->hfa_home = find_slot(m, hfa, g->home_team);
+		sl->away_hfa = find_slot(m, g->away_team, hfa);
+		sl->hfa_away = find_slot(m, hfa, g->away_team);
+	}
+	m->num_slotted = m->num_games;
+
+	return 0;
+}
+
+/*
+ * the Hessian of minus the objective and the gradient of the
+ * objective at m->x
+ */
+static void build_system(struct bt *m)
+{
+	const unsigned int d = m->dim;
+	const unsigned int hfa = m->num_teams;
+	const unsigned int h_diag = m->diag[hfa];
+	double *values = m->hessian.values;
+	double *grad = m->grad;
+	const struct bt_slots *sl;
+	const struct game *g;
+	unsigned int h, a, i, k;
+	double p, r, w;
+
+	memset(values, 0, m->hessian.nnz * sizeof(double));
+	for (i = 0; i < d; i++) {
+		values[m->diag[i]] = m->prior;
+		grad[i] = -m->prior * m->x[i];
+	}
+
+	for (k = 0; k < m->num_games; k++) {
+		g = &m->games[k];
+		sl = &m->slots[k];
+		h = g->home_team;
+		a = g->away_team;
+		p = 1.0 / (1.0 + exp(-game_logit(m, g, m->x)));
+		r = game_outcome(g, m->mov_cap) - p;
+		w = p * (1.0 - p);
+
+		grad[h] += r;
+		grad[a] -= r;
+		values[m->diag[h]] += w;
+		values[m->diag[a]] += w;
+		values[sl->home_away] -= w;
+		values[sl->away_home] -= w;
+
+		if (!g->neutral) {
+			grad[hfa] += r;
+			values[h_diag] += w;
+			values[sl->home_hfa] += w;
+			values[sl->hfa_home] += w;
+			values[sl->away_hfa] -= w;
+			values[sl->hfa_away] -= w;
+		}
+	}
+}
+
+/*
+ * bring m's games up to the end of last_week; fits that go on
+ * from the weeks before only read the new weeks' games
+ */
+static int gather_games(struct bt *m, const struct db_overlay *o,
+			unsigned int last_week)
+{
+	const unsigned int max = overlay_num_games(o);
+	struct overlay_iter iter;
+	const struct game *g;
+	struct bt_slots *slots;
+	struct game *games;
+	unsigned int i;
+
+	if (last_week < m->num_weeks) {
+		for (i = 0; i < m->num_teams; i++)
+			bitset_clear(&m->played[i]);
+		bitset_clear(&m->hosted);
+		m->pattern_changed = true;
+		m->num_games = 0;
+		m->num_weeks = 0;
+	}
+
+	if (m->max_games < max) {
+		games = mem_realloc(MEM_ALGORITHMS, m->games,
+				    max * sizeof(struct game));
+		if (!games)
+			return -1;
+		m->games = games;
+		slots = mem_realloc(MEM_ALGORITHMS, m->slots,
+				    max * sizeof(struct bt_slots));
+		if (!slots)
+			return -1;
+		m->slots = slots;
+		m->max_games = max;
+	}
+
+	for (overlay_iter_begin(o, m->num_weeks, last_week, &iter);
+	     !overlay_iter_end(&iter); overlay_iter_next(&iter)) {
+		g = overlay_iter_data(&iter);
+		if (!bitset_test(&m->played[g->home_team], g->away_team)) {
+			bitset_set(&m->played[g->home_team], g->away_team);
+			bitset_set(&m->played[g->away_team], g->home_team);
+			m->pattern_changed = true;
+		}
+		if (!g->neutral && (!bitset_test(&m->hosted, g->home_team) ||
+				    !bitset_test(&m->hosted, g->away_team))) {
+			bitset_set(&m->hosted, g->home_team);
+			bitset_set(&m->hosted, g->away_team);
+			m->pattern_changed = true;
+		}
+		m->games[m->num_games++] = *g;
+	}
+	m->num_weeks = last_week + 1;
+
+	return 0;
+}
+
+static double dot(const double *a, const double *b, unsigned int n)
+{
+	double s = 0.0;
+	unsigned int i;
+
+	for (i = 0; i < n; i++)
+		s += a[i] * b[i];
+
+	return s;
+}
+
+/* solve H step = grad with Jacobi preconditioned conjugate gradient */
+static void solve_step(struct bt *m)
+{
+	const unsigned int d = m->dim;
+	const struct csr *hess = &m->hessian;
+	double *r = m->work;
+	double *z = m->work + d;
+	double *p = m->work + 2 * d;
+	double *q = m->work + 3 * d;
+	double *diag = m->work + 4 * d;
+	double rz, rz_next, alpha, beta, limit;
+	unsigned int i, k;
+
+	for (i = 0; i < d; i++) {
+		diag[i] = hess->values[m->diag[i]];
+		m->step[i] = 0.0;
+		r[i] = m->grad[i];
+		z[i] = r[i] / diag[i];
+		p[i] = z[i];
+	}
+
+	rz = dot(r, z, d);
+	limit = BT_CG_TOLERANCE * BT_CG_TOLERANCE * dot(r, r, d);
+
+	/* in exact arithmetic it is done after d steps */
+	for (k = 0; k < 2 * d && dot(r, r, d) > limit; k++) {
+		csr_spmv(hess, p, q, 0, d);
+		alpha = rz / dot(p, q, d);
+		for (i = 0; i < d; i++) {
+			m->step[i] += alpha * p[i];
+			r[i] -= alpha * q[i];
+			z[i] = r[i] / diag[i];
+		}
+
+		rz_next = dot(r, z, d);
+		beta = rz_next / rz;
+		rz = rz_next;
+		for (i = 0; i < d; i++)
+			p[i] = z[i] + beta * p[i];
+	}
+}
+
+
+/* api functions */
+
+/* mov_cap is the margin cap in points, or 0 for wins and losses */
+int bt_init(struct bt *m, unsigned int num_teams, int mov_cap)
+{
+	const unsigned int d = num_teams + 1;
+	unsigned int i;
+
+	m->num_teams = num_teams;
+	m->dim = d;
+	m->mov_cap = mov_cap;
+	m->prior = BT_PRIOR;
+	m->warm = false;
+	m->iterations = 0;
+	m->games = NULL;
+	m->num_games = 0;
+	m->max_games = 0;
+	m->num_weeks = 0;
+	m->slots = NULL;
+	m->num_slotted = 0;
+	for (i = 0; i < num_teams; i++)
+		bitset_clear(&m->played[i]);
+	bitset_clear(&m->hosted);
+	m->pattern_changed = true;
+	csr_init(&m->hessian, MEM_ALGORITHMS);
+
+	m->diag = mem_alloc(MEM_ALGORITHMS, d * sizeof(unsigned int));
+	m->x = mem_calloc(MEM_ALGORITHMS, d, sizeof(double));
+	m->trial = mem_calloc(MEM_ALGORITHMS, d, sizeof(double));
+	m->grad = mem_calloc(MEM_ALGORITHMS, d, sizeof(double));
+	m->step = mem_calloc(MEM_ALGORITHMS, d, sizeof(double));
+	m->work = mem_calloc(MEM_ALGORITHMS, 5 * (size_t)d, sizeof(double));
+	if (!m->diag || !m->x || !m->trial || !m->grad || !m->step ||
+	    !m->work || csr_reserve(&m->hessian, d, 4 * d) < 0) {
+		fprintf(stderr, "%s: malloc failed\n", progname);
+		bt_free(m);
+		return -1;
+	}
+
+	return 0;
+}
+
+void bt_free(struct bt *m)
+{
+	csr_free(&m->hessian);
+	mem_free(m->games);
+	mem_free(m->diag);
+	mem_free(m->slots);
+	mem_free(m->x);
+	mem_free(m->trial);
+	mem_free(m->grad);
+	mem_free(m->step);
+	mem_free(m->work);
+	m->games = NULL;
+	m->diag = NULL;
+	m->slots = NULL;
+	m->x = m->trial = m->grad = m->step = m->work = NULL;
+}
+
+/*
+ * fit the ratings to every game seen through o up to the end of
+ * last_week, starting from the last fit's ratings if there was
+ * one; the games of weeks already fit are kept, so every fit of
+ * m has to go through the same overlay
+ */
+int bt_fit(struct bt *m, const struct db_overlay *o, unsigned int last_week)
+{
+	const unsigned int d = m->dim;
+	double f, f_trial, scale, slack, max_step;
+	unsigned int i, iter, halvings;
+	bool converged = false;
+
+	assert(last_week < o->base->num_weeks);
+	assert(o->base->num_teams == m->num_teams);
+
+	if (gather_games(m, o, last_week) < 0 || build_structure(m) < 0) {
+		fprintf(stderr, "%s: malloc failed\n", progname);
+		return -1;
+	}
+
+	if (!m->warm)
+		memset(m->x, 0, d * sizeof(double));
+
+	f = objective(m, m->x);
+	for (iter = 0; iter < BT_MAX_ITERATIONS; iter++) {
+		build_system(m);
+		solve_step(m);
+
+		max_step = 0.0;
+		for (i = 0; i < d; i++) {
+			if (fabs(m->step[i]) > max_step)
+				max_step = fabs(m->step[i]);
+		}
+
+		/* close enough that the objective can no longer tell */
+		if (max_step < BT_TOLERANCE) {
+			for (i = 0; i < d; i++)
+				m->x[i] += m->step[i];
+			converged = true;
+			iter++;
+			break;
+		}
+
+		/* halve the step until the objective does not go down */
+		scale = 1.0;
+		slack = BT_OBJECTIVE_SLACK * fabs(f);
+		for (halvings = 0; halvings < BT_MAX_HALVINGS; halvings++) {
+			for (i = 0; i < d; i++)
+				m->trial[i] = m->x[i] + scale * m->step[i];
+			f_trial = objective(m, m->trial);
+			if (f_trial >= f - slack)
+				break;
+			scale *= 0.5;
+		}
+
+		if (halvings == BT_MAX_HALVINGS) {
+			fprintf(stderr, "%s: bradley-terry step did not improve the fit\n",
+				progname);
+			return -2;
+		}
+
+		memcpy(m->x, m->trial, d * sizeof(double));
+		f = f_trial;
+	}
+
+	m->iterations = iter;
+	m->warm = true;
+	prof_count(PROF_ALGORITHM_ITERATIONS, iter);
+
+	if (!converged) {
+		fprintf(stderr, "%s: bradley-terry did not converge in %u iterations\n",
+			progname, BT_MAX_ITERATIONS);
+		return -3;
+	}
+
+	return 0;
+}
+
+void bt_ratings(const struct bt *m, struct ratings *out)
+{
+	unsigned int i;
+
+	out->num_teams = m->num_teams;
+	for (i = 0; i < m->num_teams; i++)
+		out->team[i] = m->x[i];
+	out->home_adv = m->x[m->num_teams];
+}
+
+/* the chance the home team wins g under ratings fit by bt_fit() */
+double bt_probability(const struct ratings *r, const struct game *g)
+{
+	double z = r->team[g->home_team] - r->team[g->away_team];
+
+	if (!g->neutral)
+		z += r->home_adv;
+
+	return 1.0 / (1.0 + exp(-z));
+}
+
+/* fit weeks first..last in order, each starting from the one before */
+static int rate_weeks(const struct db_overlay *o, unsigned int first,
+		      unsigned int last, struct ratings *out, double prior,
+		      int mov_cap)
+{
+	struct bt m;
+	unsigned int w;
+	int err = 0;
+
+	if (bt_init(&m, o->base->num_teams, mov_cap) < 0)
+		return -1;
+	m.prior = prior;
+
+	for (w = first; w <= last; w++) {
+		if (bt_fit(&m, o, w) < 0) {
+			err = -2;
+			break;
+		}
+		bt_ratings(&m, &out[w - first]);
+	}
+
+	bt_free(&m);
+	return err;
+}
+
+/* rate_weeks() of the plain db */
+static int rate_db(const struct db *db, unsigned int first, unsigned int last,
+		   struct ratings *out, double prior, int mov_cap)
+{
+	struct db_overlay o;
+
+	overlay_init(&o, db);
+	return rate_weeks(&o, first, last, out, prior, mov_cap);
+}
+
+int bt_rate(const struct db *db, unsigned int last_week, struct ratings *out)
+{
+	return rate_db(db, last_week, last_week, out, BT_PRIOR, 0);
+}
+
+int bt_rate_weeks(const struct db *db, unsigned int first, unsigned int last,
+		  struct ratings *out)
+{
+	return rate_db(db, first, last, out, BT_PRIOR, 0);
+}
+
+int bt_mov_rate(const struct db *db, unsigned int last_week,
+		struct ratings *out)
+{
+	return rate_db(db, last_week, last_week, out, BT_PRIOR, BT_MOV_CAP);
+}
+
+int bt_mov_rate_weeks(const struct db *db, unsigned int first,
+		      unsigned int last, struct ratings *out)
+{
+	return rate_db(db, first, last, out, BT_PRIOR, BT_MOV_CAP);
+}
+
+int bt_rate_overlay(const struct db_overlay *o, unsigned int first,
+		    unsigned int last, struct ratings *out)
+{
+	return rate_weeks(o, first, last, out, BT_PRIOR, 0);
+}
+
+int bt_mov_rate_overlay(const struct db_overlay *o, unsigned int first,
+			unsigned int last, struct ratings *out)
+{
+	return rate_weeks(o, first, last, out, BT_PRIOR, BT_MOV_CAP);
+}
+
+/* bt_rate_weeks() with param[] for the prior and margin cap */
+int bt_rate_params(const struct db *db, unsigned int first, unsigned int last,
+		   const double *param, struct ratings *out)
+{
+	return rate_db(db, first, last, out, param[BT_PARAM_PRIOR],
+		       (int)param[BT_PARAM_CAP]);
+}
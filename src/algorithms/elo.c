@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <assert.h>
+
+#include "../spreden.h"
+#include "algorithms.h"
+
+/*
+ * Elo ratings with a home advantage
+ *
+ * every team starts at 0 and each game moves its two teams by
+ *
+ *   k m (s - 1 / (1 + 10^(-(r[home] - r[away] + h) / 400)))
+ *
+ * in opposite directions, where s is 1, 0 or 1/2 for a home win,
+ * loss or tie and h is left out for neutral games. m is 1, or
+ * with a margin cap, log(1 + min(|margin|, cap)) so that wins by
+ * more move the ratings more. between seasons every rating goes
+ * a fraction of the way back to 0
+ *
+ * the ratings are given in points, at ELO_POINTS elo per point
+ */
+
+#define ELO_K        20.0
+#define ELO_HOME     65.0
+#define ELO_REVERT   (1.0 / 3.0)
+
+/* margin cap of the multiplier in points, or 0 for none */
+#define ELO_MOV_CAP   0.0
+
+#define ELO_SCALE   400.0
+#define ELO_POINTS   25.0
+
+enum elo_param {
+	ELO_PARAM_K,
+	ELO_PARAM_HOME,
+	ELO_PARAM_REVERT,
+	ELO_PARAM_CAP
+};
+
+const struct tunable elo_tunable = {
+	.name = "elo",
+	.num_params = 4,
+	.param = { "k", "home", "revert", "cap" },
+	.value = { ELO_K, ELO_HOME, ELO_REVERT, ELO_MOV_CAP },
+	.rate_weeks = elo_rate_params
+};
+
+
+/* helper functions */
+
+static double mov_multiplier(const struct game *g, double cap)
+{
+	double margin;
+
+	if (cap <= 0.0)
+		return 1.0;
+
+	margin = fabs((double)(g->home_score - g->away_score));
+	if (margin > cap)
+		margin = cap;
+
+	return log1p(margin);
+}
+
+static double game_result(const struct game *g)
+{
+	if (g->home_score > g->away_score)
+		return 1.0;
+	if (g->home_score < g->away_score)
+		return 0.0;
+	return 0.5;
+}
+
+
+/* run every game through the end of last, saving weeks first..last */
+static int rate(const struct db_overlay *o, unsigned int first,
+		unsigned int last, const double *param, struct ratings *out)
+{
+	const struct db *db = o->base;
+	const double k = param[ELO_PARAM_K];
+	const double home = param[ELO_PARAM_HOME];
+	const double keep = 1.0 - param[ELO_PARAM_REVERT];
+	const double cap = param[ELO_PARAM_CAP];
+	double elo[DB_MAX_TEAMS] = { 0 };
+	struct overlay_iter iter;
+	const struct game *g;
+	double diff, delta;
+	unsigned int i, w;
+
+	assert(first <= last && last < db->num_weeks);
+
+	for (w = 0; w <= last; w++) {
+		if (w > 0 && db->weeks[w].id.year != db->weeks[w - 1].id.year) {
+			for (i = 0; i < db->num_teams; i++)
+				elo[i] *= keep;
+		}
+
+		for (overlay_iter_begin(o, w, w, &iter); !overlay_iter_end(&iter);
+		     overlay_iter_next(&iter)) {
+			g = overlay_iter_data(&iter);
+			diff = elo[g->home_team] - elo[g->away_team];
+			if (!g->neutral)
+				diff += home;
+
+			delta = k * mov_multiplier(g, cap) *
+				(game_result(g) -
+				 1.0 / (1.0 + pow(10.0, -diff / ELO_SCALE)));
+			elo[g->home_team] += delta;
+			elo[g->away_team] -= delta;
+		}
+
+		if (w < first)
+			continue;
+
+		out[w - first].num_teams = db->num_teams;
+		out[w - first].home_adv = home / ELO_POINTS;
+		for (i = 0; i < db->num_teams; i++)
+			out[w - first].team[i] = elo[i] / ELO_POINTS;
+	}
+
+	return 0;
+}
+
+
+/* api functions */
+
+int elo_rate_params(const struct db *db, unsigned int first,
+		    unsigned int last, const double *param,
+		    struct ratings *out)
+{
+	struct db_overlay o;
+
+	overlay_init(&o, db);
+	return rate(&o, first, last, param, out);
+}
+
+int elo_rate(const struct db *db, unsigned int last_week, struct ratings *out)
+{
+	return elo_rate_params(db, last_week, last_week, elo_tunable.value, out);
+}
+
+int elo_rate_weeks(const struct db *db, unsigned int first,
+		   unsigned int last, struct ratings *out)
+{
+	return elo_rate_params(db, first, last, elo_tunable.value, out);
+}
+
+int elo_rate_overlay(const struct db_overlay *o, unsigned int first,
+		     unsigned int last, struct ratings *out)
+{
+	return rate(o, first, last, elo_tunable.value, out);
+}
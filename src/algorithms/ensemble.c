@@ -0,0 +1,631 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <assert.h>
+
+#include "../spreden.h"
+#include "../dstruct/mem.h"
+#include "../dstruct/pool.h"
+#include "../profile/profile.h"
+#include "algorithms.h"
+
+/*
+ * ensembles of the rc's algorithms
+ *
+ * every prediction here is walk forward: a game in week w is
+ * predicted from the ratings through week w-1. each algorithm
+ * is rated once per week into a forecast, and everything after
+ * that, from error stats to weight fitting to predictions, only
+ * reads the forecasts
+ *
+ * the ensemble margin is a weighted sum of the component margins,
+ * with weights from ridge regression on the analyze window. the
+ * weights are free, not a convex mix, so they also put components
+ * on different scales (points, logits, percentages) onto points
+ */
+
+/* ridge, as a fraction of the mean diagonal of the normal matrix */
+#define ENSEMBLE_RIDGE  1e-3
+
+/* longest line in a weights file */
+#define ENSEMBLE_LINE_MAX  256
+
+struct forecast_task {
+	struct pool *pool;
+	const struct db *db;
+	/* what_if - the overlay to rate through, or NULL for the db */
+	const struct db_overlay *what_if;
+	struct forecast *f;
+};
+
+
+/* helper functions */
+
+static void forecast_task(void *arg)
+{
+	struct forecast_task *t = arg;
+	struct forecast *f = t->f;
+
+	if (t->what_if)
+		f->err = algo_rate_overlay(t->pool, t->what_if, f->algo,
+					   f->first, f->first + f->num_weeks - 1,
+					   f->r);
+	else
+		f->err = algo_rate_weeks(t->pool, t->db, f->algo, f->first,
+					 f->first + f->num_weeks - 1, f->r);
+}
+
+static void free_forecasts(struct forecast *f, unsigned int n)
+{
+	unsigned int i;
+
+	for (i = 0; i < n; i++)
+		mem_free(f[i].r);
+}
+
+/*
+ * rate weeks first..last with every algorithm in the rc, one
+ * pool task per algorithm; each of those splits its weeks too.
+ * given what_if, the algorithms rate the games seen through it
+ */
+static int build_forecasts(struct state *s, const struct db *db,
+			   const struct db_overlay *what_if,
+			   unsigned int first, unsigned int last,
+			   struct forecast *f)
+{
+	const struct vector *names = &s->rc.user_algorithms;
+	struct forecast_task tasks[ENSEMBLE_MAX_COMPONENTS];
+	struct pool_group group;
+	unsigned int i;
+	int err = 0;
+
+	for (i = 0; i < names->length; i++) {
+		f[i].algo = algo_find(VECTOR_AT(names, char *, i));
+		f[i].first = first;
+		f[i].num_weeks = last - first + 1;
+		f[i].err = 0;
+		f[i].r = mem_alloc(MEM_ALGORITHMS,
+				   f[i].num_weeks * sizeof(struct ratings));
+		if (!f[i].r) {
+			fprintf(stderr, "%s: malloc failed\n", progname);
+			free_forecasts(f, i);
+			return -1;
+		}
+	}
+
+	pool_group_init(&group, &s->pool);
+	for (i = 0; i < names->length; i++) {
+		tasks[i].pool = &s->pool;
+		tasks[i].db = db;
+		tasks[i].what_if = what_if;
+		tasks[i].f = &f[i];
+		pool_group_spawn(&group, forecast_task, &tasks[i]);
+	}
+	pool_group_wait(&group);
+
+	for (i = 0; i < names->length; i++) {
+		if (f[i].err)
+			err = -2;
+	}
+
+	if (err)
+		free_forecasts(f, names->length);
+	return err;
+}
+
+static int check_components(const struct rc *rc)
+{
+	if (algo_check(rc) < 0)
+		return -1;
+
+	if (rc->user_algorithms.length > ENSEMBLE_MAX_COMPONENTS) {
+		fprintf(stderr, "%s: too many algorithms; ENSEMBLE_MAX_COMPONENTS is %d\n",
+			progname, ENSEMBLE_MAX_COMPONENTS);
+		return -2;
+	}
+
+	return 0;
+}
+
+static int write_weights(FILE *stream, const struct ensemble *e,
+			 const char *sport)
+{
+	unsigned int i;
+
+	for (i = 0; i < e->num_components; i++) {
+		if (fprintf(stream, "%s %s %.17g\n", sport, e->algo[i]->name,
+			    e->weight[i]) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+static FILE *open_output(const char *path, const char *mode)
+{
+	FILE *stream = fopen(path, mode);
+
+	if (!stream)
+		fprintf(stderr, "%s: could not open '%s' for writing: %s\n",
+			progname, path, strerror(errno));
+
+	return stream;
+}
+
+static int close_output(FILE *stream, const char *path)
+{
+	if (fclose(stream) != 0) {
+		fprintf(stderr, "%s: error writing '%s'\n", progname, path);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * write the all pairs matrix of every algorithm for every week
+ * first..last, from the ratings that predict that week
+ */
+static int write_matrices(struct state *s, const struct db *db,
+			  const struct forecast *f, unsigned int first,
+			  unsigned int last, FILE *bin, FILE *csv)
+{
+	const struct ratings *r;
+	struct pair_matrix m;
+	unsigned int i, w;
+	int err = 0;
+
+	if (matrix_init(&m, db->num_teams, csv != NULL) < 0)
+		return -1;
+
+	for (i = 0; i < s->rc.user_algorithms.length && !err; i++) {
+		for (w = first; w <= last && !err; w++) {
+			r = &f[i].r[w - 1 - f[i].first];
+			matrix_label(&m, db, f[i].algo->name,
+				     &db->weeks[w].id);
+			matrix_compute(&m, &s->pool, db, r,
+				       matrix_scale(db, r, w - 1));
+
+			if (bin && matrix_write_binary(bin, &m, db, f[i].algo->name,
+						       &db->weeks[w].id) < 0) {
+				fprintf(stderr, "%s: error writing '%s'\n",
+					progname, s->rc.matrix_file);
+				err = -2;
+			}
+			if (csv && matrix_write_csv(csv, &m) < 0) {
+				fprintf(stderr, "%s: error writing '%s'\n",
+					progname, s->rc.matrix_csv_file);
+				err = -3;
+			}
+		}
+	}
+
+	matrix_free(&m);
+	return err;
+}
+
+static void print_analysis(const struct db *db, unsigned int first,
+			   unsigned int last, const struct forecast *f,
+			   const struct ensemble *e)
+{
+	double sq[ENSEMBLE_MAX_COMPONENTS + 1] = { 0 };
+	unsigned int right[ENSEMBLE_MAX_COMPONENTS + 1] = { 0 };
+	const struct game *g;
+	unsigned int n = 0;
+	unsigned int i, w;
+	double y, p, sum;
+	int k;
+
+	for (w = first; w <= last; w++) {
+		for (k = db->weeks[w].game_begin; k < db->weeks[w].game_end; k++) {
+			g = &db->games[k];
+			y = g->home_score - g->away_score;
+			sum = 0.0;
+			for (i = 0; i < e->num_components; i++) {
+				p = forecast_margin(&f[i], g, w);
+				sq[i] += (y - p) * (y - p);
+				right[i] += (y * p > 0);
+				sum += e->weight[i] * p;
+			}
+			sq[i] += (y - sum) * (y - sum);
+			right[i] += (y * sum > 0);
+			n++;
+		}
+	}
+
+	printf("%s analyze %d week %d to %d week %d, %u games\n", db->sport,
+	       db->weeks[first].id.year, db->weeks[first].id.week,
+	       db->weeks[last].id.year, db->weeks[last].id.week, n);
+	printf("%-*s %10s %10s %8s\n", TEAM_NAME_MAX, "algorithm", "weight",
+	       "rmse", "correct");
+	for (i = 0; i < e->num_components; i++) {
+		printf("%-*s %10.4f %10.3f %8.3f\n", TEAM_NAME_MAX,
+		       e->algo[i]->name, e->weight[i],
+		       n ? sqrt(sq[i] / n) : 0.0,
+		       n ? (double)right[i] / n : 0.0);
+	}
+	printf("%-*s %10s %10.3f %8.3f\n\n", TEAM_NAME_MAX, "ensemble", "",
+	       n ? sqrt(sq[i] / n) : 0.0, n ? (double)right[i] / n : 0.0);
+}
+
+/*
+ * the games of week w seen through o, so added games are predicted
+ * too: each component's margin, the ensemble's, then the home win
+ * chance of each component that has one
+ */
+static void print_predictions(const struct db_overlay *o, unsigned int w,
+			      const struct forecast *f, unsigned int num,
+			      const struct ensemble *e)
+{
+	const struct db *db = o->base;
+	struct overlay_iter iter;
+	const struct game *g;
+	double p, sum;
+	unsigned int i;
+
+	printf("%s predict %d week %d\n", db->sport, db->weeks[w].id.year,
+	       db->weeks[w].id.week);
+	printf("%-*s %-*s", TEAM_NAME_MAX, "home", TEAM_NAME_MAX, "away");
+	for (i = 0; i < num; i++)
+		printf(" %10s", f[i].algo->name);
+	if (e)
+		printf(" %10s", "ensemble");
+	for (i = 0; i < num; i++) {
+		if (f[i].algo->probability)
+			printf(" %6s win", f[i].algo->name);
+	}
+	putchar('\n');
+
+	for (overlay_iter_begin(o, w, w, &iter); !overlay_iter_end(&iter);
+	     overlay_iter_next(&iter)) {
+		g = overlay_iter_data(&iter);
+		printf("%-*s %-*s", TEAM_NAME_MAX,
+		       db_team_name(db, g->home_team), TEAM_NAME_MAX,
+		       db_team_name(db, g->away_team));
+
+		sum = 0.0;
+		for (i = 0; i < num; i++) {
+			p = forecast_margin(&f[i], g, w);
+			printf(" %10.3f", p);
+			if (e)
+				sum += e->weight[i] * p;
+		}
+		if (e)
+			printf(" %10.3f", sum);
+		for (i = 0; i < num; i++) {
+			if (f[i].algo->probability)
+				printf(" %10.3f",
+				       forecast_probability(&f[i], g, w));
+		}
+		putchar('\n');
+	}
+	putchar('\n');
+}
+
+
+/* api functions */
+
+/*
+ * the target weeks that can be predicted walk forward; every
+ * one of them has a week before it to predict from
+ */
+int forecast_range(const struct rc *rc, const struct db *db,
+		   unsigned int *first, unsigned int *last)
+{
+	if (db_week_range(db, &rc->target_begin, &rc->target_end,
+			  first, last) < 0) {
+		fprintf(stderr, "%s: no target weeks loaded for %s\n",
+			progname, db->sport);
+		return -1;
+	}
+
+	/* the first loaded week has nothing before it to predict from */
+	if (*first == 0)
+		*first = 1;
+	if (*first > *last) {
+		fprintf(stderr, "%s: no weeks before the target weeks for %s\n",
+			progname, db->sport);
+		return -2;
+	}
+
+	return 0;
+}
+
+/* the margin f predicts for game g of week w, from week w-1 */
+double forecast_margin(const struct forecast *f, const struct game *g,
+		       unsigned int w)
+{
+	const struct ratings *r;
+	double margin;
+
+	assert(w > f->first && w - 1 - f->first < f->num_weeks);
+
+	r = &f->r[w - 1 - f->first];
+	margin = r->team[g->home_team] - r->team[g->away_team];
+	if (!g->neutral)
+		margin += r->home_adv;
+
+	return margin;
+}
+
+/* the chance the home team wins g of week w, from week w-1 */
+double forecast_probability(const struct forecast *f, const struct game *g,
+			    unsigned int w)
+{
+	assert(f->algo->probability);
+	assert(w > f->first && w - 1 - f->first < f->num_weeks);
+
+	return f->algo->probability(&f->r[w - 1 - f->first], g);
+}
+
+/*
+ * fit the weights of e's components to the games in weeks
+ * first..last by ridge regression of the home margins on the
+ * forecast margins
+ */
+int ensemble_fit(struct ensemble *e, const struct db *db,
+		 const struct forecast *f, unsigned int first,
+		 unsigned int last)
+{
+	const unsigned int n = e->num_components;
+	double m[ENSEMBLE_MAX_COMPONENTS * ENSEMBLE_MAX_COMPONENTS] = { 0 };
+	double p[ENSEMBLE_MAX_COMPONENTS];
+	const struct game *g;
+	double y, ridge = 0.0;
+	unsigned int i, j, w;
+	int k;
+
+	for (i = 0; i < n; i++)
+		e->weight[i] = 0.0;
+
+	/* normal equations; the right hand side goes in weight */
+	for (w = first; w <= last; w++) {
+		for (k = db->weeks[w].game_begin; k < db->weeks[w].game_end; k++) {
+			g = &db->games[k];
+			y = g->home_score - g->away_score;
+			for (i = 0; i < n; i++)
+				p[i] = forecast_margin(&f[i], g, w);
+			for (i = 0; i < n; i++) {
+				e->weight[i] += p[i] * y;
+				for (j = 0; j <= i; j++)
+					m[i*n + j] += p[i] * p[j];
+			}
+		}
+	}
+
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < i; j++)
+			m[j*n + i] = m[i*n + j];
+		ridge += m[i*n + i];
+	}
+
+	/* scaled to the data, plus a floor for all zero forecasts */
+	ridge = ENSEMBLE_RIDGE * ridge / n + ENSEMBLE_RIDGE;
+	for (i = 0; i < n; i++)
+		m[i*n + i] += ridge;
+
+	if (cholesky(m, n) < 0) {
+		fprintf(stderr, "%s: ensemble weights have no solution\n",
+			progname);
+		return -1;
+	}
+	cholesky_solve(m, n, e->weight);
+
+	return 0;
+}
+
+/*
+ * read the weights for sport from a file written by analyze; the
+ * algorithms must be the ones in the rc, in the same order
+ */
+int ensemble_read(struct ensemble *e, const char *path, const char *sport,
+		  const struct rc *rc)
+{
+	char line[ENSEMBLE_LINE_MAX];
+	char file_sport[ENSEMBLE_LINE_MAX];
+	char name[ENSEMBLE_LINE_MAX];
+	const char *want;
+	unsigned int n = 0;
+	unsigned int lineno = 0;
+	double weight;
+	FILE *stream;
+	int err = 0;
+
+	stream = fopen(path, "r");
+	if (!stream) {
+		fprintf(stderr, "%s: could not open '%s': %s\n",
+			progname, path, strerror(errno));
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), stream)) {
+		lineno++;
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+
+		if (sscanf(line, "%s %s %lf", file_sport, name, &weight) != 3) {
+			fprintf(stderr, "%s: bad weight at %s line %u\n",
+				progname, path, lineno);
+			err = -2;
+			break;
+		}
+		if (strcmp(file_sport, sport) != 0)
+			continue;
+
+		if (n >= rc->user_algorithms.length) {
+			fprintf(stderr, "%s: '%s' has more %s weights than algorithms\n",
+				progname, path, sport);
+			err = -3;
+			break;
+		}
+
+		want = VECTOR_AT(&rc->user_algorithms, char *, n);
+		if (strcmp(name, want) != 0) {
+			fprintf(stderr, "%s: '%s' has a weight for '%s' where '%s' was expected\n",
+				progname, path, name, want);
+			err = -4;
+			break;
+		}
+
+		e->algo[n] = algo_find(want);
+		e->weight[n] = weight;
+		n++;
+	}
+
+	if (!err && n != rc->user_algorithms.length) {
+		fprintf(stderr, "%s: '%s' has no %s weights for these algorithms\n",
+			progname, path, sport);
+		err = -5;
+	}
+
+	fclose(stream);
+	e->num_components = n;
+	return err;
+}
+
+/*
+ * walk forward over the target weeks: report each algorithm's
+ * errors, fit ensemble weights, and write them to the weights
+ * file if there is one
+ */
+int algo_analyze(struct state *s)
+{
+	struct forecast f[ENSEMBLE_MAX_COMPONENTS];
+	struct ensemble e;
+	struct prof_scope scope;
+	FILE *stream = NULL;
+	struct db *db;
+	unsigned int first, last;
+	unsigned int i, j;
+	int err = 0;
+
+	if (check_components(&s->rc) < 0)
+		return -1;
+
+	if (s->rc.weights_file) {
+		stream = fopen(s->rc.weights_file, "w");
+		if (!stream) {
+			fprintf(stderr, "%s: could not open '%s' for writing: %s\n",
+				progname, s->rc.weights_file, strerror(errno));
+			return -2;
+		}
+		fputs("# spreden ensemble weights: sport algorithm weight\n",
+		      stream);
+	}
+
+	for (i = 0; i < s->num_dbs && !err; i++) {
+		db = s->dbs[i];
+		if (forecast_range(&s->rc, db, &first, &last) < 0 ||
+		    build_forecasts(s, db, NULL, first - 1, last - 1, f) < 0) {
+			err = -3;
+			break;
+		}
+
+		e.num_components = s->rc.user_algorithms.length;
+		for (j = 0; j < e.num_components; j++)
+			e.algo[j] = f[j].algo;
+
+		prof_begin(&scope, PROF_ALGORITHMS);
+		err = ensemble_fit(&e, db, f, first, last);
+		prof_end(&scope);
+
+		if (!err) {
+			print_analysis(db, first, last, f, &e);
+			if (stream && write_weights(stream, &e, db->sport) < 0) {
+				fprintf(stderr, "%s: error writing '%s'\n",
+					progname, s->rc.weights_file);
+				err = -4;
+			}
+		}
+
+		free_forecasts(f, s->rc.user_algorithms.length);
+	}
+
+	if (stream && fclose(stream) != 0 && !err) {
+		fprintf(stderr, "%s: error writing '%s'\n",
+			progname, s->rc.weights_file);
+		err = -5;
+	}
+
+	return err;
+}
+
+/*
+ * predict every game in the target weeks from the week before,
+ * with each algorithm and, given a weights file, the ensemble;
+ * given matrix files, also every pairing of teams. given a
+ * what-if file, the ratings and games are the ones it makes
+ */
+int algo_predict(struct state *s)
+{
+	struct forecast f[ENSEMBLE_MAX_COMPONENTS];
+	struct db_overlay what_if;
+	struct ensemble e;
+	struct db *db;
+	FILE *bin = NULL, *csv = NULL;
+	unsigned int first, last;
+	unsigned int i, w;
+	int err = 0;
+
+	if (check_components(&s->rc) < 0)
+		return -1;
+
+	if (s->rc.matrix_file &&
+	    !(bin = open_output(s->rc.matrix_file, "wb")))
+		return -4;
+	if (s->rc.matrix_csv_file &&
+	    !(csv = open_output(s->rc.matrix_csv_file, "w"))) {
+		if (bin)
+			fclose(bin);
+		return -4;
+	}
+	if (csv && matrix_write_csv_header(csv) < 0) {
+		fprintf(stderr, "%s: error writing '%s'\n", progname,
+			s->rc.matrix_csv_file);
+		err = -5;
+	}
+
+	for (i = 0; i < s->num_dbs && !err; i++) {
+		db = s->dbs[i];
+		if (s->rc.weights_file &&
+		    ensemble_read(&e, s->rc.weights_file, db->sport,
+				  &s->rc) < 0) {
+			err = -2;
+			break;
+		}
+
+		if (forecast_range(&s->rc, db, &first, &last) < 0 ||
+		    algo_what_if(&s->rc, db, &what_if) < 0) {
+			err = -3;
+			break;
+		}
+
+		if (build_forecasts(s, db, s->rc.what_if_file ? &what_if : NULL,
+				    first - 1, last - 1, f) < 0) {
+			overlay_free(&what_if);
+			err = -3;
+			break;
+		}
+
+		for (w = first; w <= last; w++)
+			print_predictions(&what_if, w, f,
+					  s->rc.user_algorithms.length,
+					  s->rc.weights_file ? &e : NULL);
+
+		if ((bin || csv) &&
+		    write_matrices(s, db, f, first, last, bin, csv) < 0)
+			err = -5;
+
+		free_forecasts(f, s->rc.user_algorithms.length);
+		overlay_free(&what_if);
+	}
+
+	if (bin && close_output(bin, s->rc.matrix_file) < 0 && !err)
+		err = -6;
+	if (csv && close_output(csv, s->rc.matrix_csv_file) < 0 && !err)
+		err = -6;
+
+	return err;
+}
@@ -0,0 +1,523 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#include "../spreden.h"
+#include "algorithms.h"
+#include "../profile/profile.h"
+#include "../dstruct/mem.h"
+
+/*
+ * every game is one equation in the least squares system:
+ *
+ *   r[home] - r[away] + h = home_score - away_score
+ *
+ * where h, the home advantage, is left out for neutral games
+ *
+ * lsq keeps the normal equations M x = b, with x = (r, h), and
+ * the inverse of M so that a single game can be added, removed
+ * or changed with a rank-one update instead of a new solve
+ *
+ * M also has 11^T added over the team block, which pins the sum
+ * of the ratings to zero, and a small ridge so that it stays
+ * invertible for disconnected schedules
+ *
+ * with a margin cap, every game's margin is cut to at most
+ * mov_cap points either way before it goes in
+ */
+
+/* diagonal ridge added to M */
+#define LSQ_RIDGE        1e-6
+
+/* smallest allowed Sherman-Morrison denominator */
+#define LSQ_MIN_PIVOT    1e-9
+
+/* check the residual after this many updates */
+#define LSQ_CHECK_EVERY  64
+
+
+/* helper functions */
+
+static double game_margin(const struct lsq *l, const struct game *g)
+{
+	double margin = (double)(g->home_score - g->away_score);
+
+	if (l->mov_cap > 0.0) {
+		if (margin > l->mov_cap)
+			margin = l->mov_cap;
+		else if (margin < -l->mov_cap)
+			margin = -l->mov_cap;
+	}
+
+	return margin;
+}
+
+/* M += w a a^T and b += w y a for the game's row a */
+static void accumulate(struct lsq *l, const struct game *g, double w)
+{
+	const unsigned int h = g->home_team;
+	const unsigned int a = g->away_team;
+	const unsigned int d = l->dim;
+	const unsigned int hfa = l->num_teams;
+	const double y = w * game_margin(l, g);
+	double *m = l->m;
+
+	m[h*d + h] += w;
+	m[a*d + a] += w;
+	m[h*d + a] -= w;
+	m[a*d + h] -= w;
+	l->b[h] += y;
+	l->b[a] -= y;
+
+	if (!g->neutral) {
+		m[hfa*d + hfa] += w;
+		m[h*d + hfa] += w;
+		m[hfa*d + h] += w;
+		m[a*d + hfa] -= w;
+		m[hfa*d + a] -= w;
+		l->b[hfa] += y;
+	}
+}
+
+/* u = inv a for the game's row a; only three columns are touched */
+static void inv_times_row(const struct lsq *l, const struct game *g,
+			  double *u)
+{
+	const unsigned int d = l->dim;
+	const double *ih = &l->inv[g->home_team * d];
+	const double *ia = &l->inv[g->away_team * d];
+	const double *ihfa = &l->inv[l->num_teams * d];
+	unsigned int i;
+
+	/* inv is symmetric, so rows are columns */
+	if (g->neutral) {
+		for (i = 0; i < d; i++)
+			u[i] = ih[i] - ia[i];
+	} else {
+		for (i = 0; i < d; i++)
+			u[i] = ih[i] - ia[i] + ihfa[i];
+	}
+}
+
+static double row_dot(const struct lsq *l, const struct game *g,
+		      const double *v)
+{
+	double s = v[g->home_team] - v[g->away_team];
+
+	if (!g->neutral)
+		s += v[l->num_teams];
+
+	return s;
+}
+
+/* in place cholesky factorization of the d x d matrix a */
+int cholesky(double *a, unsigned int d)
+{
+	unsigned int i, j, k;
+	double s;
+
+	for (j = 0; j < d; j++) {
+		s = a[j*d + j];
+		for (k = 0; k < j; k++)
+			s -= a[j*d + k] * a[j*d + k];
+		if (s <= 0.0)
+			return -1;
+		a[j*d + j] = sqrt(s);
+
+		for (i = j + 1; i < d; i++) {
+			s = a[i*d + j];
+			for (k = 0; k < j; k++)
+				s -= a[i*d + k] * a[j*d + k];
+			a[i*d + j] = s / a[j*d + j];
+		}
+	}
+
+	return 0;
+}
+
+/* solve L L^T x = x in place with the factor from cholesky() */
+void cholesky_solve(const double *f, unsigned int d, double *x)
+{
+	unsigned int i, k;
+	double s;
+
+	for (i = 0; i < d; i++) {
+		s = x[i];
+		for (k = 0; k < i; k++)
+			s -= f[i*d + k] * x[k];
+		x[i] = s / f[i*d + i];
+	}
+
+	for (i = d; i-- > 0;) {
+		s = x[i];
+		for (k = i + 1; k < d; k++)
+			s -= f[k*d + i] * x[k];
+		x[i] = s / f[i*d + i];
+	}
+}
+
+static void solve_from_inverse(struct lsq *l)
+{
+	const unsigned int d = l->dim;
+	unsigned int i, j;
+	double s;
+
+	for (i = 0; i < d; i++) {
+		s = 0.0;
+		for (j = 0; j < d; j++)
+			s += l->inv[i*d + j] * l->b[j];
+		l->x[i] = s;
+	}
+}
+
+
+/* api functions */
+
+int lsq_init(struct lsq *l, unsigned int num_teams)
+{
+	unsigned int d = num_teams + 1;
+
+	memset(l, 0, sizeof(struct lsq));
+	l->num_teams = num_teams;
+	l->dim = d;
+	l->tolerance = LSQ_DEFAULT_TOLERANCE;
+
+	l->m = mem_calloc(MEM_ALGORITHMS, (size_t)d * d, sizeof(double));
+	l->inv = mem_calloc(MEM_ALGORITHMS, (size_t)d * d, sizeof(double));
+	l->b = mem_calloc(MEM_ALGORITHMS, d, sizeof(double));
+	l->x = mem_calloc(MEM_ALGORITHMS, d, sizeof(double));
+	l->work = mem_calloc(MEM_ALGORITHMS, 2 * (size_t)d, sizeof(double));
+	if (!l->m || !l->inv || !l->b || !l->x || !l->work) {
+		fprintf(stderr, "%s: malloc failed\n", progname);
+		lsq_free(l);
+		return -1;
+	}
+
+	lsq_reset(l);
+	return 0;
+}
+
+void lsq_free(struct lsq *l)
+{
+	mem_free(l->m);
+	mem_free(l->inv);
+	mem_free(l->b);
+	mem_free(l->x);
+	mem_free(l->work);
+	l->m = l->inv = l->b = l->x = l->work = NULL;
+}
+
+/* back to no games, keeping the allocations */
+void lsq_reset(struct lsq *l)
+{
+	const unsigned int d = l->dim;
+	const unsigned int n = l->num_teams;
+	unsigned int i, j;
+
+	memset(l->b, 0, d * sizeof(double));
+	memset(l->x, 0, d * sizeof(double));
+
+	for (i = 0; i < d; i++) {
+		for (j = 0; j < d; j++)
+			l->m[i*d + j] = (i < n && j < n) ? 1.0 : 0.0;
+		l->m[i*d + i] += LSQ_RIDGE;
+	}
+
+	l->solved = false;
+	l->updates = 0;
+}
+
+/*
+ * scale the weight of every game in the system by f, leaving the
+ * sum pin and ridge alone; M is the fixed part plus the games, so
+ * f M + (1 - f) (fixed part) scales just the games
+ */
+void lsq_scale(struct lsq *l, double f)
+{
+	const unsigned int d = l->dim;
+	const unsigned int n = l->num_teams;
+	double fixed;
+	unsigned int i, j;
+
+	for (i = 0; i < d; i++) {
+		for (j = 0; j < d; j++) {
+			fixed = (i < n && j < n) ? 1.0 : 0.0;
+			if (i == j)
+				fixed += LSQ_RIDGE;
+			l->m[i*d + j] = f * l->m[i*d + j] + (1.0 - f) * fixed;
+		}
+		l->b[i] *= f;
+	}
+
+	l->solved = false;
+}
+
+/* add a game's equation without updating the solution */
+void lsq_accumulate(struct lsq *l, const struct game *g, double w)
+{
+	accumulate(l, g, w);
+	l->solved = false;
+}
+
+/*
+ * add every game counted in a head-to-head matrix; this is the
+ * same system as accumulating the games one at a time, built
+ * from per-pair totals by streaming the matrix a tile at a time
+ */
+void lsq_accumulate_h2h(struct lsq *l, const struct h2h *h, double w)
+{
+	const unsigned int d = l->dim;
+	const unsigned int n = l->num_teams;
+	const unsigned int hfa = n;
+	const struct h2h_cell *tile, *c;
+	unsigned int ti, tj, r, k;
+	unsigned int i, j;
+	double games, home;
+	double *m = l->m;
+
+	assert(h->num_teams == n);
+	/* the pair totals are of whole margins */
+	assert(l->mov_cap <= 0.0);
+
+	for (ti = 0; ti < h->num_tiles; ti++) {
+		for (tj = 0; tj < h->num_tiles; tj++) {
+			tile = h2h_tile(h, ti, tj);
+			for (r = 0; r < H2H_TILE; r++) {
+				i = ti * H2H_TILE + r;
+				for (k = 0; k < H2H_TILE; k++) {
+					c = &tile[r * H2H_TILE + k];
+					if (c->games == 0)
+						continue;
+
+					/* each game is in both of its cells */
+					j = tj * H2H_TILE + k;
+					games = w * c->games;
+					m[i*d + i] += games;
+					m[i*d + j] -= games;
+					l->b[i] += w * c->margin;
+
+					/* home games only show up in the host's cell */
+					if (c->home == 0)
+						continue;
+					home = w * c->home;
+					m[hfa*d + hfa] += home;
+					m[i*d + hfa] += home;
+					m[hfa*d + i] += home;
+					m[j*d + hfa] -= home;
+					m[hfa*d + j] -= home;
+					l->b[hfa] += w * c->home_margin;
+				}
+			}
+		}
+	}
+
+	l->solved = false;
+}
+
+/* add the games of weeks first..last straight out of a game pack */
+void lsq_accumulate_pack(struct lsq *l, const struct game_pack *p,
+			 unsigned int first, unsigned int last, double w)
+{
+	struct pack_iter iter;
+
+	for (pack_iter_begin(p, first, last, &iter); !pack_iter_end(&iter);
+	     pack_iter_next(&iter))
+		accumulate(l, pack_iter_data(&iter), w);
+
+	l->solved = false;
+}
+
+/* factor M from scratch, rebuilding the inverse and the solution */
+int lsq_solve(struct lsq *l)
+{
+	const unsigned int d = l->dim;
+	double *f;
+	unsigned int i;
+
+	/* factor a copy of M; the inverse is built column by column */
+	f = mem_alloc(MEM_ALGORITHMS, (size_t)d * d * sizeof(double));
+	if (!f) {
+		fprintf(stderr, "%s: malloc failed\n", progname);
+		return -1;
+	}
+
+	memcpy(f, l->m, (size_t)d * d * sizeof(double));
+	if (cholesky(f, d) < 0) {
+		fprintf(stderr, "%s: least squares system is not positive definite\n",
+			progname);
+		mem_free(f);
+		return -2;
+	}
+
+	for (i = 0; i < d; i++) {
+		memset(&l->inv[i*d], 0, d * sizeof(double));
+		l->inv[i*d + i] = 1.0;
+		cholesky_solve(f, d, &l->inv[i*d]);
+	}
+
+	mem_free(f);
+
+	solve_from_inverse(l);
+	l->solved = true;
+	l->updates = 0;
+	l->full_solves++;
+	prof_count(PROF_FULL_SOLVES, 1);
+	if (prof_enabled)
+		prof_residual(lsq_residual(l));
+
+	return 0;
+}
+
+/*
+ * add (w > 0) or remove (w < 0) one game's equation and update
+ * the inverse and solution with Sherman-Morrison:
+ *
+ *   inv' = inv - w u u^T / (1 + w a^T u),  u = inv a
+ *   x'   = x + w u (y - a^T x) / (1 + w a^T u)
+ */
+static int rank_one(struct lsq *l, const struct game *g, double w)
+{
+	const unsigned int d = l->dim;
+	double *u = l->work;
+	double denom, scale, gain;
+	unsigned int i, j;
+
+	assert(l->solved);
+
+	accumulate(l, g, w);
+
+	inv_times_row(l, g, u);
+	denom = 1.0 + w * row_dot(l, g, u);
+	if (fabs(denom) < LSQ_MIN_PIVOT)
+		return lsq_solve(l);
+
+	gain = w * (game_margin(l, g) - row_dot(l, g, l->x)) / denom;
+	for (i = 0; i < d; i++)
+		l->x[i] += gain * u[i];
+
+	scale = w / denom;
+	for (i = 0; i < d; i++) {
+		double ui = scale * u[i];
+		double *row = &l->inv[i*d];
+
+		for (j = 0; j < d; j++)
+			row[j] -= ui * u[j];
+	}
+
+	l->updates++;
+	l->rank_one_updates++;
+	prof_count(PROF_RANK_ONE_UPDATES, 1);
+	if (l->updates % LSQ_CHECK_EVERY == 0)
+		return lsq_refresh(l);
+
+	return 0;
+}
+
+int lsq_add(struct lsq *l, const struct game *g, double w)
+{
+	if (!l->solved) {
+		accumulate(l, g, w);
+		return lsq_solve(l);
+	}
+
+	return rank_one(l, g, w);
+}
+
+int lsq_remove(struct lsq *l, const struct game *g, double w)
+{
+	if (!l->solved) {
+		accumulate(l, g, -w);
+		return lsq_solve(l);
+	}
+
+	return rank_one(l, g, -w);
+}
+
+/*
+ * change a game that is already in the system
+ *
+ * if only the score changed, the row is the same and M does not
+ * move; the solution just shifts along inv a
+ */
+int lsq_modify(struct lsq *l, const struct game *old, const struct game *g,
+	       double w)
+{
+	double *u = l->work;
+	double dy;
+	unsigned int i;
+
+	if (!l->solved ||
+	    old->home_team != g->home_team ||
+	    old->away_team != g->away_team ||
+	    old->neutral != g->neutral) {
+		if (lsq_remove(l, old, w) < 0)
+			return -1;
+		return lsq_add(l, g, w);
+	}
+
+	dy = w * (game_margin(l, g) - game_margin(l, old));
+	if (dy == 0.0)
+		return 0;
+
+	inv_times_row(l, g, u);
+	for (i = 0; i < l->dim; i++)
+		l->x[i] += dy * u[i];
+
+	l->b[g->home_team] += dy;
+	l->b[g->away_team] -= dy;
+	if (!g->neutral)
+		l->b[l->num_teams] += dy;
+
+	return 0;
+}
+
+/* relative residual |M x - b| / max(1, |b|) in the max norm */
+double lsq_residual(const struct lsq *l)
+{
+	const unsigned int d = l->dim;
+	double r, rmax = 0.0, bmax = 1.0;
+	unsigned int i, j;
+
+	for (i = 0; i < d; i++) {
+		r = -l->b[i];
+		for (j = 0; j < d; j++)
+			r += l->m[i*d + j] * l->x[j];
+		if (fabs(r) > rmax)
+			rmax = fabs(r);
+		if (fabs(l->b[i]) > bmax)
+			bmax = fabs(l->b[i]);
+	}
+
+	return rmax / bmax;
+}
+
+/* fall back to a full solve if the updates have drifted too far */
+int lsq_refresh(struct lsq *l)
+{
+	double residual;
+
+	if (!l->solved)
+		return lsq_solve(l);
+
+	residual = lsq_residual(l);
+	prof_residual(residual);
+	if (residual > l->tolerance)
+		return lsq_solve(l);
+
+	return 0;
+}
+
+/* copy the solution out as ratings */
+void lsq_ratings(const struct lsq *l, struct ratings *out)
+{
+	unsigned int i;
+
+	assert(l->solved);
+
+	out->num_teams = l->num_teams;
+	for (i = 0; i < l->num_teams; i++)
+		out->team[i] = l->x[i];
+	out->home_adv = l->x[l->num_teams];
+}
@@ -0,0 +1,251 @@
+#include <stdio.h>
+#include <assert.h>
+
+#include "../spreden.h"
+#include "algorithms.h"
+
+/*
+ * the builtin massey counts every game in full; tune can cap the
+ * margins, weight a game decay^age, age in weeks before the week
+ * being rated, and keep only the last window weeks
+ */
+#define MASSEY_MOV_CAP  0.0
+#define MASSEY_DECAY    1.0
+#define MASSEY_WINDOW   0.0
+
+/*
+ * massey-window weights a game 0.95^age and drops it after 32
+ * weeks, the best of tune's grid on the nfl and close to it on
+ * the ncaaf
+ */
+#define MASSEY_WINDOW_DECAY  0.95
+#define MASSEY_WINDOW_WEEKS  32.0
+
+enum massey_param {
+	MASSEY_PARAM_CAP,
+	MASSEY_PARAM_DECAY,
+	MASSEY_PARAM_WINDOW
+};
+
+const struct tunable massey_tunable = {
+	.name = "massey",
+	.num_params = 3,
+	.param = { "cap", "decay", "window" },
+	.value = { MASSEY_MOV_CAP, MASSEY_DECAY, MASSEY_WINDOW },
+	.rate_weeks = massey_rate_params
+};
+
+static const double massey_window_param[] = {
+	[MASSEY_PARAM_CAP] = MASSEY_MOV_CAP,
+	[MASSEY_PARAM_DECAY] = MASSEY_WINDOW_DECAY,
+	[MASSEY_PARAM_WINDOW] = MASSEY_WINDOW_WEEKS
+};
+
+
+/* helper functions */
+
+/* put every game through the end of last_week in the system */
+static void base_system(struct lsq *l, const struct db *db,
+			unsigned int last_week)
+{
+	int end;
+	int i;
+
+	/*
+	 * the db's pair totals cover every loaded week; short of
+	 * that, its packed games, when loaded with --pack, are a
+	 * fraction of the bytes to read
+	 */
+	if (db->h2h.num_weeks == last_week + 1) {
+		lsq_accumulate_h2h(l, &db->h2h, 1.0);
+	} else if (db->pack.num_weeks > last_week) {
+		lsq_accumulate_pack(l, &db->pack, 0, last_week, 1.0);
+	} else {
+		end = db->weeks[last_week].game_end;
+		for (i = 0; i < end; i++)
+			lsq_accumulate(l, &db->games[i], 1.0);
+	}
+}
+
+/* new scores and added games in o through the end of last_week */
+static unsigned int count_changes(const struct db_overlay *o,
+				  unsigned int last_week)
+{
+	const unsigned int end = o->base->weeks[last_week].game_end;
+	unsigned int n = 0, i;
+
+	for (i = 0; i < o->num_overrides && o->overrides[i].game < end; i++)
+		n++;
+	for (i = 0; i < o->num_games && o->game_weeks[i] <= last_week; i++)
+		n++;
+
+	return n;
+}
+
+/* solve the db's system, then change it to the overlay's */
+static int change_system(struct lsq *l, const struct db_overlay *o,
+			 unsigned int last_week)
+{
+	const struct db *db = o->base;
+	const unsigned int end = db->weeks[last_week].game_end;
+	const struct game_override *ov;
+	struct game g;
+	unsigned int i;
+
+	lsq_reset(l);
+	base_system(l, db, last_week);
+	if (lsq_solve(l) < 0)
+		return -1;
+
+	for (i = 0; i < o->num_overrides && o->overrides[i].game < end; i++) {
+		ov = &o->overrides[i];
+		g = db->games[ov->game];
+		g.home_score = ov->home_score;
+		g.away_score = ov->away_score;
+		if (lsq_modify(l, &db->games[ov->game], &g, 1.0) < 0)
+			return -2;
+	}
+
+	for (i = 0; i < o->num_games && o->game_weeks[i] <= last_week; i++) {
+		if (lsq_add(l, &o->games[i], 1.0) < 0)
+			return -3;
+	}
+
+	return lsq_refresh(l);
+}
+
+/* build and solve the system from the games seen through o */
+static int overlay_system(struct lsq *l, const struct db_overlay *o,
+			  unsigned int last_week)
+{
+	struct overlay_iter iter;
+
+	lsq_reset(l);
+	for (overlay_iter_begin(o, 0, last_week, &iter);
+	     !overlay_iter_end(&iter); overlay_iter_next(&iter))
+		lsq_accumulate(l, overlay_iter_data(&iter), 1.0);
+
+	return lsq_solve(l);
+}
+
+
+/* api functions */
+
+/* least squares point margin ratings with a home advantage */
+int massey_rate(const struct db *db, unsigned int last_week,
+		struct ratings *out)
+{
+	struct lsq l;
+
+	assert(last_week < db->num_weeks);
+
+	if (lsq_init(&l, db->num_teams) < 0)
+		return -1;
+
+	base_system(&l, db, last_week);
+	if (lsq_solve(&l) < 0) {
+		lsq_free(&l);
+		return -2;
+	}
+
+	lsq_ratings(&l, out);
+	lsq_free(&l);
+
+	return 0;
+}
+
+/*
+ * massey_rate() for weeks first..last of the games seen through
+ * an overlay
+ *
+ * each week is the db's system, solved, with the overlay's new
+ * scores and added games through that week put in as rank-one
+ * updates; a what-if of a few games costs little more than the
+ * plain rating, and the last loaded week still comes from the
+ * pair totals. with as many changes as unknowns the system is
+ * instead built from the games seen through the overlay
+ */
+int massey_rate_overlay(const struct db_overlay *o, unsigned int first,
+			unsigned int last, struct ratings *out)
+{
+	const struct db *db = o->base;
+	struct lsq l;
+	unsigned int w;
+	int err = 0;
+
+	assert(first <= last && last < db->num_weeks);
+
+	if (lsq_init(&l, db->num_teams) < 0)
+		return -1;
+
+	for (w = first; w <= last; w++) {
+		if (count_changes(o, w) < l.dim)
+			err = change_system(&l, o, w);
+		else
+			err = overlay_system(&l, o, w);
+		if (err < 0) {
+			err = -2;
+			break;
+		}
+
+		lsq_ratings(&l, &out[w - first]);
+	}
+
+	lsq_free(&l);
+	return err;
+}
+
+/*
+ * massey_rate() for weeks first..last with a margin cap, decay
+ * and window, walking one lsq_window forward through the weeks
+ */
+int massey_rate_params(const struct db *db, unsigned int first,
+		       unsigned int last, const double *param,
+		       struct ratings *out)
+{
+	const double decay = param[MASSEY_PARAM_DECAY];
+	struct lsq_window win;
+	unsigned int w;
+	int err = 0;
+
+	assert(first <= last && last < db->num_weeks);
+
+	if (decay <= 0.0 || decay > 1.0 || param[MASSEY_PARAM_WINDOW] < 0.0) {
+		fprintf(stderr, "%s: massey needs a decay in (0, 1] and a window of 0 or more weeks\n",
+			progname);
+		return -1;
+	}
+
+	if (window_init(&win, db->num_teams,
+			(unsigned int)param[MASSEY_PARAM_WINDOW], decay) < 0)
+		return -2;
+	win.lsq.mov_cap = param[MASSEY_PARAM_CAP];
+
+	for (w = 0; w <= last; w++) {
+		if (window_push(&win, db, w) < 0) {
+			err = -3;
+			break;
+		}
+		if (w >= first && window_ratings(&win, &out[w - first]) < 0) {
+			err = -4;
+			break;
+		}
+	}
+
+	window_free(&win);
+	return err;
+}
+
+/* massey_rate() of the recent weeks, older ones counting less */
+int massey_window_rate(const struct db *db, unsigned int last_week,
+		       struct ratings *out)
+{
+	return massey_rate_params(db, last_week, last_week,
+				  massey_window_param, out);
+}
+
+int massey_window_rate_weeks(const struct db *db, unsigned int first,
+			     unsigned int last, struct ratings *out)
+{
+	return massey_rate_params(db, first, last, massey_window_param, out);
+}
@@ -0,0 +1,342 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <assert.h>
+
+#include "../spreden.h"
+#include "../dstruct/mem.h"
+#include "../dstruct/pool.h"
+#include "algorithms.h"
+
+/*
+ * all pairs prediction matrices
+ *
+ * cell (i, j) of a matrix is team i hosting team j: the margin
+ * r[i] - r[j] + home_adv and the home team's win probability
+ * 1 / (1 + exp(-scale margin)). a neutral site margin is half
+ * of cell (i, j) less cell (j, i). scale puts the margins of any
+ * algorithm, in points, logits or anything else, on one footing;
+ * it is the logistic fit of the results of the games the ratings
+ * were made from
+ *
+ * the rows are computed in blocks of MATRIX_ROW_BLOCK across the
+ * pool, each row as two straight loops over float arrays that
+ * the compiler can vectorize. csv text is formatted by the same
+ * blocks, each into its own buffer, and written out in order.
+ * a csv file has one header; each line of it is one cell, led by
+ * the sport, algorithm, year and week of its matrix
+ *
+ * a binary matrix is a struct matrix_header, num_teams names of
+ * TEAM_NAME_MAX bytes, then the margins and the probabilities,
+ * each num_teams x num_teams floats, row major. everything is in
+ * host byte order
+ */
+
+#define MATRIX_MAGIC    "SPMX"
+#define MATRIX_VERSION  1
+
+/* rows per task */
+#define MATRIX_ROW_BLOCK  16
+
+/* ridge on the scale, and when its fit stops */
+#define MATRIX_SCALE_PRIOR          1.0
+#define MATRIX_SCALE_TOLERANCE  1e-10
+#define MATRIX_SCALE_ITERATIONS    50
+
+/* longest csv line: the key, two names and two numbers */
+#define MATRIX_CSV_LINE  (MATRIX_CSV_KEY + 2 * TEAM_NAME_MAX + 64)
+
+struct matrix_header {
+	char magic[4];
+	uint32_t version;
+	char sport[TEAM_NAME_MAX];
+	char algorithm[TEAM_NAME_MAX];
+	/* year, week - the week the matrix predicts */
+	int16_t year;
+	int16_t week;
+	uint32_t num_teams;
+	float home_adv;
+	float scale;
+};
+
+struct matrix_job {
+	struct pair_matrix *m;
+	const struct db *db;
+	/* home - each team's rating plus the home advantage */
+	float home[DB_MAX_TEAMS];
+	float team[DB_MAX_TEAMS];
+};
+
+
+/* helper functions */
+
+static double game_result(const struct game *g)
+{
+	if (g->home_score > g->away_score)
+		return 1.0;
+	if (g->home_score < g->away_score)
+		return 0.0;
+	return 0.5;
+}
+
+static double ratings_margin(const struct ratings *r, const struct game *g)
+{
+	double margin = r->team[g->home_team] - r->team[g->away_team];
+
+	if (!g->neutral)
+		margin += r->home_adv;
+
+	return margin;
+}
+
+static void compute_row(const struct matrix_job *job, unsigned int i)
+{
+	const struct pair_matrix *m = job->m;
+	const unsigned int n = m->num_teams;
+	const float home = job->home[i];
+	const float scale = (float)m->scale;
+	const float *team = job->team;
+	float *margin = &m->margin[(size_t)i * n];
+	float *prob = &m->prob[(size_t)i * n];
+	unsigned int j;
+
+	for (j = 0; j < n; j++)
+		margin[j] = home - team[j];
+
+	for (j = 0; j < n; j++)
+		prob[j] = 1.0f / (1.0f + expf(-scale * margin[j]));
+}
+
+static size_t format_row(const struct pair_matrix *m, const struct db *db,
+			 unsigned int i, char *out)
+{
+	const unsigned int n = m->num_teams;
+	const char *home = db_team_name(db, i);
+	size_t len = 0;
+	unsigned int j;
+
+	for (j = 0; j < n; j++) {
+		if (j == i)
+			continue;
+		len += sprintf(out + len, "%s%s,%s,%.3f,%.4f\n", m->csv_key,
+			       home, db_team_name(db, j),
+			       m->margin[(size_t)i * n + j],
+			       m->prob[(size_t)i * n + j]);
+	}
+
+	return len;
+}
+
+/* compute, and maybe format, the row blocks [begin, end) */
+static void matrix_piece(void *arg, unsigned int begin, unsigned int end)
+{
+	const struct matrix_job *job = arg;
+	struct pair_matrix *m = job->m;
+	const unsigned int n = m->num_teams;
+	unsigned int block, i, last;
+	size_t len;
+
+	for (block = begin; block < end; block++) {
+		last = (block + 1) * MATRIX_ROW_BLOCK;
+		if (last > n)
+			last = n;
+
+		for (i = block * MATRIX_ROW_BLOCK; i < last; i++)
+			compute_row(job, i);
+
+		if (!m->csv)
+			continue;
+
+		len = 0;
+		for (i = block * MATRIX_ROW_BLOCK; i < last; i++)
+			len += format_row(m, job->db, i, m->csv[block] + len);
+		m->csv_len[block] = len;
+	}
+}
+
+
+/* api functions */
+
+/* with csv, room for the text of a whole matrix is kept too */
+int matrix_init(struct pair_matrix *m, unsigned int num_teams, bool csv)
+{
+	const unsigned int blocks = (num_teams + MATRIX_ROW_BLOCK - 1) /
+				    MATRIX_ROW_BLOCK;
+	const size_t cells = (size_t)num_teams * num_teams;
+	unsigned int i;
+
+	memset(m, 0, sizeof(struct pair_matrix));
+	m->num_teams = num_teams;
+	m->num_blocks = blocks;
+
+	m->margin = mem_alloc(MEM_ALGORITHMS, (cells ? cells : 1) * sizeof(float));
+	m->prob = mem_alloc(MEM_ALGORITHMS, (cells ? cells : 1) * sizeof(float));
+	if (!m->margin || !m->prob)
+		goto fail;
+
+	if (!csv)
+		return 0;
+
+	m->csv = mem_calloc(MEM_ALGORITHMS, blocks ? blocks : 1, sizeof(char *));
+	m->csv_len = mem_calloc(MEM_ALGORITHMS, blocks ? blocks : 1,
+				sizeof(size_t));
+	if (!m->csv || !m->csv_len)
+		goto fail;
+
+	/* a block of rows, every row without its own cell */
+	for (i = 0; i < blocks; i++) {
+		m->csv[i] = mem_alloc(MEM_ALGORITHMS, (size_t)MATRIX_ROW_BLOCK *
+				      num_teams * MATRIX_CSV_LINE);
+		if (!m->csv[i])
+			goto fail;
+	}
+
+	return 0;
+
+fail:
+	fprintf(stderr, "%s: malloc failed\n", progname);
+	matrix_free(m);
+	return -1;
+}
+
+void matrix_free(struct pair_matrix *m)
+{
+	unsigned int i;
+
+	if (m->csv) {
+		for (i = 0; i < m->num_blocks; i++)
+			mem_free(m->csv[i]);
+	}
+	mem_free(m->csv);
+	mem_free(m->csv_len);
+	mem_free(m->margin);
+	mem_free(m->prob);
+	memset(m, 0, sizeof(struct pair_matrix));
+}
+
+/* the sport, algorithm and week the csv text of m is for */
+void matrix_label(struct pair_matrix *m, const struct db *db,
+		  const char *algo, const struct week_id *week)
+{
+	snprintf(m->csv_key, sizeof(m->csv_key), "%s,%s,%d,%d,", db->sport,
+		 algo, week->year, week->week);
+}
+
+/*
+ * the logistic scale that best turns r's margins into the results
+ * of every game through the end of last_week
+ */
+double matrix_scale(const struct db *db, const struct ratings *r,
+		    unsigned int last_week)
+{
+	const int end = db->weeks[last_week].game_end;
+	double a = 0.0, grad, hess, margin, p, step;
+	unsigned int iter;
+	int k;
+
+	assert(last_week < db->num_weeks);
+
+	/* newton's method; the objective is concave in a */
+	for (iter = 0; iter < MATRIX_SCALE_ITERATIONS; iter++) {
+		grad = -MATRIX_SCALE_PRIOR * a;
+		hess = -MATRIX_SCALE_PRIOR;
+		for (k = 0; k < end; k++) {
+			margin = ratings_margin(r, &db->games[k]);
+			p = 1.0 / (1.0 + exp(-a * margin));
+			grad += (game_result(&db->games[k]) - p) * margin;
+			hess -= p * (1.0 - p) * margin * margin;
+		}
+
+		step = grad / hess;
+		a -= step;
+		if (fabs(step) <= MATRIX_SCALE_TOLERANCE * (1.0 + fabs(a)))
+			break;
+	}
+
+	return a;
+}
+
+/* fill m from r, and if m was made for csv, format its text too */
+void matrix_compute(struct pair_matrix *m, struct pool *pool,
+		    const struct db *db, const struct ratings *r, double scale)
+{
+	struct matrix_job job;
+	unsigned int i;
+
+	assert(r->num_teams == m->num_teams);
+
+	m->home_adv = r->home_adv;
+	m->scale = scale;
+
+	job.m = m;
+	job.db = db;
+	for (i = 0; i < m->num_teams; i++) {
+		job.home[i] = (float)(r->team[i] + r->home_adv);
+		job.team[i] = (float)r->team[i];
+	}
+	pool_parallel_for(pool, 0, m->num_blocks, 1, matrix_piece, &job);
+}
+
+int matrix_write_binary(FILE *stream, const struct pair_matrix *m,
+			const struct db *db, const char *algo,
+			const struct week_id *week)
+{
+	const size_t cells = (size_t)m->num_teams * m->num_teams;
+	struct matrix_header h;
+	char name[TEAM_NAME_MAX];
+	unsigned int i;
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, MATRIX_MAGIC, sizeof(h.magic));
+	h.version = MATRIX_VERSION;
+	strncpy(h.sport, db->sport, sizeof(h.sport) - 1);
+	strncpy(h.algorithm, algo, sizeof(h.algorithm) - 1);
+	h.year = week->year;
+	h.week = week->week;
+	h.num_teams = m->num_teams;
+	h.home_adv = (float)m->home_adv;
+	h.scale = (float)m->scale;
+
+	if (fwrite(&h, sizeof(h), 1, stream) != 1)
+		return -1;
+
+	for (i = 0; i < m->num_teams; i++) {
+		memset(name, 0, sizeof(name));
+		strncpy(name, db_team_name(db, i), sizeof(name) - 1);
+		if (fwrite(name, sizeof(name), 1, stream) != 1)
+			return -2;
+	}
+
+	if (fwrite(m->margin, sizeof(float), cells, stream) != cells ||
+	    fwrite(m->prob, sizeof(float), cells, stream) != cells)
+		return -3;
+
+	return 0;
+}
+
+/* the column names, once at the top of a csv file */
+int matrix_write_csv_header(FILE *stream)
+{
+	if (fputs("sport,algorithm,year,week,home,away,margin,probability\n",
+		  stream) < 0)
+		return -1;
+
+	return 0;
+}
+
+/* the text matrix_compute() formatted */
+int matrix_write_csv(FILE *stream, const struct pair_matrix *m)
+{
+	unsigned int i;
+
+	assert(m->csv);
+
+	for (i = 0; i < m->num_blocks; i++) {
+		if (fwrite(m->csv[i], 1, m->csv_len[i], stream) != m->csv_len[i])
+			return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,319 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "../spreden.h"
+#include "../dstruct/mem.h"
+#include "algorithms.h"
+
+/*
+ * queries over the rating history rank keeps with --history
+ *
+ *   history  a stored ranking for each target week, or with --team
+ *            where that team stood in each
+ *   trend    a team's rating and its change each target week
+ *   movers   the teams that rose and fell the most each target week
+ *
+ * none of them load or rate any games. trend reads just the one
+ * team's column of the history; the others read whole weeks
+ */
+
+typedef int (*query_fn)(const struct rc *rc, const char *sport,
+			const char *algo, const struct rating_history *h,
+			unsigned int first, unsigned int last);
+
+
+/* helper functions */
+
+/* qsort has no context argument, so the values being sorted go here */
+static const float *sort_values;
+
+static int compare_columns(const void *a, const void *b)
+{
+	float va = sort_values[*(const unsigned int *)a];
+	float vb = sort_values[*(const unsigned int *)b];
+
+	return (va < vb) - (va > vb);
+}
+
+/* the columns with a value, largest value first; returns how many */
+static unsigned int order_columns(const float *values, unsigned int n,
+				  unsigned int *order)
+{
+	unsigned int c, count = 0;
+
+	for (c = 0; c < n; c++) {
+		if (!isnan(values[c]))
+			order[count++] = c;
+	}
+
+	sort_values = values;
+	qsort(order, count, sizeof(unsigned int), compare_columns);
+
+	return count;
+}
+
+/* place[c] - column c's place in order, from 1, or 0 if unrated */
+static void place_columns(const unsigned int *order, unsigned int count,
+			  unsigned int n, unsigned int *place)
+{
+	unsigned int i;
+
+	memset(place, 0, n * sizeof(unsigned int));
+	for (i = 0; i < count; i++)
+		place[order[i]] = i + 1;
+}
+
+static void print_week(const char *sport, const char *algo,
+		       const struct week_id *id)
+{
+	printf("%s %s %d week %d\n", sport, algo, id->year, id->week);
+}
+
+/* the column of rc's team in h, or -1 */
+static int find_team(const struct rc *rc, const char *sport,
+		     const char *algo, const struct rating_history *h)
+{
+	int column = history_find_team(h, rc->team);
+
+	if (column < 0)
+		fprintf(stderr, "%s: no team '%s' in the %s %s rating history\n",
+			progname, rc->team, sport, algo);
+
+	return column;
+}
+
+/* where rc's team stood in each week first..last */
+static void print_standing(const char *sport, const char *algo,
+			   const struct rating_history *h, unsigned int column,
+			   unsigned int first, unsigned int last)
+{
+	const unsigned int n = history_num_teams(h);
+	const struct week_id *id;
+	unsigned int order[DB_MAX_TEAMS];
+	unsigned int place[DB_MAX_TEAMS];
+	float values[DB_MAX_TEAMS];
+	unsigned int count, i;
+
+	printf("%s %s %s\n", sport, algo, history_team_name(h, column));
+	for (i = first; i <= last; i++) {
+		history_row(h, i, values);
+		count = order_columns(values, n, order);
+		place_columns(order, count, n, place);
+
+		id = history_week(h, i);
+		if (!place[column]) {
+			printf("%4d week %-2d  unrated\n", id->year, id->week);
+			continue;
+		}
+		printf("%4d week %-2d %4u of %-4u %8.3f\n", id->year, id->week,
+		       place[column], count, values[column]);
+	}
+	putchar('\n');
+}
+
+static int history_query(const struct rc *rc, const char *sport,
+			 const char *algo, const struct rating_history *h,
+			 unsigned int first, unsigned int last)
+{
+	unsigned int order[DB_MAX_TEAMS];
+	float values[DB_MAX_TEAMS];
+	unsigned int count, i, j;
+	int column;
+
+	if (rc->team) {
+		if ((column = find_team(rc, sport, algo, h)) < 0)
+			return -1;
+		print_standing(sport, algo, h, column, first, last);
+		return 0;
+	}
+
+	/* the same as rank prints */
+	for (i = first; i <= last; i++) {
+		history_row(h, i, values);
+		count = order_columns(values, history_num_teams(h), order);
+
+		print_week(sport, algo, history_week(h, i));
+		for (j = 0; j < count; j++) {
+			printf("%4u  %-*s %8.3f\n", j + 1, TEAM_NAME_MAX,
+			       history_team_name(h, order[j]), values[order[j]]);
+		}
+		printf("home advantage %.3f\n\n", history_home_adv(h, i));
+	}
+
+	return 0;
+}
+
+static int trend_query(const struct rc *rc, const char *sport,
+		       const char *algo, const struct rating_history *h,
+		       unsigned int first, unsigned int last)
+{
+	const struct week_id *id;
+	float *values;
+	float prev = NAN;
+	unsigned int i;
+	int column;
+
+	if ((column = find_team(rc, sport, algo, h)) < 0)
+		return -1;
+
+	values = mem_alloc(MEM_ALGORITHMS, (last - first + 1) * sizeof(float));
+	if (!values) {
+		fprintf(stderr, "%s: malloc failed\n", progname);
+		return -2;
+	}
+
+	history_column(h, column, first, last, values);
+
+	printf("%s %s %s\n", sport, algo, history_team_name(h, column));
+	for (i = first; i <= last; i++) {
+		if (isnan(values[i - first]))
+			continue;
+
+		id = history_week(h, i);
+		printf("%4d week %-2d %8.3f", id->year, id->week,
+		       values[i - first]);
+		if (!isnan(prev))
+			printf(" %+8.3f", values[i - first] - prev);
+		putchar('\n');
+		prev = values[i - first];
+	}
+	putchar('\n');
+
+	mem_free(values);
+	return 0;
+}
+
+static void print_mover(const struct rating_history *h, unsigned int column,
+			const float *values, const float *change,
+			const unsigned int *place, const unsigned int *was)
+{
+	printf("%4u  %-*s %8.3f %+8.3f  was %u\n", place[column],
+	       TEAM_NAME_MAX, history_team_name(h, column), values[column],
+	       change[column], was[column]);
+}
+
+static int movers_query(const struct rc *rc, const char *sport,
+			const char *algo, const struct rating_history *h,
+			unsigned int first, unsigned int last)
+{
+	const unsigned int n = history_num_teams(h);
+	unsigned int order[DB_MAX_TEAMS];
+	unsigned int place[DB_MAX_TEAMS];
+	unsigned int was[DB_MAX_TEAMS];
+	float values[DB_MAX_TEAMS];
+	float before[DB_MAX_TEAMS];
+	float change[DB_MAX_TEAMS];
+	const struct week_id *id;
+	unsigned int count, i, j, c;
+
+	/* each week is against the week before it in the history */
+	if (first == 0)
+		first = 1;
+	if (first > last) {
+		id = history_week(h, 0);
+		fprintf(stderr, "%s: no %s %s ratings before %d week %d\n",
+			progname, sport, algo, id->year, id->week);
+		return -1;
+	}
+
+	for (i = first; i <= last; i++) {
+		history_row(h, i - 1, before);
+		count = order_columns(before, n, order);
+		place_columns(order, count, n, was);
+
+		history_row(h, i, values);
+		count = order_columns(values, n, order);
+		place_columns(order, count, n, place);
+
+		for (c = 0; c < n; c++)
+			change[c] = values[c] - before[c];
+		count = order_columns(change, n, order);
+
+		id = history_week(h, i - 1);
+		printf("%s %s %d week %d since %d week %d\n", sport, algo,
+		       history_week(h, i)->year, history_week(h, i)->week,
+		       id->year, id->week);
+
+		puts("rising");
+		for (j = 0; j < count && j < rc->top && change[order[j]] > 0.0f; j++)
+			print_mover(h, order[j], values, change, place, was);
+
+		puts("falling");
+		for (j = 0; j < count && j < rc->top &&
+		     change[order[count - 1 - j]] < 0.0f; j++)
+			print_mover(h, order[count - 1 - j], values, change,
+				    place, was);
+		putchar('\n');
+	}
+
+	return 0;
+}
+
+/* run fn over the target weeks of every sport and algorithm's history */
+static int each_history(const struct rc *rc, const char *command,
+			query_fn fn)
+{
+	struct rating_history h;
+	const char *sport, *algo;
+	unsigned int first, last;
+	unsigned int i, j;
+	int err = 0;
+
+	if (!rc->history_dir) {
+		fprintf(stderr, "%s: %s reads a rating history; give --history\n",
+			progname, command);
+		return -1;
+	}
+
+	for (i = 0; i < rc->sports.length && !err; i++) {
+		sport = VECTOR_AT(&rc->sports, char *, i);
+		for (j = 0; j < rc->user_algorithms.length && !err; j++) {
+			algo = VECTOR_AT(&rc->user_algorithms, char *, j);
+			if (history_open(&h, rc->history_dir, sport, algo,
+					 false) < 0) {
+				err = -2;
+				break;
+			}
+
+			if (history_week_range(&h, &rc->target_begin,
+					       &rc->target_end, &first,
+					       &last) < 0) {
+				fprintf(stderr, "%s: no %s %s ratings kept for the target weeks\n",
+					progname, sport, algo);
+				err = -3;
+			} else if (fn(rc, sport, algo, &h, first, last) < 0) {
+				err = -4;
+			}
+
+			history_close(&h);
+		}
+	}
+
+	return err;
+}
+
+
+/* api functions */
+
+int query_history(struct state *s)
+{
+	return each_history(&s->rc, "history", history_query);
+}
+
+int query_movers(struct state *s)
+{
+	return each_history(&s->rc, "movers", movers_query);
+}
+
+int query_trend(struct state *s)
+{
+	if (!s->rc.team) {
+		fprintf(stderr, "%s: trend needs a team; give --team\n",
+			progname);
+		return -1;
+	}
+
+	return each_history(&s->rc, "trend", trend_query);
+}
@@ -0,0 +1,189 @@
+#include <stdio.h>
+#include <assert.h>
+
+#include "../spreden.h"
+#include "../dstruct/csr.h"
+#include "../dstruct/mem.h"
+#include "algorithms.h"
+
+/*
+ * strength of schedule at any depth
+ *
+ * level 0 is each team's record as a winning percentage, ties
+ * counting half, and level k is the games-weighted mean of its
+ * opponents' level k-1. with P the schedule adjacency scaled so
+ * each row sums to one, level k = P level k-1, so every level
+ * is one sparse product instead of another nested walk over the
+ * schedules
+ *
+ * teams without games sit at 0.5 on every level
+ *
+ * a rating blends levels 1 up, each weighted twice the next, so
+ * sos is the usual two parts opponents' record to one part
+ * opponents' opponents' and sos-deep goes SOS_MAX_LEVELS deep
+ */
+
+#define SOS_NO_GAMES  0.5
+
+/* levels the sos algorithm rates with */
+#define SOS_LEVELS    3
+
+
+/* helper functions */
+
+/* fill p with the row scaled schedule and level 0 with the records */
+static int build_schedule(const struct h2h *h, struct csr *p,
+			  double *record)
+{
+	const unsigned int n = h->num_teams;
+	const struct h2h_cell *row;
+	double wins[DB_MAX_TEAMS] = { 0 };
+	double losses[DB_MAX_TEAMS] = { 0 };
+	double games[DB_MAX_TEAMS] = { 0 };
+	unsigned int i, j, k, tj;
+
+	/* totals, streaming each row a tile segment at a time */
+	for (i = 0; i < n; i++) {
+		for (tj = 0; tj < h->num_tiles; tj++) {
+			row = h2h_row(h, i, tj);
+			for (k = 0; k < H2H_TILE; k++) {
+				j = tj * H2H_TILE + k;
+				games[i] += row[k].games;
+				wins[i] += row[k].wins;
+				if (j < n)
+					losses[j] += row[k].wins;
+			}
+		}
+	}
+
+	for (i = 0; i < n; i++) {
+		if (games[i] == 0) {
+			record[i] = SOS_NO_GAMES;
+			continue;
+		}
+		/* what is neither a win nor a loss is a tie */
+		record[i] = (wins[i] + 0.5 * (games[i] - wins[i] - losses[i])) /
+			    games[i];
+	}
+
+	csr_clear(p);
+	for (i = 0; i < n; i++) {
+		for (tj = 0; tj < h->num_tiles; tj++) {
+			row = h2h_row(h, i, tj);
+			for (k = 0; k < H2H_TILE; k++) {
+				if (row[k].games &&
+				    csr_push(p, tj * H2H_TILE + k,
+					     row[k].games / games[i]) < 0)
+					return -1;
+			}
+		}
+		if (csr_end_row(p) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+/* rate by levels 1..num_levels-1, each weighted twice the next */
+static int rate_levels(const struct db *db, unsigned int last_week,
+		       unsigned int num_levels, struct ratings *out)
+{
+	struct sos *s;
+	unsigned int i, k;
+	double sum, weight, total;
+
+	assert(num_levels >= 2);
+
+	s = mem_alloc(MEM_ALGORITHMS, sizeof(struct sos));
+	if (!s) {
+		fprintf(stderr, "%s: malloc failed\n", progname);
+		return -1;
+	}
+
+	if (sos_compute(db, last_week, num_levels, s) < 0) {
+		mem_free(s);
+		return -2;
+	}
+
+	/* weights 2^(num_levels-2) down to 1 */
+	total = (double)((1u << (num_levels - 1)) - 1);
+
+	out->num_teams = db->num_teams;
+	out->home_adv = 0.0;
+	for (i = 0; i < db->num_teams; i++) {
+		sum = 0.0;
+		weight = (double)(1u << (num_levels - 2));
+		for (k = 1; k < num_levels; k++, weight /= 2.0)
+			sum += weight * s->level[k][i];
+		out->team[i] = sum / total;
+	}
+
+	mem_free(s);
+	return 0;
+}
+
+
+/* api functions */
+
+/*
+ * compute num_levels levels of strength of schedule using every
+ * game through the end of last_week
+ */
+int sos_compute(const struct db *db, unsigned int last_week,
+		unsigned int num_levels, struct sos *out)
+{
+	const struct h2h *h = &db->h2h;
+	struct h2h local;
+	struct csr p;
+	unsigned int i, k;
+	int err = 0;
+
+	assert(last_week < db->num_weeks);
+	assert(num_levels > 0 && num_levels <= SOS_MAX_LEVELS);
+
+	/* the db's pair totals cover every loaded week */
+	h2h_init(&local);
+	if (h->num_weeks != last_week + 1) {
+		if (h2h_build(&local, db, last_week + 1) < 0)
+			return -1;
+		h = &local;
+	}
+
+	csr_init(&p, MEM_ALGORITHMS);
+	if (csr_reserve(&p, db->num_teams, db->num_teams * TEAM_SCHED_MAX) < 0 ||
+	    build_schedule(h, &p, out->level[0]) < 0) {
+		fprintf(stderr, "%s: malloc failed\n", progname);
+		err = -2;
+		goto out;
+	}
+
+	out->num_teams = db->num_teams;
+	out->num_levels = num_levels;
+	for (k = 1; k < num_levels; k++) {
+		csr_spmv(&p, out->level[k-1], out->level[k], 0, p.num_rows);
+
+		for (i = 0; i < db->num_teams; i++) {
+			if (p.row_begin[i] == p.row_begin[i+1])
+				out->level[k][i] = SOS_NO_GAMES;
+		}
+	}
+
+out:
+	csr_free(&p);
+	h2h_free(&local);
+	return err;
+}
+
+/* the usual published strength of schedule */
+int sos_rate(const struct db *db, unsigned int last_week,
+	     struct ratings *out)
+{
+	return rate_levels(db, last_week, SOS_LEVELS, out);
+}
+
+/* strength of schedule as deep as the levels go */
+int sos_deep_rate(const struct db *db, unsigned int last_week,
+		  struct ratings *out)
+{
+	return rate_levels(db, last_week, SOS_MAX_LEVELS, out);
+}
@@ -0,0 +1,484 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <math.h>
+
+#include "../spreden.h"
+#include "../dstruct/mem.h"
+#include "../dstruct/pool.h"
+#include "../profile/profile.h"
+#include "algorithms.h"
+
+/*
+ * parameter search for the tunable algorithms
+ *
+ * each --grid name=lo:hi:step range is one axis; the points are
+ * every combination of the axes, or with --random, that many
+ * points drawn uniformly from the ranges. parameters without a
+ * range keep the builtin algorithm's value
+ *
+ * every point is scored walk forward over the target weeks, the
+ * same way analyze scores an algorithm: the rmse of the margins
+ * and the fraction of winners picked. the margins are first
+ * scaled by their least squares fit to the results, so that
+ * algorithms rated in logits or elo are scored in points too.
+ * a point is printed if no other point beats it on one score
+ * without losing on the other
+ *
+ * the points are split across the pool; they all read the one
+ * loaded db
+ */
+
+/* seed of the random search, so a search can be repeated */
+#define TUNE_SEED  0x5eed5eed5eed5eedULL
+
+static const struct tunable *const tunables[] = {
+	&bt_tunable,
+	&elo_tunable,
+	&massey_tunable
+};
+
+#define NUM_TUNABLES (sizeof(tunables) / sizeof(tunables[0]))
+
+/* one --grid range, for one parameter of one tunable */
+struct tune_range {
+	unsigned int param;
+	double lo;
+	double hi;
+	double step;
+	unsigned int count;
+};
+
+struct tune_point {
+	double param[TUNE_MAX_PARAMS];
+	double rmse;
+	double correct;
+	int err;
+};
+
+/* tune_job is one tunable's points over one db's target weeks */
+struct tune_job {
+	const struct db *db;
+	const struct tunable *t;
+	unsigned int first;
+	unsigned int last;
+	struct tune_point *points;
+	atomic_uint failed;
+};
+
+
+/* helper functions */
+
+static const struct tunable *tunable_find(const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < NUM_TUNABLES; i++) {
+		if (strcmp(tunables[i]->name, name) == 0)
+			return tunables[i];
+	}
+
+	return NULL;
+}
+
+static int param_find(const struct tunable *t, const char *name,
+		      size_t len)
+{
+	unsigned int i;
+
+	for (i = 0; i < t->num_params; i++) {
+		if (strlen(t->param[i]) == len &&
+		    strncmp(t->param[i], name, len) == 0)
+			return i;
+	}
+
+	return -1;
+}
+
+/*
+ * parse name=v or name=lo:hi[:step] for t's parameter name; 1 if
+ * t has no such parameter, 0 on success and negative on error
+ */
+static int parse_range(const char *spec, const struct tunable *t,
+		       bool random, struct tune_range *out)
+{
+	const char *eq = strchr(spec, '=');
+	char *endptr;
+	int param;
+
+	if (!eq) {
+		fprintf(stderr, "%s: '%s' is not a name=lo:hi:step range\n",
+			progname, spec);
+		return -1;
+	}
+
+	param = param_find(t, spec, eq - spec);
+	if (param < 0)
+		return 1;
+	out->param = param;
+
+	out->lo = strtod(eq + 1, &endptr);
+	out->hi = out->lo;
+	out->step = 0.0;
+	if (endptr != eq + 1 && *endptr == ':')
+		out->hi = strtod(endptr + 1, &endptr);
+	if (endptr != eq + 1 && *endptr == ':')
+		out->step = strtod(endptr + 1, &endptr);
+
+	if (endptr == eq + 1 || *endptr != '\0' || out->hi < out->lo ||
+	    out->step < 0.0) {
+		fprintf(stderr, "%s: '%s' is not a name=lo:hi:step range\n",
+			progname, spec);
+		return -2;
+	}
+
+	if (random || out->hi == out->lo) {
+		out->count = 1;
+	} else if (out->step == 0.0) {
+		fprintf(stderr, "%s: '%s' needs a step for a grid search\n",
+			progname, spec);
+		return -3;
+	} else if ((out->hi - out->lo) / out->step >= TUNE_MAX_POINTS) {
+		fprintf(stderr, "%s: '%s' has too many points; TUNE_MAX_POINTS is %d\n",
+			progname, spec, TUNE_MAX_POINTS);
+		return -4;
+	} else {
+		/* the slack keeps hi in when the steps round short */
+		out->count = (unsigned int)((out->hi - out->lo) / out->step +
+					    1e-9) + 1;
+	}
+
+	return 0;
+}
+
+/* the rc's ranges that apply to t, or negative on error */
+static int parse_ranges(const struct rc *rc, const struct tunable *t,
+			struct tune_range *ranges)
+{
+	unsigned int i, n = 0;
+	int err;
+
+	for (i = 0; i < rc->tune_grid.length; i++) {
+		err = parse_range(VECTOR_AT(&rc->tune_grid, char *, i), t,
+				  rc->tune_random > 0, &ranges[n]);
+		if (err < 0)
+			return -1;
+		if (err > 0)
+			continue;
+
+		if (n == TUNE_MAX_PARAMS) {
+			fprintf(stderr, "%s: more ranges than %s has parameters\n",
+				progname, t->name);
+			return -2;
+		}
+		n++;
+	}
+
+	return n;
+}
+
+/* make sure every algorithm is tunable and every range is used */
+static int check_search(const struct rc *rc)
+{
+	struct tune_range range;
+	const struct tunable *t;
+	const char *spec;
+	unsigned int i, j;
+	bool used;
+	int err;
+
+	for (i = 0; i < rc->user_algorithms.length; i++) {
+		if (!tunable_find(VECTOR_AT(&rc->user_algorithms, char *, i))) {
+			fprintf(stderr, "%s: '%s' has no parameters to tune\n",
+				progname,
+				VECTOR_AT(&rc->user_algorithms, char *, i));
+			return -1;
+		}
+	}
+
+	for (i = 0; i < rc->tune_grid.length; i++) {
+		spec = VECTOR_AT(&rc->tune_grid, char *, i);
+		used = false;
+		for (j = 0; j < rc->user_algorithms.length && !used; j++) {
+			t = tunable_find(VECTOR_AT(&rc->user_algorithms, char *, j));
+			err = parse_range(spec, t, rc->tune_random > 0, &range);
+			if (err < 0)
+				return -2;
+			used = err == 0;
+		}
+		if (!used) {
+			fprintf(stderr, "%s: no algorithm has a parameter for '%s'\n",
+				progname, spec);
+			return -3;
+		}
+	}
+
+	return 0;
+}
+
+static uint64_t next_random(uint64_t *state)
+{
+	uint64_t x = *state;
+
+	/* xorshift64* */
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*state = x;
+
+	return x * 0x2545f4914f6cdd1dULL;
+}
+
+/* uniform on [0, 1) */
+static double next_uniform(uint64_t *state)
+{
+	return (next_random(state) >> 11) * 0x1.0p-53;
+}
+
+/*
+ * the points to try, with the builtin values first; the count,
+ * or negative on error.  with no range for the algorithm every
+ * other point would be the builtin again, so there are none
+ */
+static int make_points(const struct rc *rc, const struct tunable *t,
+		       const struct tune_range *ranges, unsigned int num_ranges,
+		       struct tune_point **out)
+{
+	struct tune_point *points;
+	uint64_t state = TUNE_SEED;
+	unsigned long n = 1;
+	unsigned int i, j, k;
+	const struct tune_range *r;
+
+	if (!num_ranges) {
+		n = 0;
+	} else if (rc->tune_random) {
+		n = rc->tune_random;
+	} else {
+		for (j = 0; j < num_ranges; j++) {
+			n *= ranges[j].count;
+			if (n > TUNE_MAX_POINTS) {
+				fprintf(stderr, "%s: the grid for %s has too many points; TUNE_MAX_POINTS is %d\n",
+					progname, t->name, TUNE_MAX_POINTS);
+				return -1;
+			}
+		}
+	}
+
+	points = mem_alloc(MEM_ALGORITHMS, (n + 1) * sizeof(struct tune_point));
+	if (!points) {
+		fprintf(stderr, "%s: malloc failed\n", progname);
+		return -2;
+	}
+
+	for (i = 0; i <= n; i++) {
+		memcpy(points[i].param, t->value, sizeof(points[i].param));
+		points[i].err = 0;
+	}
+
+	for (i = 1; i <= n; i++) {
+		/* i - 1 in mixed radix, the last range fastest */
+		k = i - 1;
+		for (j = num_ranges; j-- > 0;) {
+			r = &ranges[j];
+			if (rc->tune_random) {
+				points[i].param[r->param] = r->lo +
+					(r->hi - r->lo) * next_uniform(&state);
+			} else {
+				points[i].param[r->param] = r->lo +
+					(k % r->count) * r->step;
+				k /= r->count;
+			}
+		}
+	}
+
+	*out = points;
+	return n + 1;
+}
+
+static void score_point(const struct tune_job *job, const struct forecast *f,
+			struct tune_point *p)
+{
+	const struct db *db = job->db;
+	const struct game *g;
+	double sy2 = 0.0, syp = 0.0, spp = 0.0;
+	unsigned int right = 0, n = 0;
+	unsigned int w;
+	double y, m, sse;
+	int k;
+
+	for (w = job->first; w <= job->last; w++) {
+		for (k = db->weeks[w].game_begin; k < db->weeks[w].game_end; k++) {
+			g = &db->games[k];
+			y = g->home_score - g->away_score;
+			m = forecast_margin(f, g, w);
+			sy2 += y * y;
+			syp += y * m;
+			spp += m * m;
+			right += (y * m > 0);
+			n++;
+		}
+	}
+
+	sse = spp > 0.0 ? sy2 - syp * syp / spp : sy2;
+	p->rmse = n ? sqrt(fmax(sse, 0.0) / n) : 0.0;
+	p->correct = n ? (double)right / n : 0.0;
+}
+
+/* rate and score points [begin, end) as one piece of the parallel for */
+static void tune_piece(void *arg, unsigned int begin, unsigned int end)
+{
+	struct tune_job *job = arg;
+	struct prof_scope scope;
+	struct forecast f;
+	unsigned int i;
+
+	f.algo = NULL;
+	f.first = job->first - 1;
+	f.num_weeks = job->last - job->first + 1;
+	f.r = mem_alloc(MEM_ALGORITHMS, f.num_weeks * sizeof(struct ratings));
+	if (!f.r) {
+		fprintf(stderr, "%s: malloc failed\n", progname);
+		atomic_fetch_add(&job->failed, end - begin);
+		for (i = begin; i < end; i++)
+			job->points[i].err = -1;
+		return;
+	}
+
+	for (i = begin; i < end; i++) {
+		prof_begin(&scope, PROF_ALGORITHMS);
+		job->points[i].err = job->t->rate_weeks(job->db, f.first,
+							job->last - 1,
+							job->points[i].param,
+							f.r);
+		prof_end(&scope);
+
+		if (job->points[i].err)
+			atomic_fetch_add(&job->failed, 1);
+		else
+			score_point(job, &f, &job->points[i]);
+	}
+
+	mem_free(f.r);
+}
+
+/* by rmse, then most correct first */
+static int compare_points(const void *a, const void *b)
+{
+	const struct tune_point *p = a;
+	const struct tune_point *q = b;
+
+	if (p->rmse != q->rmse)
+		return p->rmse < q->rmse ? -1 : 1;
+	if (p->correct != q->correct)
+		return p->correct > q->correct ? -1 : 1;
+	return 0;
+}
+
+static void print_point(const char *label, const struct tunable *t,
+			const struct tune_point *p)
+{
+	unsigned int i;
+
+	printf("%-8s", label);
+	for (i = 0; i < t->num_params; i++)
+		printf(" %10.4g", p->param[i]);
+	printf(" %10.3f %8.3f\n", p->rmse, p->correct);
+}
+
+/*
+ * print the builtin point and the pareto front of the rest; the
+ * points after the first are sorted in the process
+ */
+static void print_tuning(const struct tune_job *job, unsigned int num_points)
+{
+	const struct db *db = job->db;
+	const struct tunable *t = job->t;
+	struct tune_point *rest = &job->points[1];
+	double best = -1.0;
+	unsigned int games = 0;
+	unsigned int i, w;
+
+	for (w = job->first; w <= job->last; w++)
+		games += db->weeks[w].game_end - db->weeks[w].game_begin;
+
+	printf("%s tune %s %d week %d to %d week %d, %u games, %u points\n",
+	       db->sport, t->name, db->weeks[job->first].id.year,
+	       db->weeks[job->first].id.week, db->weeks[job->last].id.year,
+	       db->weeks[job->last].id.week, games, num_points - 1);
+	printf("%-8s", "");
+	for (i = 0; i < t->num_params; i++)
+		printf(" %10s", t->param[i]);
+	printf(" %10s %8s\n", "rmse", "correct");
+
+	if (!job->points[0].err)
+		print_point("builtin", t, &job->points[0]);
+
+	/* failed points sort last */
+	for (i = 0; i < num_points - 1; i++) {
+		if (rest[i].err)
+			rest[i].rmse = INFINITY;
+	}
+	qsort(rest, num_points - 1, sizeof(struct tune_point), compare_points);
+
+	for (i = 0; i < num_points - 1 && !rest[i].err; i++) {
+		if (rest[i].correct > best) {
+			print_point("pareto", t, &rest[i]);
+			best = rest[i].correct;
+		}
+	}
+
+	if (atomic_load(&job->failed))
+		printf("%u points failed to rate\n", atomic_load(&job->failed));
+	putchar('\n');
+}
+
+
+/* api functions */
+
+/*
+ * search the parameters of each algorithm in the rc over the
+ * target weeks of every sport
+ */
+int algo_tune(struct state *s)
+{
+	const struct vector *names = &s->rc.user_algorithms;
+	struct tune_range ranges[TUNE_MAX_PARAMS];
+	struct tune_job job;
+	struct db *db;
+	unsigned int i, j;
+	int num_ranges, num_points;
+
+	if (check_search(&s->rc) < 0)
+		return -1;
+
+	for (i = 0; i < s->num_dbs; i++) {
+		db = s->dbs[i];
+		if (forecast_range(&s->rc, db, &job.first, &job.last) < 0)
+			return -2;
+
+		for (j = 0; j < names->length; j++) {
+			job.db = db;
+			job.t = tunable_find(VECTOR_AT(names, char *, j));
+			num_ranges = parse_ranges(&s->rc, job.t, ranges);
+			if (num_ranges < 0)
+				return -3;
+
+			num_points = make_points(&s->rc, job.t, ranges,
+						 num_ranges, &job.points);
+			if (num_points < 0)
+				return -4;
+
+			atomic_init(&job.failed, 0);
+			pool_parallel_for(&s->pool, 0, num_points, 1,
+					  tune_piece, &job);
+
+			print_tuning(&job, num_points);
+			mem_free(job.points);
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <math.h>
+#include <assert.h>
+
+#include "../spreden.h"
+#include "algorithms.h"
+
+/*
+ * least squares over a moving window of weeks
+ *
+ * the window holds the last size weeks, each weighted decay^age
+ * with age in weeks since it was pushed. pushing a week changes
+ * the normal equations in place instead of rebuilding them:
+ *
+ *   scale every game already in by decay
+ *   take out the week that falls off the end, at decay^size
+ *   add the new week's games at weight 1
+ *
+ * so walking a window forward costs the games going in and out
+ * each week, not every game in the window. a push that only adds
+ * fewer games than the system has unknowns, with no decay, is
+ * done as rank-one updates of a solved system, and the next
+ * ratings need no solve at all; otherwise they take one solve.
+ * weeks are never dropped by rank-one downdates, which lose too
+ * much precision when a short window is close to singular
+ */
+
+
+/* helper functions */
+
+/* add (weight > 0) or remove (weight < 0) the games of week w */
+static int change_week(struct lsq *l, const struct week *w,
+		       const struct db *db, double weight, bool rank_one)
+{
+	int i;
+
+	for (i = w->game_begin; i < w->game_end; i++) {
+		if (!rank_one)
+			lsq_accumulate(l, &db->games[i], weight);
+		else if (lsq_add(l, &db->games[i], weight) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+
+/* api functions */
+
+/* size is the weeks kept, 0 for all; decay is in (0, 1] */
+int window_init(struct lsq_window *win, unsigned int num_teams,
+		unsigned int size, double decay)
+{
+	assert(decay > 0.0 && decay <= 1.0);
+
+	if (lsq_init(&win->lsq, num_teams) < 0)
+		return -1;
+
+	win->size = size;
+	win->decay = decay;
+	win->begin = 0;
+	win->end = 0;
+
+	return 0;
+}
+
+void window_free(struct lsq_window *win)
+{
+	lsq_free(&win->lsq);
+}
+
+/* move the window forward to end with week, the next one in order */
+int window_push(struct lsq_window *win, const struct db *db,
+		unsigned int week)
+{
+	struct lsq *l = &win->lsq;
+	const struct week *out = NULL;
+	unsigned int changes;
+	bool rank_one;
+
+	assert(week == win->end && week < db->num_weeks);
+
+	changes = db->weeks[week].game_end - db->weeks[week].game_begin;
+	if (win->size && win->end - win->begin == win->size) {
+		out = &db->weeks[win->begin];
+		changes += out->game_end - out->game_begin;
+	}
+
+	rank_one = l->solved && win->decay == 1.0 && !out && changes < l->dim;
+
+	if (win->decay != 1.0 && win->end > win->begin)
+		lsq_scale(l, win->decay);
+
+	/* add before removing, so the system never loses a week's rank */
+	if (change_week(l, &db->weeks[week], db, 1.0, rank_one) < 0)
+		return -1;
+	win->end++;
+
+	if (out) {
+		if (change_week(l, out, db, -pow(win->decay, win->size),
+				rank_one) < 0)
+			return -2;
+		win->begin++;
+	}
+
+	return 0;
+}
+
+/* the ratings for the weeks now in the window */
+int window_ratings(struct lsq_window *win, struct ratings *out)
+{
+	if (!win->lsq.solved && lsq_solve(&win->lsq) < 0)
+		return -1;
+
+	lsq_ratings(&win->lsq, out);
+	return 0;
+}
@@ -1,16 +1,37 @@
 #ifndef DATABASE_H
 #define DATABASE_H
 
-#include <uthash.h>
+#include <yajl/yajl_parse.h>
 
 #include "../spreden.h"
-#include "../dstruct/list.h"
+#include "../dstruct/arena.h"
+#include "../dstruct/bitset.h"
+#include "../dstruct/intern.h"
+#include "../dstruct/pool.h"
+#include "../dstruct/vector.h"
 
 #define UUID_LENGTH  36
 
 #define DB_MAX_TEAMS    256
 #define DB_MAX_GAMES  32768
 #define DB_MAX_WEEKS    512
+#define DB_MAX_PATH    1024
+
+/* team sets are bitsets over team indices */
+_Static_assert(DB_MAX_TEAMS <= BITSET_MAX_BITS, "DB_MAX_TEAMS is too big for a bitset");
+
+/* team name bytes reserved per team up front */
+#define DB_TEAM_NAME_RESERVE  16
+
+/* chunk size of the db arena */
+#define DB_ARENA_CHUNK  16384
+
+/* side of a head-to-head tile, in teams */
+#define H2H_TILE        8
+#define H2H_TILE_CELLS  (H2H_TILE * H2H_TILE)
+
+/* most bytes one game takes in a game_pack */
+#define PACK_MAX_GAME_BYTES  14
 
 struct week {
 	struct week_id id;
@@ -18,31 +39,255 @@ struct week {
 	int game_end;
 };
 
-struct team_hash_entry {
-	UT_hash_handle hh;
-	char uuid[UUID_LENGTH+1];
-	int team;
+/* a row team's record against a column team; see h2h.c */
+struct h2h_cell {
+	int games;
+	int wins;
+	int margin;
+	/* home - games the row team hosted, and its margin in them */
+	int home;
+	int home_margin;
+};
+
+struct h2h {
+	unsigned int num_teams;
+	/* num_tiles - tiles along each side */
+	unsigned int num_tiles;
+	/* num_weeks - weeks [0, num_weeks) are counted */
+	unsigned int num_weeks;
+	struct h2h_cell *cells;
+};
+
+/* one week's games in a game_pack */
+struct pack_block {
+	/* offset - where the week starts in the pack's bytes */
+	unsigned int offset;
+	/* game - index of the week's first game */
+	unsigned int game;
+	unsigned int num_games;
+};
+
+/*
+ * game_pack is a db's games compressed into one block per week,
+ * for reading long histories in order; see pack.c
+ */
+struct game_pack {
+	/* num_weeks - weeks [0, num_weeks) are packed */
+	unsigned int num_weeks;
+	unsigned int num_games;
+	struct pack_block *blocks;
+	unsigned char *bytes;
+	size_t num_bytes;
+	size_t max_bytes;
 };
 
 struct db {
+	const char *sport;
 	struct team teams[DB_MAX_TEAMS];
 	struct game games[DB_MAX_GAMES];
 	struct week weeks[DB_MAX_WEEKS];
-	struct team_hash_entry *teams_hash;
+	/* uuids - interned in team order, so a uuid's id is its team */
+	struct intern uuids;
+	/* names - the team names the teams refer to */
+	struct intern names;
+	/* opponents - every team each team has played */
+	struct bitset opponents[DB_MAX_TEAMS];
+	/* h2h - every pair's head-to-head record over all loaded weeks */
+	struct h2h h2h;
+	/* pack - every loaded week's games packed in order, with --pack */
+	struct game_pack pack;
 	unsigned int num_teams;
 	unsigned int num_games;
 	unsigned int num_weeks;
-	struct list game_files;
+	struct vector game_files;
+	/* game_paths - one block backing the game_files strings */
+	char *game_paths;
+	/* arena - the game paths, freed with the db */
+	struct arena arena;
+};
+
+struct pack_iter {
+	const struct game_pack *pack;
+	unsigned int week;
+	unsigned int last_week;
+	/* src - the next game's first byte */
+	const unsigned char *src;
+	/* left - games of the week not yet decoded */
+	unsigned int left;
+	struct game current;
+};
+
+/*
+ * rating_history is one algorithm's ratings for one sport, every
+ * week it has rated, kept on disk by team; see history.c
+ */
+struct rating_history {
+	char path[DB_MAX_PATH];
+	int fd;
+	bool writable;
+	/* map - the whole file, map_size bytes */
+	unsigned char *map;
+	size_t map_size;
+	/* num_segments - segments the map covers */
+	unsigned int num_segments;
+	/* index - a row of each week rated, the latest, in week order */
+	unsigned int *index;
+	unsigned int num_index;
+	unsigned int max_index;
+	/* db, column - the db last appended from and its teams' columns */
+	const struct db *db;
+	unsigned int column[DB_MAX_TEAMS];
+};
+
+/* a replacement score for a game in the base db */
+struct game_override {
+	unsigned int game;
+	int home_score;
+	int away_score;
+};
+
+/*
+ * db_overlay is a set of what-if changes on top of a loaded db
+ *
+ * the base db is never copied or modified; readers see the
+ * merged games through overlay_get_game() or an overlay_iter.
+ * an overlay with no changes allocates nothing, so one can
+ * stand in for the plain db
+ */
+struct db_overlay {
+	const struct db *base;
+	/* games - added games and the week index of each, by week */
+	struct game *games;
+	unsigned int *game_weeks;
+	unsigned int num_games;
+	unsigned int max_games;
+	/* overrides - score changes, sorted by game */
+	struct game_override *overrides;
+	unsigned int num_overrides;
+	unsigned int max_overrides;
+};
+
+struct overlay_iter {
+	const struct db_overlay *overlay;
+	unsigned int week;
+	unsigned int last_week;
+	/* game, base_end - the next base game and the end of its week */
+	unsigned int game;
+	unsigned int base_end;
+	/* override - the first override not before game */
+	unsigned int override;
+	/* added, added_end - the same for the week's added games */
+	unsigned int added;
+	unsigned int added_end;
+	struct game current;
 };
 
 /* db.c */
+extern yajl_alloc_funcs db_parse_alloc;
 extern int hash_add(struct db *db, const char *uuid, int team);
 extern int hash_get(struct db *db, const char *uuid);
+extern const char *db_team_name(const struct db *db, unsigned int team);
+extern struct db *db_init(const char *sport);
+extern void db_free(struct db *db);
+extern int db_week_range(const struct db *db, const struct week_id *begin,
+			 const struct week_id *end,
+			 unsigned int *first, unsigned int *last);
 
 /* scan.c */
-extern int db_scan(struct state *s);
+extern int db_scan(const struct rc *rc, struct pool *pool, struct db *db);
 
 /* parse_teams.c */
 extern int db_parse_teams(struct db *db, const char *filename);
 
+/* parse_games.c */
+extern int db_parse_games(struct db *db, unsigned int week,
+			  const char *filename,
+			  const unsigned char *buf, size_t len);
+
+/* load.c */
+extern int db_load_games(struct db *db);
+
+/* opponents.c */
+extern unsigned int db_common_opponents(const struct db *db, unsigned int a,
+					unsigned int b, struct bitset *out);
+extern unsigned int db_components(const struct db *db);
+
+/* h2h.c */
+extern void h2h_init(struct h2h *h);
+extern void h2h_free(struct h2h *h);
+extern int h2h_reset(struct h2h *h, unsigned int num_teams);
+extern void h2h_add_game(struct h2h *h, const struct game *g);
+extern void h2h_append_weeks(struct h2h *h, const struct db *db,
+			     unsigned int end_week);
+extern int h2h_build(struct h2h *h, const struct db *db,
+		     unsigned int end_week);
+extern struct h2h_cell *h2h_tile(const struct h2h *h, unsigned int ti,
+				 unsigned int tj);
+extern struct h2h_cell *h2h_row(const struct h2h *h, unsigned int i,
+				unsigned int tj);
+extern struct h2h_cell *h2h_cell(const struct h2h *h, unsigned int i,
+				 unsigned int j);
+
+/* pack.c */
+extern void pack_init(struct game_pack *p);
+extern void pack_free(struct game_pack *p);
+extern void pack_reset(struct game_pack *p);
+extern int pack_append_weeks(struct game_pack *p, const struct db *db,
+			     unsigned int end_week);
+extern int pack_build(struct game_pack *p, const struct db *db,
+		      unsigned int end_week);
+extern unsigned int pack_decode_week(const struct game_pack *p,
+				     unsigned int week, struct game *out);
+extern void pack_iter_begin(const struct game_pack *p, unsigned int first,
+			    unsigned int last, struct pack_iter *iter);
+extern bool pack_iter_end(const struct pack_iter *iter);
+extern const struct game *pack_iter_data(const struct pack_iter *iter);
+extern void pack_iter_next(struct pack_iter *iter);
+
+/* history.c */
+extern int history_open(struct rating_history *h, const char *dir,
+			const char *sport, const char *algo, bool write);
+extern void history_close(struct rating_history *h);
+extern int history_append(struct rating_history *h, const struct db *db,
+			  unsigned int week, double home_adv,
+			  const double *team);
+extern unsigned int history_num_teams(const struct rating_history *h);
+extern const char *history_team_name(const struct rating_history *h,
+				     unsigned int column);
+extern int history_find_team(const struct rating_history *h,
+			     const char *name);
+extern int history_week_range(const struct rating_history *h,
+			      const struct week_id *begin,
+			      const struct week_id *end,
+			      unsigned int *first, unsigned int *last);
+extern const struct week_id *history_week(const struct rating_history *h,
+					  unsigned int i);
+extern double history_home_adv(const struct rating_history *h,
+			       unsigned int i);
+extern void history_column(const struct rating_history *h,
+			   unsigned int column, unsigned int first,
+			   unsigned int last, float *out);
+extern void history_row(const struct rating_history *h, unsigned int i,
+			float *out);
+
+/* overlay.c */
+extern void overlay_init(struct db_overlay *o, const struct db *base);
+extern void overlay_clear(struct db_overlay *o);
+extern void overlay_free(struct db_overlay *o);
+extern int overlay_add_game(struct db_overlay *o, unsigned int week,
+			    const struct game *g);
+extern int overlay_set_score(struct db_overlay *o, unsigned int game,
+			     int home_score, int away_score);
+extern unsigned int overlay_num_games(const struct db_overlay *o);
+extern void overlay_get_game(const struct db_overlay *o, unsigned int i,
+			     struct game *out);
+extern int overlay_read(struct db_overlay *o, const char *path);
+extern void overlay_iter_begin(const struct db_overlay *o,
+			       unsigned int first_week,
+			       unsigned int last_week,
+			       struct overlay_iter *iter);
+extern bool overlay_iter_end(const struct overlay_iter *iter);
+extern const struct game *overlay_iter_data(const struct overlay_iter *iter);
+extern void overlay_iter_next(struct overlay_iter *iter);
+
 #endif
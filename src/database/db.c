@@ -6,7 +6,12 @@
 #include <uuid/uuid.h>
 
 #include "../spreden.h"
-#include "../dstruct/list.h"
+#include "../dstruct/arena.h"
+#include "../dstruct/intern.h"
+#include "../dstruct/vector.h"
+#include "../dstruct/mem.h"
+#include "../dstruct/pool.h"
+#include "../profile/profile.h"
 #include "database.h"
 
 
@@ -15,7 +20,7 @@
 int hash_add(struct db *db, const char *uuid, int team)
 {
 	uuid_t temp;
-	struct team_hash_entry *entry;
+	int id;
 
 	/* make sure it's a valid uuid */
 	if (uuid_parse(uuid, temp) < 0) {
@@ -23,39 +28,66 @@ int hash_add(struct db *db, const char *uuid, int team)
 		return -1;
 	}
 
-	/* allocate hash entry */
-	entry = malloc(sizeof(struct team_hash_entry));
-	if (!entry) {
+	/* teams are added in order, so the new id is the team */
+	id = intern_add(&db->uuids, uuid, strlen(uuid));
+	prof_count(PROF_HASH_PROBES, 1);
+	if (id < 0) {
 		fprintf(stderr, "%s: malloc failed\n", progname);
 		return -2;
 	}
 
-	/* copy fields */
-	strncpy(entry->uuid, uuid, UUID_LENGTH);
-	entry->uuid[UUID_LENGTH] = '\0';
-	entry->team = team;
-
-	/* add to hash table */
-	HASH_ADD_STR(db->teams_hash, uuid, entry);
+	if (id != team) {
+		fprintf(stderr, "%s: uuid '%s' is already team %d\n",
+			progname, uuid, id);
+		return -3;
+	}
 
 	return 0;
 }
 
 int hash_get(struct db *db, const char *uuid)
 {
-	const struct team_hash_entry *entry;
+	prof_count(PROF_HASH_PROBES, 1);
+	return intern_find(&db->uuids, uuid, strlen(uuid));
+}
+
+const char *db_team_name(const struct db *db, unsigned int team)
+{
+	assert(team < db->num_teams);
+
+	return intern_str(&db->names, db->teams[team].name);
+}
+
+/* parser allocation */
 
-	HASH_FIND_STR(db->teams_hash, uuid, entry);
-	if (entry)
-		return entry->team;
+static void *parse_malloc(void *ctx, size_t size)
+{
+	(void)ctx;
+	return mem_alloc(MEM_PARSE, size);
+}
 
-	return -1;
+static void *parse_realloc(void *ctx, void *p, size_t size)
+{
+	(void)ctx;
+	return mem_realloc(MEM_PARSE, p, size);
 }
 
-static void db_print_sizes(const struct db *db)
+static void parse_free(void *ctx, void *p)
 {
-	(void)db;
+	(void)ctx;
+	mem_free(p);
+}
 
+/* passed to yajl_alloc() so the parsers are charged to MEM_PARSE */
+yajl_alloc_funcs db_parse_alloc = {
+	parse_malloc,
+	parse_realloc,
+	parse_free,
+	NULL
+};
+
+static void db_print_sizes(void)
+{
 	fprintf(stderr, "db: DB_MAX_TEAMS = %u\n", DB_MAX_TEAMS);
 	fprintf(stderr, "db: DB_MAX_GAMES = %u\n", DB_MAX_GAMES);
 	fprintf(stderr, "db: DB_MAX_WEEKS = %u\n", DB_MAX_WEEKS);
@@ -71,43 +103,186 @@ static void db_print_sizes(const struct db *db)
 	fprintf(stderr, "db: total alloc db    = %lu\n", sizeof(struct db));
 }
 
-static int db_init(struct state *s)
+struct db *db_init(const char *sport)
 {
 	size_t alloc_size;
 	struct db *db;
 
 	/* allocate the db all at once */
 	alloc_size = sizeof(struct db);
-	db = malloc(alloc_size);
+	db = mem_alloc(MEM_DB, alloc_size);
 	if (!db) {
 		fprintf(stderr, "%s: malloc failed\n", progname);
-		return -1;
+		return NULL;
 	}
 
 	/* init members */
-	db->teams_hash = NULL;
+	db->sport = sport;
+	intern_init(&db->uuids, MEM_HASH);
+	intern_init(&db->names, MEM_DB);
 	db->num_teams = 0;
 	db->num_games = 0;
 	db->num_weeks = 0;
-	list_init(&db->game_files);
+	h2h_init(&db->h2h);
+	pack_init(&db->pack);
+	vector_init(&db->game_files, sizeof(const char *));
+	db->game_paths = NULL;
+	arena_init(&db->arena, MEM_DB, DB_ARENA_CHUNK);
 
-	/* finally, set the db pointer in the state */
-	s->db = db;
+	/* size the team tables once so parsing never grows them */
+	if (intern_reserve(&db->uuids, DB_MAX_TEAMS,
+			   DB_MAX_TEAMS * UUID_LENGTH) < 0 ||
+	    intern_reserve(&db->names, DB_MAX_TEAMS,
+			   DB_MAX_TEAMS * DB_TEAM_NAME_RESERVE) < 0) {
+		fprintf(stderr, "%s: malloc failed\n", progname);
+		db_free(db);
+		return NULL;
+	}
+
+	return db;
+}
+
+void db_free(struct db *db)
+{
+	intern_free(&db->uuids);
+	intern_free(&db->names);
+	h2h_free(&db->h2h);
+	pack_free(&db->pack);
+	vector_free(&db->game_files);
+	arena_release(&db->arena);
+	mem_free(db);
+}
+
+static int load_teams(const struct rc *rc, struct db *db)
+{
+	char pathbuf[DB_MAX_PATH];
+
+	/* teams live at the top of the sport dir */
+	snprintf(pathbuf, DB_MAX_PATH, "%s/%s/teams.json",
+		 rc->data_dir, db->sport);
+	pathbuf[DB_MAX_PATH-1] = '\0';
+
+	if (db_parse_teams(db, pathbuf) < 0)
+		return -1;
 
 	if (verbose)
-		db_print_sizes(db);
+		fprintf(stderr, "db: %s: %u teams\n", db->sport, db->num_teams);
 
 	return 0;
 }
 
+static int load_sport(const struct rc *rc, struct pool *pool, struct db *db)
+{
+	struct prof_scope scope;
+	struct trace_span span;
+	int err = 0;
+
+	prof_begin(&scope, PROF_LOAD);
+	trace_begin(&span, "load", "load %s", db->sport);
+
+	if (load_teams(rc, db) < 0)
+		err = -1;
+	else if (db_scan(rc, pool, db) < 0)
+		err = -2;
+	else if (db_load_games(db) < 0)
+		err = -3;
+	else if (rc->pack_games && pack_build(&db->pack, db, db->num_weeks) < 0)
+		err = -4;
+
+	trace_end(&span);
+	prof_end(&scope);
+	return err;
+}
+
+/* load_job is one sport being loaded as a pool task */
+struct load_job {
+	const struct rc *rc;
+	struct pool *pool;
+	struct db *db;
+	int err;
+};
+
+static void load_task(void *arg)
+{
+	struct load_job *job = arg;
+
+	job->err = load_sport(job->rc, job->pool, job->db);
+}
+
 /* api functions */
 
+/* load a db for each sport in the rc, all at the same time */
 int db_load(struct state *s)
 {
-	assert(s->db == NULL);
+	struct load_job jobs[RC_MAX_SPORTS];
+	struct pool_group group;
+	struct db *db;
+	unsigned int i;
+	int err = 0;
+
+	assert(s->num_dbs == 0);
+	assert(s->rc.sports.length <= RC_MAX_SPORTS);
+
+	if (verbose)
+		db_print_sizes();
+
+	for (i = 0; i < s->rc.sports.length; i++) {
+		db = db_init(VECTOR_AT(&s->rc.sports, char *, i));
+		if (!db)
+			return -1;
+
+		s->dbs[s->num_dbs++] = db;
+	}
+
+	/* every sport is a task, and each one scans its years in parallel */
+	pool_group_init(&group, &s->pool);
+	for (i = 0; i < s->num_dbs; i++) {
+		jobs[i].rc = &s->rc;
+		jobs[i].pool = &s->pool;
+		jobs[i].db = s->dbs[i];
+		jobs[i].err = 0;
+		pool_group_spawn(&group, load_task, &jobs[i]);
+	}
+	pool_group_wait(&group);
+
+	for (i = 0; i < s->num_dbs; i++) {
+		if (jobs[i].err)
+			err = -2;
+	}
+
+	return err;
+}
+
+
+static int compare_week_ids(const struct week_id *a, const struct week_id *b)
+{
+	if (a->year != b->year)
+		return (a->year > b->year) - (a->year < b->year);
+
+	return (a->week > b->week) - (a->week < b->week);
+}
+
+/* find the indices of the loaded weeks between begin and end */
+int db_week_range(const struct db *db, const struct week_id *begin,
+		  const struct week_id *end,
+		  unsigned int *first, unsigned int *last)
+{
+	unsigned int i = 0;
+
+	while (i < db->num_weeks && compare_week_ids(&db->weeks[i].id, begin) < 0)
+		i++;
+
+	/* a begin of "last week of the year" is that year's last loaded week */
+	if (begin->week == WEEK_ID_END && i > 0 &&
+	    db->weeks[i-1].id.year == begin->year)
+		i--;
+	*first = i;
 
-	if (db_init(s) < 0)
+	while (i < db->num_weeks && compare_week_ids(&db->weeks[i].id, end) <= 0)
+		i++;
+	if (i == *first)
 		return -1;
+	*last = i - 1;
 
 	return 0;
 }
@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include "../spreden.h"
+#include "../dstruct/mem.h"
+#include "database.h"
+
+/*
+ * h2h is the head-to-head record of every ordered pair of teams
+ *
+ * the matrix is stored as H2H_TILE x H2H_TILE tiles, tile rows
+ * one after another and cells row major inside a tile, so a
+ * kernel walking a tile or a row segment stays in a few cache
+ * lines. it is sized to the loaded teams, rounded up to whole
+ * tiles; cells past the last team stay zero, so kernels can
+ * always work on whole tiles
+ */
+
+
+/* helper functions */
+
+static void add_pair(struct h2h_cell *c, int margin, bool home)
+{
+	c->games++;
+	c->wins += (margin > 0);
+	c->margin += margin;
+	if (home) {
+		c->home++;
+		c->home_margin += margin;
+	}
+}
+
+
+/* api functions */
+
+void h2h_init(struct h2h *h)
+{
+	h->num_teams = 0;
+	h->num_tiles = 0;
+	h->num_weeks = 0;
+	h->cells = NULL;
+}
+
+void h2h_free(struct h2h *h)
+{
+	mem_free(h->cells);
+	h2h_init(h);
+}
+
+/* size the matrix for num_teams and clear it to no weeks */
+int h2h_reset(struct h2h *h, unsigned int num_teams)
+{
+	unsigned int num_tiles;
+	size_t num_cells;
+
+	assert(num_teams <= DB_MAX_TEAMS);
+
+	num_tiles = (num_teams + H2H_TILE - 1) / H2H_TILE;
+	num_cells = (size_t)num_tiles * num_tiles * H2H_TILE_CELLS;
+
+	if (num_tiles != h->num_tiles) {
+		mem_free(h->cells);
+		h->cells = NULL;
+		h->num_tiles = 0;
+		if (num_cells) {
+			h->cells = mem_alloc(MEM_DB,
+					     num_cells * sizeof(struct h2h_cell));
+			if (!h->cells) {
+				fprintf(stderr, "%s: malloc failed\n", progname);
+				return -1;
+			}
+		}
+		h->num_tiles = num_tiles;
+	}
+
+	if (num_cells)
+		memset(h->cells, 0, num_cells * sizeof(struct h2h_cell));
+	h->num_teams = num_teams;
+	h->num_weeks = 0;
+
+	return 0;
+}
+
+/* count one game in both of its cells */
+void h2h_add_game(struct h2h *h, const struct game *g)
+{
+	const int margin = g->home_score - g->away_score;
+
+	add_pair(h2h_cell(h, g->home_team, g->away_team), margin,
+		 !g->neutral);
+	add_pair(h2h_cell(h, g->away_team, g->home_team), -margin, false);
+}
+
+/*
+ * add the weeks from the last one counted up to, but not
+ * including, end_week; weeks are only ever appended, so this
+ * is all an update needs after more weeks are loaded
+ */
+void h2h_append_weeks(struct h2h *h, const struct db *db,
+		      unsigned int end_week)
+{
+	const struct week *w;
+	int i;
+
+	assert(h->num_teams == db->num_teams);
+	assert(end_week <= db->num_weeks);
+
+	for (; h->num_weeks < end_week; h->num_weeks++) {
+		w = &db->weeks[h->num_weeks];
+		for (i = w->game_begin; i < w->game_end; i++)
+			h2h_add_game(h, &db->games[i]);
+	}
+}
+
+/* rebuild from scratch for weeks [0, end_week) */
+int h2h_build(struct h2h *h, const struct db *db, unsigned int end_week)
+{
+	if (h2h_reset(h, db->num_teams) < 0)
+		return -1;
+
+	h2h_append_weeks(h, db, end_week);
+	return 0;
+}
+
+/* the tile holding rows ti * H2H_TILE.. and columns tj * H2H_TILE.. */
+struct h2h_cell *h2h_tile(const struct h2h *h, unsigned int ti,
+			  unsigned int tj)
+{
+	assert(ti < h->num_tiles && tj < h->num_tiles);
+
+	return &h->cells[((size_t)ti * h->num_tiles + tj) * H2H_TILE_CELLS];
+}
+
+/* the H2H_TILE cells of row i that fall in tile column tj */
+struct h2h_cell *h2h_row(const struct h2h *h, unsigned int i, unsigned int tj)
+{
+	return h2h_tile(h, i / H2H_TILE, tj) + (i % H2H_TILE) * H2H_TILE;
+}
+
+/* team i's record against team j */
+struct h2h_cell *h2h_cell(const struct h2h *h, unsigned int i, unsigned int j)
+{
+	return h2h_row(h, i, j / H2H_TILE) + j % H2H_TILE;
+}
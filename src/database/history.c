@@ -0,0 +1,474 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <assert.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../spreden.h"
+#include "../dstruct/mem.h"
+#include "database.h"
+
+/*
+ * rating_history keeps every week one algorithm has rated for one
+ * sport in a file, DIR/SPORT.ALGORITHM.hist, so that a team's
+ * ratings over time can be read back instead of recomputed
+ *
+ * the file is a struct history_header, which holds the team names,
+ * and then segments of HISTORY_SEGMENT_WEEKS rows. a segment keeps
+ * each team's ratings for its rows together as one column:
+ *
+ *   row 0..63 week ids and home advantages
+ *   team 0    rating row 0, row 1, ... row 63
+ *   team 1    rating row 0, row 1, ... row 63
+ *   ...
+ *
+ * so one team's history is a run of 256 bytes per segment, and
+ * reading it through the map touches nothing else. the file only
+ * grows: a row is written and then counted in the header, and
+ * new teams take the next free column. a week rated again gets a
+ * new row, which shadows the old one
+ *
+ * the index from week id to row is built when the file is opened.
+ * writers hold an exclusive lock on the file and readers a shared
+ * one, so a reader never sees a row being written
+ */
+
+#define HISTORY_MAGIC    "SPRH"
+#define HISTORY_VERSION  1
+
+/* rows per segment */
+#define HISTORY_SEGMENT_WEEKS  64
+
+/* smallest index worth allocating */
+#define HISTORY_MIN_INDEX  64
+
+struct history_header {
+	char magic[4];
+	uint32_t version;
+	char sport[TEAM_NAME_MAX];
+	char algorithm[TEAM_NAME_MAX];
+	/* num_teams - columns in use; num_rows - rows written */
+	uint32_t num_teams;
+	uint32_t num_rows;
+	char names[DB_MAX_TEAMS][TEAM_NAME_MAX];
+};
+
+struct history_row {
+	struct week_id id;
+	/* num_teams - columns there were when the row was written */
+	uint32_t num_teams;
+	float home_adv;
+};
+
+struct history_segment {
+	struct history_row rows[HISTORY_SEGMENT_WEEKS];
+	float column[DB_MAX_TEAMS][HISTORY_SEGMENT_WEEKS];
+};
+
+
+/* helper functions */
+
+static struct history_header *header(const struct rating_history *h)
+{
+	return (struct history_header *)h->map;
+}
+
+static struct history_segment *segment(const struct rating_history *h,
+				       unsigned int row)
+{
+	return (struct history_segment *)(h->map +
+		sizeof(struct history_header) +
+		(size_t)(row / HISTORY_SEGMENT_WEEKS) *
+		sizeof(struct history_segment));
+}
+
+static struct history_row *row_info(const struct rating_history *h,
+				    unsigned int row)
+{
+	return &segment(h, row)->rows[row % HISTORY_SEGMENT_WEEKS];
+}
+
+/* a team's rating in a row, or NAN if the team had none */
+static float row_value(const struct rating_history *h, unsigned int row,
+		       unsigned int column)
+{
+	if (column >= row_info(h, row)->num_teams)
+		return NAN;
+
+	return segment(h, row)->column[column][row % HISTORY_SEGMENT_WEEKS];
+}
+
+static int compare_week_ids(const struct week_id *a, const struct week_id *b)
+{
+	if (a->year != b->year)
+		return (a->year > b->year) - (a->year < b->year);
+
+	return (a->week > b->week) - (a->week < b->week);
+}
+
+/* map the header and num_segments segments, growing the file to fit */
+static int map_file(struct rating_history *h, unsigned int num_segments)
+{
+	const size_t size = sizeof(struct history_header) +
+			    (size_t)num_segments * sizeof(struct history_segment);
+	const int prot = PROT_READ | (h->writable ? PROT_WRITE : 0);
+	void *map;
+
+	if (h->writable && size > h->map_size && ftruncate(h->fd, size) < 0) {
+		fprintf(stderr, "%s: could not grow '%s': %s\n",
+			progname, h->path, strerror(errno));
+		return -1;
+	}
+
+	if (h->map)
+		munmap(h->map, h->map_size);
+	h->map = NULL;
+
+	map = mmap(NULL, size, prot, MAP_SHARED, h->fd, 0);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "%s: could not map '%s': %s\n",
+			progname, h->path, strerror(errno));
+		return -2;
+	}
+
+	h->map = map;
+	h->map_size = size;
+	h->num_segments = num_segments;
+	return 0;
+}
+
+/* start an empty file */
+static int create_file(struct rating_history *h, const char *sport,
+		       const char *algo)
+{
+	struct history_header *hdr;
+
+	if (map_file(h, 0) < 0)
+		return -1;
+
+	hdr = header(h);
+	memcpy(hdr->magic, HISTORY_MAGIC, sizeof(hdr->magic));
+	hdr->version = HISTORY_VERSION;
+	strncpy(hdr->sport, sport, sizeof(hdr->sport) - 1);
+	strncpy(hdr->algorithm, algo, sizeof(hdr->algorithm) - 1);
+
+	return 0;
+}
+
+/* map an existing file and make sure it is what it should be */
+static int check_file(struct rating_history *h, size_t size,
+		      const char *sport, const char *algo)
+{
+	const struct history_header *hdr;
+	unsigned int needed;
+
+	if (size < sizeof(struct history_header)) {
+		fprintf(stderr, "%s: '%s' is not a rating history\n",
+			progname, h->path);
+		return -1;
+	}
+
+	if (map_file(h, (size - sizeof(struct history_header)) /
+			sizeof(struct history_segment)) < 0)
+		return -2;
+
+	hdr = header(h);
+	needed = (hdr->num_rows + HISTORY_SEGMENT_WEEKS - 1) /
+		 HISTORY_SEGMENT_WEEKS;
+	if (memcmp(hdr->magic, HISTORY_MAGIC, sizeof(hdr->magic)) != 0 ||
+	    hdr->version != HISTORY_VERSION ||
+	    hdr->num_teams > DB_MAX_TEAMS || needed > h->num_segments) {
+		fprintf(stderr, "%s: '%s' is not a rating history\n",
+			progname, h->path);
+		return -3;
+	}
+
+	if (strncmp(hdr->sport, sport, sizeof(hdr->sport)) != 0 ||
+	    strncmp(hdr->algorithm, algo, sizeof(hdr->algorithm)) != 0) {
+		fprintf(stderr, "%s: '%s' holds %.*s %.*s ratings, not %s %s\n",
+			progname, h->path, TEAM_NAME_MAX, hdr->sport,
+			TEAM_NAME_MAX, hdr->algorithm, sport, algo);
+		return -4;
+	}
+
+	return 0;
+}
+
+/* first index position whose week is not before id */
+static unsigned int index_lower_bound(const struct rating_history *h,
+				      const struct week_id *id)
+{
+	unsigned int lo = 0, hi = h->num_index, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (compare_week_ids(&row_info(h, h->index[mid])->id, id) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/* point the index at row for its week, over any older row */
+static int index_insert(struct rating_history *h, unsigned int row)
+{
+	const struct week_id *id = &row_info(h, row)->id;
+	unsigned int pos = index_lower_bound(h, id);
+	unsigned int *index;
+	unsigned int size;
+
+	if (pos < h->num_index &&
+	    compare_week_ids(&row_info(h, h->index[pos])->id, id) == 0) {
+		h->index[pos] = row;
+		return 0;
+	}
+
+	if (h->num_index == h->max_index) {
+		size = h->max_index ? 2 * h->max_index : HISTORY_MIN_INDEX;
+		index = mem_realloc(MEM_DB, h->index, size * sizeof(unsigned int));
+		if (!index) {
+			fprintf(stderr, "%s: malloc failed\n", progname);
+			return -1;
+		}
+		h->index = index;
+		h->max_index = size;
+	}
+
+	memmove(&h->index[pos + 1], &h->index[pos],
+		(h->num_index - pos) * sizeof(unsigned int));
+	h->index[pos] = row;
+	h->num_index++;
+	return 0;
+}
+
+/* give every team of db a column, adding the ones new to the file */
+static int map_teams(struct rating_history *h, const struct db *db)
+{
+	struct history_header *hdr = header(h);
+	const char *name;
+	unsigned int i;
+	int column;
+
+	for (i = 0; i < db->num_teams; i++) {
+		name = db_team_name(db, i);
+		column = history_find_team(h, name);
+		if (column < 0) {
+			if (hdr->num_teams == DB_MAX_TEAMS) {
+				fprintf(stderr, "%s: '%s' is full; DB_MAX_TEAMS is %d\n",
+					progname, h->path, DB_MAX_TEAMS);
+				return -1;
+			}
+			column = hdr->num_teams++;
+			strncpy(hdr->names[column], name, TEAM_NAME_MAX - 1);
+		}
+		h->column[i] = column;
+	}
+
+	h->db = db;
+	return 0;
+}
+
+
+/* api functions */
+
+/*
+ * open the history of algo's sport ratings in dir; to write, the
+ * file is created if need be, and to read it must exist
+ */
+int history_open(struct rating_history *h, const char *dir,
+		 const char *sport, const char *algo, bool write)
+{
+	struct stat st;
+	unsigned int row;
+
+	memset(h, 0, sizeof(struct rating_history));
+	h->writable = write;
+	snprintf(h->path, DB_MAX_PATH, "%s/%s.%s.hist", dir, sport, algo);
+	h->path[DB_MAX_PATH-1] = '\0';
+
+	h->fd = open(h->path, write ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+	if (h->fd < 0) {
+		if (errno == ENOENT)
+			fprintf(stderr, "%s: no %s %s rating history in '%s'\n",
+				progname, sport, algo, dir);
+		else
+			fprintf(stderr, "%s: could not open '%s': %s\n",
+				progname, h->path, strerror(errno));
+		return -1;
+	}
+
+	if (flock(h->fd, write ? LOCK_EX : LOCK_SH) < 0 ||
+	    fstat(h->fd, &st) < 0) {
+		fprintf(stderr, "%s: could not open '%s': %s\n",
+			progname, h->path, strerror(errno));
+		history_close(h);
+		return -2;
+	}
+
+	if ((write && st.st_size == 0 ? create_file(h, sport, algo) :
+	     check_file(h, (size_t)st.st_size, sport, algo)) < 0) {
+		history_close(h);
+		return -3;
+	}
+
+	for (row = 0; row < header(h)->num_rows; row++) {
+		if (index_insert(h, row) < 0) {
+			history_close(h);
+			return -4;
+		}
+	}
+
+	return 0;
+}
+
+void history_close(struct rating_history *h)
+{
+	if (h->map)
+		munmap(h->map, h->map_size);
+	if (h->fd >= 0)
+		close(h->fd);
+	mem_free(h->index);
+	memset(h, 0, sizeof(struct rating_history));
+	h->fd = -1;
+}
+
+/*
+ * add db's ratings team[] after week; history_week() pointers
+ * from before may no longer be valid
+ */
+int history_append(struct rating_history *h, const struct db *db,
+		   unsigned int week, double home_adv, const double *team)
+{
+	struct history_segment *seg;
+	struct history_row *info;
+	unsigned int row, k, i;
+
+	assert(h->writable && week < db->num_weeks);
+
+	if (h->db != db && map_teams(h, db) < 0)
+		return -1;
+
+	row = header(h)->num_rows;
+	if (row / HISTORY_SEGMENT_WEEKS >= h->num_segments &&
+	    map_file(h, h->num_segments + 1) < 0)
+		return -2;
+
+	seg = segment(h, row);
+	k = row % HISTORY_SEGMENT_WEEKS;
+
+	/* teams in the file that db does not have are left unrated */
+	for (i = 0; i < header(h)->num_teams; i++)
+		seg->column[i][k] = NAN;
+	for (i = 0; i < db->num_teams; i++)
+		seg->column[h->column[i]][k] = (float)team[i];
+
+	info = &seg->rows[k];
+	info->id = db->weeks[week].id;
+	info->num_teams = header(h)->num_teams;
+	info->home_adv = (float)home_adv;
+
+	/* the row is there once it is counted */
+	header(h)->num_rows = row + 1;
+
+	return index_insert(h, row);
+}
+
+unsigned int history_num_teams(const struct rating_history *h)
+{
+	return header(h)->num_teams;
+}
+
+const char *history_team_name(const struct rating_history *h,
+			      unsigned int column)
+{
+	assert(column < header(h)->num_teams);
+
+	return header(h)->names[column];
+}
+
+/* the column of the team called name, or -1 */
+int history_find_team(const struct rating_history *h, const char *name)
+{
+	const struct history_header *hdr = header(h);
+	unsigned int i;
+
+	for (i = 0; i < hdr->num_teams; i++) {
+		if (strncmp(hdr->names[i], name, TEAM_NAME_MAX) == 0)
+			return i;
+	}
+
+	return -1;
+}
+
+/* find the index positions of the weeks between begin and end */
+int history_week_range(const struct rating_history *h,
+		       const struct week_id *begin,
+		       const struct week_id *end,
+		       unsigned int *first, unsigned int *last)
+{
+	unsigned int i = index_lower_bound(h, begin);
+
+	/* a begin of "last week of the year" is that year's last week */
+	if (begin->week == WEEK_ID_END && i > 0 &&
+	    history_week(h, i - 1)->year == begin->year)
+		i--;
+	*first = i;
+
+	while (i < h->num_index && compare_week_ids(history_week(h, i), end) <= 0)
+		i++;
+	if (i == *first)
+		return -1;
+	*last = i - 1;
+
+	return 0;
+}
+
+/* the week at index position i */
+const struct week_id *history_week(const struct rating_history *h,
+				   unsigned int i)
+{
+	assert(i < h->num_index);
+
+	return &row_info(h, h->index[i])->id;
+}
+
+double history_home_adv(const struct rating_history *h, unsigned int i)
+{
+	assert(i < h->num_index);
+
+	return row_info(h, h->index[i])->home_adv;
+}
+
+/* one team's ratings at index positions first..last; NAN is unrated */
+void history_column(const struct rating_history *h, unsigned int column,
+		    unsigned int first, unsigned int last, float *out)
+{
+	unsigned int i;
+
+	assert(first <= last && last < h->num_index);
+
+	for (i = first; i <= last; i++)
+		out[i - first] = row_value(h, h->index[i], column);
+}
+
+/* every team's rating at index position i, by column */
+void history_row(const struct rating_history *h, unsigned int i, float *out)
+{
+	const unsigned int row = h->index[i];
+	unsigned int c;
+
+	assert(i < h->num_index);
+
+	for (c = 0; c < header(h)->num_teams; c++)
+		out[c] = row_value(h, row, c);
+}
@@ -0,0 +1,575 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#ifdef HAVE_IO_URING
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+#include "../spreden.h"
+#include "../dstruct/vector.h"
+#include "../dstruct/mem.h"
+#include "database.h"
+#include "../profile/profile.h"
+
+/* max number of week files being read at once */
+#define LOAD_QUEUE_DEPTH  32
+
+
+/* file helpers */
+
+/* open a week file and find out how big a buffer it needs */
+static int open_week_file(const char *path, size_t *size)
+{
+	struct stat st;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "%s: could not open '%s' for reading: %s\n",
+			progname, path, strerror(errno));
+		return -1;
+	}
+
+	if (fstat(fd, &st) < 0) {
+		fprintf(stderr, "%s: could not stat '%s': %s\n",
+			progname, path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	*size = (size_t)st.st_size;
+	return fd;
+}
+
+static int read_all(int fd, const char *path, unsigned char *buf, size_t size)
+{
+	size_t done = 0;
+	ssize_t n;
+
+	while (done < size) {
+		n = read(fd, buf + done, size - done);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0) {
+			fprintf(stderr, "%s: error reading '%s': %s\n",
+				progname, path,
+				n < 0 ? strerror(errno) : "unexpected end of file");
+			return -1;
+		}
+		done += (size_t)n;
+	}
+
+	return 0;
+}
+
+
+/* synchronous loader */
+
+static int load_sync(struct db *db)
+{
+	const char *path;
+	unsigned char *buf = NULL;
+	size_t buf_size = 0;
+	size_t size;
+	unsigned int week;
+	int fd;
+	int err = 0;
+	void *p;
+
+	for (week = 0; week < db->game_files.length && !err; week++) {
+		path = VECTOR_AT(&db->game_files, const char *, week);
+
+		fd = open_week_file(path, &size);
+		if (fd < 0) {
+			err = -1;
+			break;
+		}
+
+		/* reuse one buffer for every file */
+		if (size > buf_size) {
+			p = mem_realloc(MEM_DB, buf, size);
+			if (!p) {
+				fprintf(stderr, "%s: malloc failed\n", progname);
+				close(fd);
+				err = -2;
+				break;
+			}
+			buf = p;
+			buf_size = size;
+		}
+
+		prof_count(PROF_BYTES_READ, size);
+		if (read_all(fd, path, buf, size) < 0)
+			err = -3;
+		else if (db_parse_games(db, week, path, buf, size) < 0)
+			err = -4;
+
+		close(fd);
+	}
+
+	mem_free(buf);
+	return err;
+}
+
+
+/* io_uring loader */
+
+#ifdef HAVE_IO_URING
+
+struct uring {
+	int fd;
+	/* submission queue */
+	unsigned int *sq_head;
+	unsigned int *sq_tail;
+	unsigned int *sq_mask;
+	unsigned int *sq_array;
+	struct io_uring_sqe *sqes;
+	/* completion queue */
+	unsigned int *cq_head;
+	unsigned int *cq_tail;
+	unsigned int *cq_mask;
+	struct io_uring_cqe *cqes;
+	/* mappings */
+	void *sq_ring;
+	size_t sq_ring_size;
+	void *cq_ring;
+	size_t cq_ring_size;
+	size_t sqes_size;
+};
+
+/* a week file that is being read */
+struct read_slot {
+	bool busy;
+	int fd;
+	unsigned int week;
+	const char *path;
+	unsigned char *buf;
+	size_t size;
+	size_t done;
+	struct iovec iov;
+};
+
+static int uring_setup(struct uring *r, unsigned int entries)
+{
+	struct io_uring_params params;
+	bool single_mmap;
+
+	memset(&params, 0, sizeof(params));
+	memset(r, 0, sizeof(struct uring));
+
+	r->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+	if (r->fd < 0)
+		return -1;
+
+	r->sq_ring_size = params.sq_off.array +
+		params.sq_entries * sizeof(unsigned int);
+	r->cq_ring_size = params.cq_off.cqes +
+		params.cq_entries * sizeof(struct io_uring_cqe);
+	r->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+	/* newer kernels map both rings with one call */
+	single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if (single_mmap) {
+		if (r->cq_ring_size > r->sq_ring_size)
+			r->sq_ring_size = r->cq_ring_size;
+		r->cq_ring_size = r->sq_ring_size;
+	}
+
+	r->sq_ring = mmap(NULL, r->sq_ring_size, PROT_READ | PROT_WRITE,
+			  MAP_SHARED, r->fd, IORING_OFF_SQ_RING);
+	if (r->sq_ring == MAP_FAILED)
+		goto fail_fd;
+
+	if (single_mmap) {
+		r->cq_ring = r->sq_ring;
+	} else {
+		r->cq_ring = mmap(NULL, r->cq_ring_size, PROT_READ | PROT_WRITE,
+				  MAP_SHARED, r->fd, IORING_OFF_CQ_RING);
+		if (r->cq_ring == MAP_FAILED)
+			goto fail_sq;
+	}
+
+	r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE,
+		       MAP_SHARED, r->fd, IORING_OFF_SQES);
+	if (r->sqes == MAP_FAILED)
+		goto fail_cq;
+
+	r->sq_head = (unsigned int *)((char *)r->sq_ring + params.sq_off.head);
+	r->sq_tail = (unsigned int *)((char *)r->sq_ring + params.sq_off.tail);
+	r->sq_mask = (unsigned int *)((char *)r->sq_ring + params.sq_off.ring_mask);
+	r->sq_array = (unsigned int *)((char *)r->sq_ring + params.sq_off.array);
+	r->cq_head = (unsigned int *)((char *)r->cq_ring + params.cq_off.head);
+	r->cq_tail = (unsigned int *)((char *)r->cq_ring + params.cq_off.tail);
+	r->cq_mask = (unsigned int *)((char *)r->cq_ring + params.cq_off.ring_mask);
+	r->cqes = (struct io_uring_cqe *)((char *)r->cq_ring + params.cq_off.cqes);
+
+	return 0;
+
+fail_cq:
+	if (r->cq_ring != r->sq_ring)
+		munmap(r->cq_ring, r->cq_ring_size);
+fail_sq:
+	munmap(r->sq_ring, r->sq_ring_size);
+fail_fd:
+	close(r->fd);
+	return -1;
+}
+
+static void uring_teardown(struct uring *r)
+{
+	munmap(r->sqes, r->sqes_size);
+	if (r->cq_ring != r->sq_ring)
+		munmap(r->cq_ring, r->cq_ring_size);
+	munmap(r->sq_ring, r->sq_ring_size);
+	close(r->fd);
+}
+
+/* queue a readv for the unread part of the slot's file */
+static void uring_queue_read(struct uring *r, struct read_slot *slot,
+			     unsigned int index)
+{
+	struct io_uring_sqe *sqe;
+	unsigned int tail;
+	unsigned int i;
+
+	slot->iov.iov_base = slot->buf + slot->done;
+	slot->iov.iov_len = slot->size - slot->done;
+
+	tail = *r->sq_tail;
+	i = tail & *r->sq_mask;
+	sqe = &r->sqes[i];
+
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	sqe->opcode = IORING_OP_READV;
+	sqe->fd = slot->fd;
+	sqe->off = slot->done;
+	sqe->addr = (unsigned long)&slot->iov;
+	sqe->len = 1;
+	sqe->user_data = index;
+
+	r->sq_array[i] = i;
+	__atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+static int uring_submit(struct uring *r, unsigned int to_submit,
+			unsigned int wait)
+{
+	int ret;
+
+	do {
+		ret = (int)syscall(__NR_io_uring_enter, r->fd, to_submit, wait,
+				   wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+	} while (ret < 0 && errno == EINTR);
+
+	if (ret < 0) {
+		fprintf(stderr, "%s: io_uring_enter failed: %s\n",
+			progname, strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+static void release_slot(struct read_slot *slot)
+{
+	close(slot->fd);
+	mem_free(slot->buf);
+	slot->buf = NULL;
+	slot->busy = false;
+}
+
+/* handle a finished read; the slot is released once the file is parsed */
+static int complete_read(struct db *db, struct uring *r,
+			 struct read_slot *slot, unsigned int index,
+			 int res, unsigned int *queued)
+{
+	int err = 0;
+
+	if (res <= 0) {
+		fprintf(stderr, "%s: error reading '%s': %s\n",
+			progname, slot->path,
+			res < 0 ? strerror(-res) : "unexpected end of file");
+		release_slot(slot);
+		return -1;
+	}
+
+	/* short read; go back for the rest */
+	prof_count(PROF_BYTES_READ, (unsigned long)res);
+	slot->done += (size_t)res;
+	if (slot->done < slot->size) {
+		uring_queue_read(r, slot, index);
+		(*queued)++;
+		return 0;
+	}
+
+	if (db_parse_games(db, slot->week, slot->path, slot->buf, slot->size) < 0)
+		err = -2;
+
+	release_slot(slot);
+	return err;
+}
+
+/* open the next file into a free slot and queue its read */
+static int start_read(struct db *db, struct uring *r, struct read_slot *slot,
+		      unsigned int index, const char *path, unsigned int week,
+		      unsigned int *queued)
+{
+	int err = 0;
+
+	slot->fd = open_week_file(path, &slot->size);
+	if (slot->fd < 0)
+		return -1;
+
+	slot->path = path;
+	slot->week = week;
+	slot->done = 0;
+	slot->buf = mem_alloc(MEM_DB, slot->size ? slot->size : 1);
+	if (!slot->buf) {
+		fprintf(stderr, "%s: malloc failed\n", progname);
+		close(slot->fd);
+		return -2;
+	}
+
+	/* nothing to read for empty files */
+	slot->busy = true;
+	if (slot->size == 0) {
+		if (db_parse_games(db, week, path, slot->buf, 0) < 0)
+			err = -3;
+		release_slot(slot);
+		return err;
+	}
+
+	uring_queue_read(r, slot, index);
+	(*queued)++;
+	return 0;
+}
+
+static int load_uring(struct db *db, struct uring *r)
+{
+	struct read_slot slots[LOAD_QUEUE_DEPTH];
+	const struct vector *files = &db->game_files;
+	struct io_uring_cqe *cqe;
+	unsigned int week = 0;
+	unsigned int in_flight = 0;
+	unsigned int queued;
+	unsigned int head;
+	unsigned int i;
+	int res;
+	int err = 0;
+
+	memset(slots, 0, sizeof(slots));
+
+	while (!err && (week < files->length || in_flight > 0)) {
+		queued = 0;
+
+		/* keep the queue full */
+		for (i = 0; i < LOAD_QUEUE_DEPTH && week < files->length; i++) {
+			if (slots[i].busy)
+				continue;
+
+			err = start_read(db, r, &slots[i], i,
+					 VECTOR_AT(files, const char *, week),
+					 week, &queued);
+			if (err)
+				break;
+
+			week++;
+		}
+
+		in_flight += queued;
+		if (in_flight == 0)
+			continue;
+
+		/* submit the new reads and wait for at least one */
+		if (uring_submit(r, queued, err ? 0 : 1) < 0) {
+			err = -1;
+			break;
+		}
+
+		/* parse everything that finished */
+		head = *r->cq_head;
+		while (head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+			cqe = &r->cqes[head & *r->cq_mask];
+			i = (unsigned int)cqe->user_data;
+			res = cqe->res;
+			head++;
+			__atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+
+			in_flight--;
+			queued = 0;
+			if (complete_read(db, r, &slots[i], i, res, &queued) < 0)
+				err = -2;
+			if (queued && uring_submit(r, queued, 0) < 0)
+				err = -3;
+			in_flight += queued;
+		}
+	}
+
+	/* drain anything still in flight before freeing buffers */
+	while (in_flight > 0) {
+		if (uring_submit(r, 0, 1) < 0)
+			break;
+		head = *r->cq_head;
+		while (head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+			release_slot(&slots[r->cqes[head & *r->cq_mask].user_data]);
+			head++;
+			in_flight--;
+		}
+		__atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+	}
+
+	for (i = 0; i < LOAD_QUEUE_DEPTH; i++) {
+		if (slots[i].busy)
+			release_slot(&slots[i]);
+	}
+
+	return err;
+}
+
+#endif
+
+
+/* post-processing */
+
+/*
+ * weeks may have been parsed in any order; move the games
+ * so that each week's games are contiguous and in week order,
+ * then build each team's schedule and the pair aggregates
+ */
+static int finish_games(struct db *db)
+{
+	struct game *sorted;
+	struct week *w;
+	struct game *g;
+	struct team *t;
+	unsigned int begin;
+	unsigned int i;
+	int n;
+
+	sorted = mem_alloc(MEM_DB, sizeof(struct game) *
+			   (db->num_games ? db->num_games : 1));
+	if (!sorted) {
+		fprintf(stderr, "%s: malloc failed\n", progname);
+		return -1;
+	}
+
+	begin = 0;
+	for (i = 0; i < db->num_weeks; i++) {
+		w = &db->weeks[i];
+		n = w->game_end - w->game_begin;
+		memcpy(&sorted[begin], &db->games[w->game_begin],
+		       sizeof(struct game) * n);
+		w->game_begin = begin;
+		w->game_end = begin + n;
+		begin += n;
+	}
+
+	assert(begin == db->num_games);
+	memcpy(db->games, sorted, sizeof(struct game) * db->num_games);
+	mem_free(sorted);
+
+	/* build schedules, opponent sets and the head-to-head matrix */
+	for (i = 0; i < db->num_teams; i++) {
+		db->teams[i].sched_len = 0;
+		bitset_clear(&db->opponents[i]);
+	}
+
+	if (h2h_reset(&db->h2h, db->num_teams) < 0)
+		return -3;
+
+	for (i = 0; i < db->num_games; i++) {
+		g = &db->games[i];
+		bitset_set(&db->opponents[g->home_team], g->away_team);
+		bitset_set(&db->opponents[g->away_team], g->home_team);
+		h2h_add_game(&db->h2h, g);
+
+		t = &db->teams[g->home_team];
+		if (t->sched_len >= TEAM_SCHED_MAX)
+			goto sched_full;
+		t->sched[t->sched_len++] = i;
+
+		t = &db->teams[g->away_team];
+		if (t->sched_len >= TEAM_SCHED_MAX)
+			goto sched_full;
+		t->sched[t->sched_len++] = i;
+	}
+
+	/* the games are in week order, so that was every week */
+	db->h2h.num_weeks = db->num_weeks;
+
+	return 0;
+
+sched_full:
+	fprintf(stderr, "%s: too many games for '%s'; TEAM_SCHED_MAX is %u\n",
+		progname, intern_str(&db->names, t->name), TEAM_SCHED_MAX);
+	return -2;
+}
+
+
+/* api functions */
+
+/*
+ * read and parse every scanned week file
+ *
+ * reads go through io_uring when the kernel supports it so that
+ * the next files are being read while the current one is parsed;
+ * otherwise the files are read one at a time
+ */
+int db_load_games(struct db *db)
+{
+	const char *method = "synchronous";
+	struct prof_scope scope;
+	int err;
+#ifdef HAVE_IO_URING
+	struct uring r;
+#endif
+
+	assert(db->num_weeks == db->game_files.length);
+
+	prof_begin(&scope, PROF_LOAD_GAMES);
+
+#ifdef HAVE_IO_URING
+	if (uring_setup(&r, LOAD_QUEUE_DEPTH) == 0) {
+		method = "io_uring";
+		err = load_uring(db, &r);
+		uring_teardown(&r);
+	} else {
+		if (verbose)
+			fprintf(stderr, "db: io_uring unavailable: %s\n",
+				strerror(errno));
+		err = load_sync(db);
+	}
+#else
+	err = load_sync(db);
+#endif
+
+	prof_end(&scope);
+	if (err)
+		return -1;
+
+	prof_begin(&scope, PROF_FINISH_GAMES);
+	err = finish_games(db);
+	prof_end(&scope);
+	if (err)
+		return -2;
+
+	if (verbose) {
+		fprintf(stderr, "db: %s: loaded %u games from %u weeks (%s)\n",
+			db->sport, db->num_games, db->num_weeks, method);
+		fprintf(stderr, "db: %s: schedule has %u connected components\n",
+			db->sport, db_components(db));
+	}
+
+	return 0;
+}
@@ -0,0 +1,62 @@
+#include <stdio.h>
+#include <assert.h>
+
+#include "../spreden.h"
+#include "../dstruct/bitset.h"
+#include "database.h"
+
+/*
+ * queries over the opponent sets built when the games are
+ * loaded; each is a handful of whole-set operations rather
+ * than walks over the team schedules
+ */
+
+/* the teams both a and b have played; out may be NULL for just the count */
+unsigned int db_common_opponents(const struct db *db, unsigned int a,
+				 unsigned int b, struct bitset *out)
+{
+	assert(a < db->num_teams);
+	assert(b < db->num_teams);
+
+	if (!out)
+		return bitset_count_and(&db->opponents[a], &db->opponents[b]);
+
+	bitset_and(out, &db->opponents[a], &db->opponents[b]);
+	return bitset_count(out);
+}
+
+/*
+ * the number of connected components in the schedule graph;
+ * a rating system can only compare teams in the same one
+ */
+unsigned int db_components(const struct db *db)
+{
+	struct bitset unseen, reached, frontier, next;
+	unsigned int components = 0;
+	int t;
+
+	bitset_fill(&unseen, db->num_teams);
+
+	while ((t = bitset_next(&unseen, 0)) >= 0) {
+		components++;
+
+		/* breadth first, one whole frontier at a time */
+		bitset_clear(&reached);
+		bitset_set(&reached, t);
+		frontier = reached;
+
+		while (!bitset_empty(&frontier)) {
+			bitset_clear(&next);
+			for (t = bitset_next(&frontier, 0); t >= 0;
+			     t = bitset_next(&frontier, t + 1))
+				bitset_or(&next, &next, &db->opponents[t]);
+
+			bitset_andnot(&frontier, &next, &reached);
+			bitset_or(&reached, &reached, &frontier);
+		}
+
+		bitset_andnot(&unseen, &unseen, &reached);
+	}
+
+	return components;
+}
@@ -0,0 +1,475 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+#include "../spreden.h"
+#include "database.h"
+#include "../dstruct/mem.h"
+
+#define OVERLAY_MIN_ALLOC  16
+
+/* longest line in a what-if file */
+#define OVERLAY_LINE_MAX  256
+
+/* sport, year, week, home, away, home score, away score, neutral */
+#define OVERLAY_MAX_FIELDS  8
+
+
+/* helper functions */
+
+static int grow(void **array, unsigned int *max, size_t size)
+{
+	unsigned int new_max;
+	void *p;
+
+	new_max = *max ? *max * 2 : OVERLAY_MIN_ALLOC;
+	p = mem_realloc(MEM_DB, *array, new_max * size);
+	if (!p) {
+		fprintf(stderr, "%s: malloc failed\n", progname);
+		return -1;
+	}
+
+	*array = p;
+	*max = new_max;
+	return 0;
+}
+
+/* index of the first override at or after game */
+static unsigned int find_override(const struct db_overlay *o,
+				  unsigned int game)
+{
+	unsigned int lo = 0, hi = o->num_overrides, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (o->overrides[mid].game < game)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/* index of the first added game in week or a later one */
+static unsigned int find_added(const struct db_overlay *o, unsigned int week)
+{
+	unsigned int lo = 0, hi = o->num_games, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (o->game_weeks[mid] < week)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/* the base game of week between home and away, or -1 */
+static int find_game(const struct db *db, unsigned int week, int home,
+		     int away)
+{
+	int k;
+
+	for (k = db->weeks[week].game_begin; k < db->weeks[week].game_end; k++) {
+		if (db->games[k].home_team == home &&
+		    db->games[k].away_team == away)
+			return k;
+	}
+
+	return -1;
+}
+
+static int find_week(const struct db *db, int year, int week)
+{
+	unsigned int w;
+
+	for (w = 0; w < db->num_weeks; w++) {
+		if (db->weeks[w].id.year == year && db->weeks[w].id.week == week)
+			return w;
+	}
+
+	return -1;
+}
+
+static int find_team(const struct db *db, const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < db->num_teams; i++) {
+		if (strcmp(db_team_name(db, i), name) == 0)
+			return i;
+	}
+
+	return -1;
+}
+
+static int parse_int(const char *str, int *out)
+{
+	char *endptr;
+	long n;
+
+	n = strtol(str, &endptr, 10);
+	if (*str == '\0' || *endptr != '\0' || n < 0 || n > SHRT_MAX)
+		return -1;
+
+	*out = (int)n;
+	return 0;
+}
+
+/* split line at commas into at most OVERLAY_MAX_FIELDS fields */
+static unsigned int split_fields(char *line, char **fields)
+{
+	unsigned int n = 0;
+	char *p = line;
+
+	line[strcspn(line, "\r\n")] = '\0';
+	for (;;) {
+		if (n == OVERLAY_MAX_FIELDS)
+			return n + 1;
+		fields[n++] = p;
+		p = strchr(p, ',');
+		if (!p)
+			return n;
+		*p++ = '\0';
+	}
+}
+
+/* apply one line of a what-if file; 1 if its week is not loaded */
+static int read_game(struct db_overlay *o, char *line, const char *path,
+		     unsigned int lineno)
+{
+	const struct db *db = o->base;
+	char *fields[OVERLAY_MAX_FIELDS];
+	int year, week, home, away, neutral = 0;
+	struct game g;
+	unsigned int n;
+	int w, k;
+
+	n = split_fields(line, fields);
+	if (n < OVERLAY_MAX_FIELDS - 1 || n > OVERLAY_MAX_FIELDS ||
+	    parse_int(fields[1], &year) < 0 ||
+	    parse_int(fields[2], &week) < 0 ||
+	    parse_int(fields[5], &g.home_score) < 0 ||
+	    parse_int(fields[6], &g.away_score) < 0 ||
+	    (n == OVERLAY_MAX_FIELDS &&
+	     (parse_int(fields[7], &neutral) < 0 || neutral > 1))) {
+		fprintf(stderr, "%s: bad what-if game at %s line %u\n",
+			progname, path, lineno);
+		return -1;
+	}
+
+	if (strcmp(fields[0], db->sport) != 0 ||
+	    (w = find_week(db, year, week)) < 0)
+		return 1;
+
+	home = find_team(db, fields[3]);
+	away = find_team(db, fields[4]);
+	if (home < 0 || away < 0) {
+		fprintf(stderr, "%s: no %s team '%s' at %s line %u\n",
+			progname, db->sport, fields[home < 0 ? 3 : 4], path,
+			lineno);
+		return -2;
+	}
+
+	/* a game that was played gets the new score */
+	if ((k = find_game(db, w, home, away)) >= 0) {
+		if (overlay_set_score(o, k, g.home_score, g.away_score) < 0)
+			return -3;
+		return 0;
+	}
+
+	g.home_team = home;
+	g.away_team = away;
+	g.neutral = neutral;
+	if (overlay_add_game(o, w, &g) < 0)
+		return -3;
+
+	return 0;
+}
+
+
+/* api functions */
+
+void overlay_init(struct db_overlay *o, const struct db *base)
+{
+	assert(o != NULL);
+	assert(base != NULL);
+
+	o->base = base;
+	o->games = NULL;
+	o->game_weeks = NULL;
+	o->num_games = 0;
+	o->max_games = 0;
+	o->overrides = NULL;
+	o->num_overrides = 0;
+	o->max_overrides = 0;
+}
+
+/* drop the changes but keep the memory for the next scenario */
+void overlay_clear(struct db_overlay *o)
+{
+	assert(o != NULL);
+
+	o->num_games = 0;
+	o->num_overrides = 0;
+}
+
+void overlay_free(struct db_overlay *o)
+{
+	assert(o != NULL);
+
+	mem_free(o->games);
+	mem_free(o->game_weeks);
+	mem_free(o->overrides);
+	overlay_init(o, o->base);
+}
+
+/* add a game that did not happen to a week of the base db */
+int overlay_add_game(struct db_overlay *o, unsigned int week,
+		     const struct game *g)
+{
+	const struct db *db = o->base;
+	unsigned int i;
+
+	if (week >= db->num_weeks) {
+		fprintf(stderr, "%s: overlay week %u is not in the db\n",
+			progname, week);
+		return -1;
+	}
+
+	if (g->home_team < 0 || (unsigned int)g->home_team >= db->num_teams ||
+	    g->away_team < 0 || (unsigned int)g->away_team >= db->num_teams ||
+	    g->home_team == g->away_team) {
+		fprintf(stderr, "%s: overlay game has invalid teams\n",
+			progname);
+		return -2;
+	}
+
+	if (o->num_games == o->max_games) {
+		unsigned int max = o->max_games;
+
+		if (grow((void **)&o->games, &max, sizeof(struct game)) < 0)
+			return -3;
+		if (grow((void **)&o->game_weeks, &o->max_games,
+			 sizeof(unsigned int)) < 0)
+			return -3;
+	}
+
+	/* added games are kept in week order, after the week's others */
+	i = find_added(o, week + 1);
+	memmove(&o->games[i+1], &o->games[i],
+		sizeof(struct game) * (o->num_games - i));
+	memmove(&o->game_weeks[i+1], &o->game_weeks[i],
+		sizeof(unsigned int) * (o->num_games - i));
+	o->games[i] = *g;
+	o->game_weeks[i] = week;
+	o->num_games++;
+
+	return 0;
+}
+
+/* replace the score of a game in the base db */
+int overlay_set_score(struct db_overlay *o, unsigned int game,
+		      int home_score, int away_score)
+{
+	struct game_override *ov;
+	unsigned int i;
+
+	if (game >= o->base->num_games) {
+		fprintf(stderr, "%s: overlay game %u is not in the db\n",
+			progname, game);
+		return -1;
+	}
+
+	/* overrides are kept sorted by game so iteration can merge them */
+	i = find_override(o, game);
+	if (i == o->num_overrides || o->overrides[i].game != game) {
+		if (o->num_overrides == o->max_overrides &&
+		    grow((void **)&o->overrides, &o->max_overrides,
+			 sizeof(struct game_override)) < 0)
+			return -2;
+
+		memmove(&o->overrides[i+1], &o->overrides[i],
+			sizeof(struct game_override) * (o->num_overrides - i));
+		o->num_overrides++;
+	}
+
+	ov = &o->overrides[i];
+	ov->game = game;
+	ov->home_score = home_score;
+	ov->away_score = away_score;
+
+	return 0;
+}
+
+/* number of games seen through the overlay, base and added */
+unsigned int overlay_num_games(const struct db_overlay *o)
+{
+	return o->base->num_games + o->num_games;
+}
+
+/*
+ * get one game through the overlay; indices past the base
+ * games are the added games, in week order
+ */
+void overlay_get_game(const struct db_overlay *o, unsigned int i,
+		      struct game *out)
+{
+	unsigned int j;
+
+	assert(i < overlay_num_games(o));
+
+	if (i >= o->base->num_games) {
+		*out = o->games[i - o->base->num_games];
+		return;
+	}
+
+	*out = o->base->games[i];
+	j = find_override(o, i);
+	if (j < o->num_overrides && o->overrides[j].game == i) {
+		out->home_score = o->overrides[j].home_score;
+		out->away_score = o->overrides[j].away_score;
+	}
+}
+
+
+/*
+ * read what-if games from a csv file, one a line:
+ *
+ *   sport,year,week,home,away,home_score,away_score[,neutral]
+ *
+ * teams are by name and neutral is 0 or 1. a game its week
+ * already has gets the new score; any other is added. lines
+ * for other sports or weeks that are not loaded are skipped
+ */
+int overlay_read(struct db_overlay *o, const char *path)
+{
+	char line[OVERLAY_LINE_MAX];
+	unsigned int lineno = 0;
+	FILE *stream;
+	int err = 0;
+
+	stream = fopen(path, "r");
+	if (!stream) {
+		fprintf(stderr, "%s: could not open '%s': %s\n",
+			progname, path, strerror(errno));
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), stream)) {
+		lineno++;
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+
+		if (read_game(o, line, path, lineno) < 0) {
+			err = -2;
+			break;
+		}
+	}
+
+	fclose(stream);
+	return err;
+}
+
+
+/* iterator functions */
+
+/* start on the games of iter->week */
+static void overlay_iter_week(struct overlay_iter *iter)
+{
+	const struct db_overlay *o = iter->overlay;
+	const struct week *w = &o->base->weeks[iter->week];
+
+	iter->game = w->game_begin;
+	iter->base_end = w->game_end;
+	iter->added = find_added(o, iter->week);
+	iter->added_end = find_added(o, iter->week + 1);
+}
+
+/* load the game the iterator is on into current */
+static void overlay_iter_load(struct overlay_iter *iter)
+{
+	const struct db_overlay *o = iter->overlay;
+	const struct game_override *ov;
+
+	for (;;) {
+		/* the week's base games, with their overrides merged in */
+		if (iter->game < iter->base_end) {
+			iter->current = o->base->games[iter->game];
+
+			while (iter->override < o->num_overrides &&
+			       o->overrides[iter->override].game < iter->game)
+				iter->override++;
+
+			if (iter->override == o->num_overrides)
+				return;
+
+			ov = &o->overrides[iter->override];
+			if (ov->game == iter->game) {
+				iter->current.home_score = ov->home_score;
+				iter->current.away_score = ov->away_score;
+			}
+			return;
+		}
+
+		/* then the games added to it */
+		if (iter->added < iter->added_end) {
+			iter->current = o->games[iter->added];
+			return;
+		}
+
+		if (++iter->week > iter->last_week)
+			return;
+		overlay_iter_week(iter);
+	}
+}
+
+/* iterate over the games of weeks first_week..last_week, week by week */
+void overlay_iter_begin(const struct db_overlay *o, unsigned int first_week,
+			unsigned int last_week, struct overlay_iter *iter)
+{
+	assert(o != NULL);
+	assert(iter != NULL);
+	assert(first_week <= last_week && last_week < o->base->num_weeks);
+
+	iter->overlay = o;
+	iter->week = first_week;
+	iter->last_week = last_week;
+	overlay_iter_week(iter);
+	iter->override = find_override(o, iter->game);
+	overlay_iter_load(iter);
+}
+
+bool overlay_iter_end(const struct overlay_iter *iter)
+{
+	assert(iter != NULL);
+
+	return iter->week > iter->last_week;
+}
+
+const struct game *overlay_iter_data(const struct overlay_iter *iter)
+{
+	assert(iter != NULL);
+
+	if (overlay_iter_end(iter))
+		return NULL;
+
+	return &iter->current;
+}
+
+void overlay_iter_next(struct overlay_iter *iter)
+{
+	assert(iter != NULL);
+
+	if (iter->game < iter->base_end)
+		iter->game++;
+	else
+		iter->added++;
+
+	overlay_iter_load(iter);
+}
@@ -0,0 +1,285 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "../spreden.h"
+#include "../dstruct/mem.h"
+#include "database.h"
+
+/*
+ * game_pack is a compressed copy of a db's games for long,
+ * mostly cold histories that are only ever read in order
+ *
+ * each week is one block, and each game in it is four varints:
+ *
+ *   zigzag(home - previous home)
+ *   zigzag(away - home) << 1 | neutral
+ *   home score
+ *   away score
+ *
+ * the previous home starts at 0 in every block, so any week can
+ * be decoded on its own from the block index. team deltas are
+ * at most two bytes and most scores one, so a game is usually
+ * 4 or 5 bytes against sizeof(struct game)
+ *
+ * the decoder loads four bytes at a time; when none of them has
+ * a continuation bit, which is most games, the whole game comes
+ * out of one word with no branches per field. the byte buffer
+ * is padded so that load never runs off the end
+ */
+
+/* bytes kept zero past the last game, for the word load */
+#define PACK_PAD  4
+
+/* smallest byte buffer worth allocating */
+#define PACK_MIN_BYTES  1024
+
+
+/* helper functions */
+
+static unsigned int zigzag(int v)
+{
+	return v < 0 ? ((unsigned int)~v << 1) | 1 : (unsigned int)v << 1;
+}
+
+static int unzigzag(unsigned int v)
+{
+	return (int)(v >> 1) ^ -(int)(v & 1);
+}
+
+static unsigned char *put_varint(unsigned char *p, unsigned int v)
+{
+	while (v >= 0x80) {
+		*p++ = (unsigned char)(v | 0x80);
+		v >>= 7;
+	}
+	*p++ = (unsigned char)v;
+
+	return p;
+}
+
+static const unsigned char *get_varint(const unsigned char *p,
+				       unsigned int *out)
+{
+	unsigned int v = 0;
+	unsigned int shift = 0;
+
+	while (*p & 0x80) {
+		v |= (unsigned int)(*p++ & 0x7f) << shift;
+		shift += 7;
+	}
+	*out = v | (unsigned int)*p++ << shift;
+
+	return p;
+}
+
+/* make room for n more bytes past the end, plus the pad */
+static int reserve_bytes(struct game_pack *p, size_t n)
+{
+	size_t need = p->num_bytes + n + PACK_PAD;
+	size_t size = p->max_bytes ? p->max_bytes : PACK_MIN_BYTES;
+	unsigned char *bytes;
+
+	if (need <= p->max_bytes)
+		return 0;
+
+	while (size < need)
+		size *= 2;
+
+	bytes = mem_realloc(MEM_DB, p->bytes, size);
+	if (!bytes) {
+		fprintf(stderr, "%s: malloc failed\n", progname);
+		return -1;
+	}
+
+	p->bytes = bytes;
+	p->max_bytes = size;
+	return 0;
+}
+
+/* decode one game at src after home team prev; returns the next byte */
+static const unsigned char *decode_game(const unsigned char *src, int prev,
+					struct game *g)
+{
+	unsigned int v[4];
+	uint32_t word;
+	unsigned int i;
+
+	memcpy(&word, src, sizeof(word));
+	if ((word & 0x80808080u) == 0) {
+		v[0] = src[0];
+		v[1] = src[1];
+		v[2] = src[2];
+		v[3] = src[3];
+		src += 4;
+	} else {
+		for (i = 0; i < 4; i++)
+			src = get_varint(src, &v[i]);
+	}
+
+	g->home_team = prev + unzigzag(v[0]);
+	g->away_team = g->home_team + unzigzag(v[1] >> 1);
+	g->neutral = v[1] & 1;
+	g->home_score = (int)v[2];
+	g->away_score = (int)v[3];
+
+	return src;
+}
+
+
+/* api functions */
+
+void pack_init(struct game_pack *p)
+{
+	memset(p, 0, sizeof(struct game_pack));
+}
+
+void pack_free(struct game_pack *p)
+{
+	mem_free(p->bytes);
+	mem_free(p->blocks);
+	pack_init(p);
+}
+
+/* back to no weeks, keeping the allocations */
+void pack_reset(struct game_pack *p)
+{
+	p->num_weeks = 0;
+	p->num_games = 0;
+	p->num_bytes = 0;
+	if (p->bytes)
+		memset(p->bytes, 0, PACK_PAD);
+}
+
+/*
+ * pack the weeks from the last one packed up to, but not
+ * including, end_week; like the h2h matrix, the pack only ever
+ * has weeks appended
+ */
+int pack_append_weeks(struct game_pack *p, const struct db *db,
+		      unsigned int end_week)
+{
+	const struct week *w;
+	const struct game *g;
+	struct pack_block *b;
+	unsigned char *dst;
+	int prev;
+	int i;
+
+	assert(end_week <= db->num_weeks);
+
+	if (!p->blocks) {
+		p->blocks = mem_alloc(MEM_DB,
+				      DB_MAX_WEEKS * sizeof(struct pack_block));
+		if (!p->blocks) {
+			fprintf(stderr, "%s: malloc failed\n", progname);
+			return -1;
+		}
+	}
+
+	for (; p->num_weeks < end_week; p->num_weeks++) {
+		w = &db->weeks[p->num_weeks];
+		if (reserve_bytes(p, (size_t)(w->game_end - w->game_begin) *
+				  PACK_MAX_GAME_BYTES) < 0)
+			return -2;
+
+		b = &p->blocks[p->num_weeks];
+		b->offset = p->num_bytes;
+		b->game = p->num_games;
+		b->num_games = w->game_end - w->game_begin;
+
+		dst = p->bytes + p->num_bytes;
+		prev = 0;
+		for (i = w->game_begin; i < w->game_end; i++) {
+			g = &db->games[i];
+			dst = put_varint(dst, zigzag(g->home_team - prev));
+			dst = put_varint(dst, zigzag(g->away_team - g->home_team)
+					 << 1 | g->neutral);
+			dst = put_varint(dst, (unsigned int)g->home_score);
+			dst = put_varint(dst, (unsigned int)g->away_score);
+			prev = g->home_team;
+		}
+
+		p->num_bytes = dst - p->bytes;
+		p->num_games += b->num_games;
+		memset(dst, 0, PACK_PAD);
+	}
+
+	return 0;
+}
+
+/* repack from scratch for weeks [0, end_week) */
+int pack_build(struct game_pack *p, const struct db *db,
+	       unsigned int end_week)
+{
+	pack_reset(p);
+	return pack_append_weeks(p, db, end_week);
+}
+
+/* decode week's games into out, which has room for all of them */
+unsigned int pack_decode_week(const struct game_pack *p, unsigned int week,
+			      struct game *out)
+{
+	const struct pack_block *b;
+	const unsigned char *src;
+	unsigned int i;
+	int prev = 0;
+
+	assert(week < p->num_weeks);
+
+	b = &p->blocks[week];
+	src = p->bytes + b->offset;
+	for (i = 0; i < b->num_games; i++) {
+		src = decode_game(src, prev, &out[i]);
+		prev = out[i].home_team;
+	}
+
+	return b->num_games;
+}
+
+/* stream the games of weeks first..last, in order */
+void pack_iter_begin(const struct game_pack *p, unsigned int first,
+		     unsigned int last, struct pack_iter *iter)
+{
+	assert(first <= last && last < p->num_weeks);
+
+	iter->pack = p;
+	iter->week = first;
+	iter->last_week = last;
+	iter->src = p->bytes + p->blocks[first].offset;
+	iter->left = p->blocks[first].num_games;
+	iter->current.home_team = 0;
+	pack_iter_next(iter);
+}
+
+bool pack_iter_end(const struct pack_iter *iter)
+{
+	return iter->week > iter->last_week;
+}
+
+const struct game *pack_iter_data(const struct pack_iter *iter)
+{
+	if (pack_iter_end(iter))
+		return NULL;
+
+	return &iter->current;
+}
+
+void pack_iter_next(struct pack_iter *iter)
+{
+	const struct game_pack *p = iter->pack;
+
+	/* skip to the next week with games; its deltas start over */
+	while (iter->left == 0) {
+		if (++iter->week > iter->last_week)
+			return;
+		iter->src = p->bytes + p->blocks[iter->week].offset;
+		iter->left = p->blocks[iter->week].num_games;
+		iter->current.home_team = 0;
+	}
+
+	iter->src = decode_game(iter->src, iter->current.home_team,
+				&iter->current);
+	iter->left--;
+}
@@ -0,0 +1,285 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+#include <assert.h>
+
+#include <yajl/yajl_parse.h>
+
+#include "../spreden.h"
+#include "database.h"
+#include "../profile/profile.h"
+
+enum record_key {
+	KEY_NONE,
+	KEY_HOME,
+	KEY_HOME_SCORE,
+	KEY_AWAY,
+	KEY_AWAY_SCORE,
+	KEY_NEUTRAL
+};
+
+/* fields that every game record must have */
+#define HAS_HOME        (1 << KEY_HOME)
+#define HAS_HOME_SCORE  (1 << KEY_HOME_SCORE)
+#define HAS_AWAY        (1 << KEY_AWAY)
+#define HAS_AWAY_SCORE  (1 << KEY_AWAY_SCORE)
+#define HAS_REQUIRED    (HAS_HOME | HAS_HOME_SCORE | HAS_AWAY | HAS_AWAY_SCORE)
+
+struct context {
+	struct db *db;
+	const char *filename;
+	unsigned int record;
+	bool in_map;
+	unsigned int fields;
+	enum record_key current;
+	struct game game;
+};
+
+
+/* callbacks */
+
+static int cb_boolean(void *ctx, int value)
+{
+	struct context *c = ctx;
+
+	if (c->current != KEY_NEUTRAL) {
+		fprintf(stderr, "%s: unexpected boolean in %s record %u\n",
+			progname, c->filename, c->record);
+		return 0;
+	}
+
+	c->game.neutral = value;
+	c->fields |= (1 << c->current);
+	c->current = KEY_NONE;
+
+	return 1;
+}
+
+static int cb_integer(void *ctx, long long value)
+{
+	struct context *c = ctx;
+
+	if (value < 0 || value > INT_MAX) {
+		fprintf(stderr, "%s: invalid score in %s record %u\n",
+			progname, c->filename, c->record);
+		return 0;
+	}
+
+	switch (c->current) {
+	case KEY_HOME_SCORE:
+		c->game.home_score = (int)value;
+		break;
+	case KEY_AWAY_SCORE:
+		c->game.away_score = (int)value;
+		break;
+	default:
+		fprintf(stderr, "%s: unexpected integer in %s record %u\n",
+			progname, c->filename, c->record);
+		return 0;
+	}
+
+	c->fields |= (1 << c->current);
+	c->current = KEY_NONE;
+
+	return 1;
+}
+
+static int cb_string(void *ctx, const unsigned char *s, size_t len)
+{
+	struct context *c = ctx;
+	char uuid[UUID_LENGTH+1];
+	int team;
+
+	if (c->current != KEY_HOME && c->current != KEY_AWAY) {
+		fprintf(stderr, "%s: unexpected string in %s record %u\n",
+			progname, c->filename, c->record);
+		return 0;
+	}
+
+	if (len != UUID_LENGTH) {
+		fprintf(stderr, "%s: incorrect uuid length in %s record %u\n",
+			progname, c->filename, c->record);
+		return 0;
+	}
+
+	strncpy(uuid, (const char *)s, UUID_LENGTH);
+	uuid[UUID_LENGTH] = '\0';
+
+	/* teams must already be in the db */
+	team = hash_get(c->db, uuid);
+	if (team < 0) {
+		fprintf(stderr, "%s: unknown team '%s' in %s record %u\n",
+			progname, uuid, c->filename, c->record);
+		return 0;
+	}
+
+	if (c->current == KEY_HOME)
+		c->game.home_team = team;
+	else
+		c->game.away_team = team;
+
+	c->fields |= (1 << c->current);
+	c->current = KEY_NONE;
+
+	return 1;
+}
+
+static int cb_start_map(void *ctx)
+{
+	struct context *c = ctx;
+
+	if (c->in_map || c->fields) {
+		fprintf(stderr, "%s: unexpected start of map at %s record %u\n",
+			progname, c->filename, c->record);
+		return 0;
+	}
+
+	c->in_map = true;
+	c->game.neutral = false;
+	return 1;
+}
+
+static int cb_map_key(void *ctx, const unsigned char *key, size_t len)
+{
+	struct context *c = ctx;
+	static const struct {
+		const char *name;
+		enum record_key key;
+	} keys[] = {
+		{ "home",       KEY_HOME },
+		{ "home_score", KEY_HOME_SCORE },
+		{ "away",       KEY_AWAY },
+		{ "away_score", KEY_AWAY_SCORE },
+		{ "neutral",    KEY_NEUTRAL }
+	};
+	unsigned int i;
+
+	if (c->current != KEY_NONE) {
+		fprintf(stderr, "%s: unexpected key in %s record %u\n",
+			progname, c->filename, c->record);
+		return 0;
+	}
+
+	for (i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+		if (strlen(keys[i].name) == len &&
+		    strncmp(keys[i].name, (const char *)key, len) == 0) {
+			c->current = keys[i].key;
+			return 1;
+		}
+	}
+
+	fprintf(stderr, "%s: unknown key in %s record %u\n",
+		progname, c->filename, c->record);
+	return 0;
+}
+
+static int cb_end_map(void *ctx)
+{
+	struct context *c = ctx;
+	struct db *db = c->db;
+
+	if (!c->in_map || (c->fields & HAS_REQUIRED) != HAS_REQUIRED) {
+		fprintf(stderr, "%s: unexpected end of map at %s record %u\n",
+			progname, c->filename, c->record);
+		return 0;
+	}
+
+	if (c->game.home_team == c->game.away_team) {
+		fprintf(stderr, "%s: team plays itself in %s record %u\n",
+			progname, c->filename, c->record);
+		return 0;
+	}
+
+	if (db->num_games >= DB_MAX_GAMES) {
+		fprintf(stderr, "%s: too many games; DB_MAX_GAMES is %u\n",
+			progname, DB_MAX_GAMES);
+		return 0;
+	}
+
+	db->games[db->num_games++] = c->game;
+
+	c->in_map = false;
+	c->fields = 0;
+	c->record++;
+
+	return 1;
+}
+
+static const yajl_callbacks callbacks = {
+	NULL,
+	cb_boolean,
+	cb_integer,
+	NULL,
+	NULL,
+	cb_string,
+	cb_start_map,
+	cb_map_key,
+	cb_end_map,
+	NULL,
+	NULL
+};
+
+
+/* helper functions */
+
+static void init_context(struct context *c, struct db *db, const char *filename)
+{
+	c->db = db;
+	c->filename = filename;
+	c->record = 1;
+	c->in_map = false;
+	c->fields = 0;
+	c->current = KEY_NONE;
+}
+
+
+/* api functions */
+
+/*
+ * parse one week file that has already been read into buf
+ * the games are appended to db->games and their range is
+ * recorded in db->weeks[week]
+ */
+int db_parse_games(struct db *db, unsigned int week, const char *filename,
+		   const unsigned char *buf, size_t len)
+{
+	yajl_handle handle;
+	yajl_status status;
+	struct context context;
+	struct prof_scope scope;
+	struct trace_span span;
+
+	assert(week < db->num_weeks);
+
+	init_context(&context, db, filename);
+	db->weeks[week].game_begin = db->num_games;
+
+	/* setup yajl */
+	handle = yajl_alloc(&callbacks, &db_parse_alloc, &context);
+	if (!handle) {
+		fprintf(stderr, "%s: malloc failed\n", progname);
+		return -1;
+	}
+
+	prof_begin(&scope, PROF_PARSE_GAMES);
+	trace_begin(&span, "parse", "%s", filename);
+	status = yajl_parse(handle, buf, len);
+	if (status == yajl_status_ok)
+		status = yajl_complete_parse(handle);
+	yajl_free(handle);
+	trace_end(&span);
+	prof_end(&scope);
+
+	if (status != yajl_status_ok) {
+		fprintf(stderr, "%s: json parse error in '%s'\n",
+			progname, filename);
+		return -2;
+	}
+
+	db->weeks[week].game_end = db->num_games;
+	prof_count(PROF_GAMES_PARSED,
+		   db->weeks[week].game_end - db->weeks[week].game_begin);
+
+	return 0;
+}
@@ -6,6 +6,7 @@
 
 #include "../spreden.h"
 #include "database.h"
+#include "../profile/profile.h"
 
 enum record_key {
 	KEY_NONE,
@@ -36,7 +37,7 @@ static int cb_string(void *ctx, const unsigned char *s, size_t len)
 	case KEY_NONE:
 		return 0;
 	case KEY_NAME:
-		if (len > TEAM_NAME_MAX) {
+		if (len >= TEAM_NAME_MAX) {
 			fprintf(stderr, "%s: team name too long in %s record %u\n",
 				progname, c->filename, c->record);
 			return 0;
@@ -103,6 +104,9 @@ static int cb_map_key(void *ctx, const unsigned char *key, size_t len)
 static int cb_end_map(void *ctx)
 {
 	struct context *c = ctx;
+	struct db *db = c->db;
+	struct team *team;
+	int name;
 
 	if (!c->in_map || !c->has_name || !c->has_uuid) {
 		fprintf(stderr, "%s: unexpected end of map at %s record %u\n",
@@ -110,6 +114,33 @@ static int cb_end_map(void *ctx)
 		return 0;
 	}
 
+	if (db->num_teams >= DB_MAX_TEAMS) {
+		fprintf(stderr, "%s: too many teams; DB_MAX_TEAMS is %u\n",
+			progname, DB_MAX_TEAMS);
+		return 0;
+	}
+
+	if (hash_get(db, c->uuid) >= 0) {
+		fprintf(stderr, "%s: duplicate uuid '%s' in %s record %u\n",
+			progname, c->uuid, c->filename, c->record);
+		return 0;
+	}
+
+	/* add the team and make it findable by uuid */
+	name = intern_add(&db->names, c->name, strlen(c->name));
+	if (name < 0) {
+		fprintf(stderr, "%s: malloc failed\n", progname);
+		return 0;
+	}
+
+	team = &db->teams[db->num_teams];
+	team->name = (unsigned int)name;
+	team->sched_len = 0;
+	if (hash_add(db, c->uuid, db->num_teams) < 0)
+		return 0;
+	db->num_teams++;
+	prof_count(PROF_TEAMS_PARSED, 1);
+
 	c->in_map = false;
 	c->has_name = false;
 	c->has_uuid = false;
@@ -158,6 +189,7 @@ int db_parse_teams(struct db *db, const char *filename)
 	yajl_handle handle;
 	yajl_status status;
 	struct context context;
+	struct prof_scope scope;
 
 	init_context(&context, db, filename);
 
@@ -169,20 +201,29 @@ int db_parse_teams(struct db *db, const char *filename)
 		return -1;
 	}
 
+	prof_begin(&scope, PROF_PARSE_TEAMS);
+
 	/* setup yajl */
-	handle = yajl_alloc(&callbacks, NULL, &context);
+	handle = yajl_alloc(&callbacks, &db_parse_alloc, &context);
 
-	while ((read = fread(buf, 1, BUF_SIZE, f))) {
+	status = yajl_status_ok;
+	while (status == yajl_status_ok && (read = fread(buf, 1, BUF_SIZE, f))) {
+		prof_count(PROF_BYTES_READ, read);
 		status = yajl_parse(handle, (unsigned char *)buf, read);
-		if (status != yajl_status_ok) {
-			fprintf(stderr, "%s: json parse error in '%s'\n",
-				progname, filename);
-			return -2;
-		}
 	}
 
-	yajl_complete_parse(handle);
+	if (status == yajl_status_ok)
+		status = yajl_complete_parse(handle);
+
 	yajl_free(handle);
+	fclose(f);
+	prof_end(&scope);
+
+	if (status != yajl_status_ok) {
+		fprintf(stderr, "%s: json parse error in '%s'\n",
+			progname, filename);
+		return -2;
+	}
 
 	return 0;
 }
@@ -4,37 +4,69 @@
 #include <errno.h>
 #include <limits.h>
 #include <assert.h>
+#include <stdatomic.h>
 
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <dirent.h>
 
 #include "../spreden.h"
-#include "../dstruct/list.h"
+#include "../dstruct/arena.h"
+#include "../dstruct/vector.h"
+#include "../dstruct/mem.h"
+#include "../dstruct/pool.h"
 #include "database.h"
+#include "../profile/profile.h"
 
-#define DB_MAX_PATH            1024
-#define DB_MAX_WEEKS_PER_YEAR    52
+#define SCAN_MIN_FILES        32
+#define SCAN_MIN_NAMES      512
 
 /*
- * scan_state holds all the info needed to scan
+ * week_file is a weekXX.* entry found in a year dir
+ * name is an offset into the year's names buffer so
+ * that the buffer can grow while scanning
+ */
+struct week_file {
+	int week;
+	size_t name;
+};
+
+/*
+ * year_scan holds all the info needed to scan
  * for weeks in a year
  *
- * db_scan() fills it out for each year and passes
- * it to scan_year()
+ * db_scan() fills one out for each year and the
+ * pool tasks pass them to scan_year()
  */
-struct scan_state {
-	struct state *state;
+struct year_scan {
 	int year;
 	int begin_week;
 	int end_week;
-	/* last_week - last scanned week */
-	int last_week;
-	/* pathbuf - buffer to carry the current dir/filename around */
-	char pathbuf[DB_MAX_PATH];
-	/* filenames - list of sorted game files to use for year */
-	char *filenames[DB_MAX_WEEKS_PER_YEAR];
+	/* files - in range week files, sorted after the scan */
+	struct week_file *files;
+	unsigned int num_files;
+	unsigned int max_files;
+	/* names - packed file names for files */
+	char *names;
+	size_t names_len;
+	size_t names_max;
+};
+
+/*
+ * scan_state is shared by the pool tasks scanning years
+ *
+ * the years are a parallel for, and once one fails
+ * the rest are skipped
+ */
+struct scan_state {
+	const struct rc *rc;
+	const char *sport;
+	int sport_fd;
+	struct year_scan *years;
+	unsigned int num_years;
+	atomic_int error;
 };
 
 
@@ -55,205 +87,366 @@ static int parse_week_num(const char *filename)
 	return week_num;
 }
 
-static int find_earliest_year(const char *path)
+static int compare_week_files(const void *a, const void *b)
+{
+	const struct week_file *wa = a;
+	const struct week_file *wb = b;
+
+	return (wa->week > wb->week) - (wa->week < wb->week);
+}
+
+static bool is_dir(int dir_fd, const struct dirent *ent)
+{
+	struct stat st;
+
+	if (ent->d_type != DT_UNKNOWN)
+		return (ent->d_type == DT_DIR);
+
+	/* some filesystems don't fill in d_type */
+	if (fstatat(dir_fd, ent->d_name, &st, 0) < 0)
+		return false;
+
+	return S_ISDIR(st.st_mode);
+}
+
+static int find_earliest_year(int sport_fd, const char *path)
 {
 	DIR *dir;
-	struct dirent ent;
-	struct dirent *result;
+	struct dirent *ent;
 	char *endptr;
+	int fd;
 	int earliest = INT_MAX, year;
 
-	/* open the year directory for reading */
-	dir = opendir(path);
+	/* fdopendir takes ownership, so give it a copy */
+	fd = dup(sport_fd);
+	dir = (fd < 0) ? NULL : fdopendir(fd);
 	if (!dir) {
 		fprintf(stderr, "%s: error reading dir '%s': %s\n",
 			progname, path, strerror(errno));
+		if (fd >= 0)
+			close(fd);
 		return -1;
 	}
 
 	/* check each entry in the dir */
-	while (readdir_r(dir, &ent, &result) == 0) {
-		if (!result)
-			break;
-
-		if (result->d_type == DT_DIR) {
-			/* convert file name to int */
-			year = (int)strtol(result->d_name, &endptr, 10);
-			/* if this year is earliest, update it */
-			if (*endptr == '\0' && year < earliest)
-				earliest = year;
-		}
+	while ((ent = readdir(dir))) {
+		if (!is_dir(sport_fd, ent))
+			continue;
+
+		/* convert file name to int */
+		year = (int)strtol(ent->d_name, &endptr, 10);
+		/* if this year is earliest, update it */
+		if (*endptr == '\0' && year < earliest)
+			earliest = year;
 	}
 
 	closedir(dir);
 	return earliest;
 }
 
-static int scan_week(struct scan_state *ss, const char *filename)
+static int add_week_file(struct year_scan *ys, int week, const char *name)
 {
-	int week_num;
-	int index;
-
-	/* if the filename is weekXX.*, parse out week num */
-	week_num = parse_week_num(filename);
-	if (week_num < 0)
-		return 1;
-
-	/*
-	 * if this week is in the range,
-	 * add it to the filenames table
-	 */
-	if (week_num >= ss->begin_week && week_num <= ss->end_week) {
-		/* build full path to file */
-		snprintf(ss->pathbuf, DB_MAX_PATH, "%s/%s/%d/%s",
-			 ss->state->rc.data_dir,
-			 ss->state->rc.sport,
-			 ss->year,
-			 filename);
-		ss->pathbuf[DB_MAX_PATH-1] = '\0';
-
-		/* add to table */
-		index = week_num - ss->begin_week;
-		ss->filenames[index] = strdup(ss->pathbuf);
-
-		/* keep track of last week */
-		if (week_num > ss->last_week)
-			ss->last_week = week_num;
+	size_t len = strlen(name) + 1;
+	void *p;
+
+	/* grow the file table */
+	if (ys->num_files == ys->max_files) {
+		ys->max_files = ys->max_files ? ys->max_files * 2 : SCAN_MIN_FILES;
+		p = mem_realloc(MEM_SCAN, ys->files,
+				ys->max_files * sizeof(struct week_file));
+		if (!p)
+			return -1;
+		ys->files = p;
+	}
+
+	/* grow the name buffer */
+	if (ys->names_len + len > ys->names_max) {
+		ys->names_max = ys->names_max ? ys->names_max * 2 : SCAN_MIN_NAMES;
+		while (ys->names_len + len > ys->names_max)
+			ys->names_max *= 2;
+		p = mem_realloc(MEM_SCAN, ys->names, ys->names_max);
+		if (!p)
+			return -1;
+		ys->names = p;
 	}
 
+	memcpy(ys->names + ys->names_len, name, len);
+	ys->files[ys->num_files].week = week;
+	ys->files[ys->num_files].name = ys->names_len;
+	ys->num_files++;
+	ys->names_len += len;
+
 	return 0;
 }
 
-static int scan_year(struct scan_state *ss)
+static int scan_year(const struct scan_state *ss, struct year_scan *ys)
 {
+	const struct rc *rc = ss->rc;
 	DIR *root;
-	struct dirent ent;
-	struct dirent *result;
-	int scan_result;
-	int num_weeks = 0;
-	int i;
-
-	assert(ss->begin_week != WEEK_ID_BEGIN);
+	struct dirent *ent;
+	char yearbuf[16];
+	int fd;
+	int week_num;
+	unsigned int i;
 
-	/* create path to year directory in db */
-	snprintf(ss->pathbuf, DB_MAX_PATH, "%s/%s/%d",
-		 ss->state->rc.data_dir, ss->state->rc.sport, ss->year);
-	ss->pathbuf[DB_MAX_PATH-1] = '\0';
+	assert(ys->begin_week != WEEK_ID_BEGIN);
 
-	/* open the year directory for reading */
-	root = opendir(ss->pathbuf);
+	/* open the year directory relative to the sport dir */
+	snprintf(yearbuf, sizeof(yearbuf), "%d", ys->year);
+	fd = openat(ss->sport_fd, yearbuf, O_RDONLY | O_DIRECTORY);
+	root = (fd < 0) ? NULL : fdopendir(fd);
 	if (!root) {
-		fprintf(stderr, "%s: error reading dir '%s': %s\n",
-			progname, ss->pathbuf, strerror(errno));
+		fprintf(stderr, "%s: error reading dir '%s/%s/%d': %s\n",
+			progname, rc->data_dir, ss->sport, ys->year,
+			strerror(errno));
+		if (fd >= 0)
+			close(fd);
 		return -1;
 	}
 
 	/* check each entry in the dir */
-	while (readdir_r(root, &ent, &result) == 0) {
-		if (!result)
-			break;
-
-		/* detect if valid week and add to filenames */
-		scan_result = scan_week(ss, result->d_name);
-		if (scan_result < 0) {
+	while ((ent = readdir(root))) {
+		/* if the filename is weekXX.*, parse out week num */
+		week_num = parse_week_num(ent->d_name);
+		if (week_num < 0)
+			continue;
+
+		/* skip weeks that are out of range */
+		if (week_num < ys->begin_week || week_num > ys->end_week)
+			continue;
+
+		if (add_week_file(ys, week_num, ent->d_name) < 0) {
+			fprintf(stderr, "%s: malloc failed\n", progname);
 			closedir(root);
 			return -2;
-		} else if (scan_result == 0) {
-			num_weeks++;
 		}
 	}
 
 	closedir(root);
 
+	/* directory order is arbitrary */
+	qsort(ys->files, ys->num_files, sizeof(struct week_file),
+	      compare_week_files);
+
 	/* update the end value since we didn't know it coming in */
-	if (ss->end_week == WEEK_ID_END)
-		ss->end_week = ss->last_week;
+	if (ys->end_week == WEEK_ID_END) {
+		if (ys->num_files > 0)
+			ys->end_week = ys->files[ys->num_files-1].week;
+		else
+			ys->end_week = ys->begin_week - 1;
+	}
 
-	/* make sure that there are no holes in the data */
-	if (num_weeks != (ss->end_week - ss->begin_week + 1)) {
+	/* make sure that there are no holes or duplicates in the data */
+	for (i = 0; i < ys->num_files; i++) {
+		if (ys->files[i].week != ys->begin_week + (int)i)
+			break;
+	}
+
+	if (i != ys->num_files ||
+	    ys->num_files != (unsigned int)(ys->end_week - ys->begin_week + 1)) {
 		fprintf(stderr, "%s: missing data in '%s/%s/%d'; expected %d weeks: %d-%d\n",
 			progname,
-			ss->state->rc.data_dir,
-			ss->state->rc.sport,
-			ss->year,
-			ss->end_week - ss->begin_week + 1,
-			ss->begin_week,
-			ss->end_week);
+			rc->data_dir,
+			ss->sport,
+			ys->year,
+			ys->end_week - ys->begin_week + 1,
+			ys->begin_week,
+			ys->end_week);
+		return -3;
+	}
+
+	return 0;
+}
+
+/* scan years [begin, end) as one piece of the parallel for */
+static void scan_years(void *arg, unsigned int begin, unsigned int end)
+{
+	struct scan_state *ss = arg;
+	struct prof_scope scope;
+	struct trace_span span;
+	unsigned int i;
+
+	for (i = begin; i < end && !atomic_load(&ss->error); i++) {
+		prof_begin(&scope, PROF_SCAN_YEAR);
+		trace_begin(&span, "scan", "%s %d", ss->sport,
+			    ss->years[i].year);
+		if (scan_year(ss, &ss->years[i]) < 0)
+			atomic_store(&ss->error, 1);
+		trace_end(&span);
+		prof_end(&scope);
+		prof_count(PROF_FILES_SCANNED, ss->years[i].num_files);
+	}
+}
+
+/*
+ * build the full path of every scanned file into one block
+ * and add them to game_files in year/week order, with a
+ * matching entry in the weeks table
+ */
+static int collect_paths(const struct rc *rc, struct db *db,
+			 struct year_scan *years, unsigned int num_years)
+{
+	const struct year_scan *ys;
+	struct arena_mark mark;
+	struct week *w;
+	const char *name;
+	size_t prefix_len;
+	size_t total = 0;
+	char *p;
+	int len;
+	unsigned int num_files = 0;
+	unsigned int i, j;
+
+	/* "<data_dir>/<sport>/<year>/<name>\0" */
+	prefix_len = strlen(rc->data_dir) + strlen(db->sport) + 2;
+	for (i = 0; i < num_years; i++) {
+		ys = &years[i];
+		len = snprintf(NULL, 0, "%d/", ys->year);
+		total += (prefix_len + len) * ys->num_files + ys->names_len;
+		num_files += ys->num_files;
+	}
+
+	if (num_files > DB_MAX_WEEKS) {
+		fprintf(stderr, "%s: too many weeks (%u); DB_MAX_WEEKS is %u\n",
+			progname, num_files, DB_MAX_WEEKS);
 		return -1;
 	}
 
-	/* finally, add the files to list */
-	for (i = 0; i < num_weeks; i++)
-		list_add_back(&ss->state->db->game_files, ss->filenames[i]);
+	arena_mark(&db->arena, &mark);
+	db->game_paths = arena_alloc_aligned(&db->arena, total, 1);
+	if (!db->game_paths ||
+	    vector_reserve(&db->game_files, num_files) < 0) {
+		fprintf(stderr, "%s: malloc failed\n", progname);
+		arena_rollback(&db->arena, &mark);
+		db->game_paths = NULL;
+		return -2;
+	}
+
+	p = db->game_paths;
+	for (i = 0; i < num_years; i++) {
+		ys = &years[i];
+		for (j = 0; j < ys->num_files; j++) {
+			name = ys->names + ys->files[j].name;
+			len = sprintf(p, "%s/%s/%d/%s", rc->data_dir,
+				      db->sport, ys->year, name);
+			vector_push_back(&db->game_files, &p);
+			p += len + 1;
+
+			/* each file is one week in the db */
+			w = &db->weeks[db->num_weeks++];
+			w->id.year = ys->year;
+			w->id.week = ys->files[j].week;
+			w->game_begin = 0;
+			w->game_end = 0;
+		}
+	}
 
+	assert((size_t)(p - db->game_paths) == total);
 	return 0;
 }
 
-int db_scan(struct state *s)
+static int scan_sport(const struct rc *rc, struct pool *pool, struct db *db)
 {
 	struct scan_state ss;
-
-	/* init scan_state */
-	ss.state = s;
-	ss.year = s->rc.data_begin.year;
-	ss.begin_week = WEEK_ID_BEGIN;
-	ss.end_week = WEEK_ID_END;
-	ss.last_week = INT_MIN;
-	memset(ss.filenames, 0, DB_MAX_WEEKS_PER_YEAR);
+	struct year_scan *ys;
+	char pathbuf[DB_MAX_PATH];
+	int begin_year;
+	int err = 0;
+	unsigned int i;
 
 	/* build path to sport in database file layout */
-	snprintf(ss.pathbuf, DB_MAX_PATH, "%s/%s", s->rc.data_dir, s->rc.sport);
-	ss.pathbuf[DB_MAX_PATH-1] = '\0';
+	snprintf(pathbuf, DB_MAX_PATH, "%s/%s", rc->data_dir, db->sport);
+	pathbuf[DB_MAX_PATH-1] = '\0';
 
-	/* make sure the expected dir exists */
-	if (access(ss.pathbuf, R_OK)) {
+	/* open the sport dir; years are opened relative to it */
+	ss.sport_fd = open(pathbuf, O_RDONLY | O_DIRECTORY);
+	if (ss.sport_fd < 0) {
 		fprintf(stderr, "%s: error reading dir '%s': %s\n",
-			progname, ss.pathbuf, strerror(errno));
+			progname, pathbuf, strerror(errno));
 		return -1;
 	}
 
 	/* if begin year is unset, find the earliest */
-	if (s->rc.data_begin.year == WEEK_ID_BEGIN) {
-		ss.year = find_earliest_year(ss.pathbuf);
-		if (ss.year == INT_MAX)
+	begin_year = rc->data_begin.year;
+	if (begin_year == WEEK_ID_BEGIN) {
+		begin_year = find_earliest_year(ss.sport_fd, pathbuf);
+		if (begin_year < 0 || begin_year == INT_MAX) {
+			close(ss.sport_fd);
 			return -2;
+		}
+	}
+
+	ss.rc = rc;
+	ss.sport = db->sport;
+	ss.num_years = 0;
+	if (rc->data_end.year >= begin_year)
+		ss.num_years = rc->data_end.year - begin_year + 1;
+	atomic_init(&ss.error, 0);
+
+	ss.years = mem_calloc(MEM_SCAN, ss.num_years ? ss.num_years : 1,
+			      sizeof(struct year_scan));
+	if (!ss.years) {
+		fprintf(stderr, "%s: malloc failed\n", progname);
+		close(ss.sport_fd);
+		return -3;
 	}
 
-	/* for each year given in the rc,
-	 * build scan_state and call scan_year()
-	 */
-	for (; ss.year <= s->rc.data_end.year; ss.year++) {
+	/* set the week range for each year given in the rc */
+	for (i = 0; i < ss.num_years; i++) {
+		ys = &ss.years[i];
+		ys->year = begin_year + (int)i;
+
 		/* set begin week */
-		if (ss.year == s->rc.data_begin.year)
-			ss.begin_week = s->rc.data_begin.week;
+		if (ys->year == rc->data_begin.year)
+			ys->begin_week = rc->data_begin.week;
 		else
-			ss.begin_week = 1;
+			ys->begin_week = 1;
 
 		/* set end week */
-		if (ss.year == s->rc.data_end.year)
-			ss.end_week = s->rc.data_end.week;
+		if (ys->year == rc->data_end.year)
+			ys->end_week = rc->data_end.week;
 		else
-			ss.end_week = WEEK_ID_END;
+			ys->end_week = WEEK_ID_END;
+	}
+
+	/* scan the years concurrently, one year per piece */
+	pool_parallel_for(pool, 0, ss.num_years, 1, scan_years, &ss);
+	close(ss.sport_fd);
 
-		ss.last_week = INT_MIN;
+	if (atomic_load(&ss.error))
+		err = -4;
+	else if (collect_paths(rc, db, ss.years, ss.num_years) < 0)
+		err = -5;
 
-		/* scan files for year */
-		if (scan_year(&ss) < 0)
-			return -3;
+	for (i = 0; i < ss.num_years; i++) {
+		mem_free(ss.years[i].files);
+		mem_free(ss.years[i].names);
 	}
+	mem_free(ss.years);
+
+	if (err)
+		return err;
 
 	/* print scanned files */
 	if (verbose) {
-		struct list_iter iter;
-		list_iter_begin(&s->db->game_files, &iter);
-		while (!list_iter_end(&iter)) {
+		for (i = 0; i < db->game_files.length; i++)
 			fprintf(stderr, "db: %s\n",
-				(char *)list_iter_data(&iter));
-			list_iter_next(&iter);
-		}
-		fprintf(stderr, "db: %d game files\n",
-			s->db->game_files.length);
+				VECTOR_AT(&db->game_files, const char *, i));
+		fprintf(stderr, "db: %s: %u game files\n",
+			db->sport, db->game_files.length);
 	}
 
 	return 0;
 }
+
+int db_scan(const struct rc *rc, struct pool *pool, struct db *db)
+{
+	struct prof_scope scope;
+	int err;
+
+	prof_begin(&scope, PROF_SCAN);
+	err = scan_sport(rc, pool, db);
+	prof_end(&scope);
+
+	return err;
+}
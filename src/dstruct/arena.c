@@ -0,0 +1,154 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "arena.h"
+#include "mem.h"
+
+/* chunk headers are padded so the data after them is max aligned */
+#define ARENA_ALIGN        _Alignof(max_align_t)
+#define ARENA_HEADER_SIZE  ((sizeof(struct arena_chunk) + ARENA_ALIGN - 1) & \
+			    ~(ARENA_ALIGN - 1))
+
+
+/* helper functions */
+
+static char *chunk_data(struct arena_chunk *c)
+{
+	return (char *)c + ARENA_HEADER_SIZE;
+}
+
+/* offset of the next align boundary at or after used in c */
+static size_t align_up(struct arena_chunk *c, size_t align)
+{
+	uintptr_t p = (uintptr_t)(chunk_data(c) + c->used);
+
+	return c->used + ((align - (p & (align - 1))) & (align - 1));
+}
+
+static struct arena_chunk *new_chunk(struct arena *a, size_t min_size)
+{
+	struct arena_chunk *c;
+	size_t size = a->chunk_size;
+
+	/* big requests get a chunk of their own size */
+	if (min_size > size)
+		size = min_size;
+
+	c = mem_alloc(a->tag, ARENA_HEADER_SIZE + size);
+	if (!c)
+		return NULL;
+
+	c->prev = a->head;
+	c->size = size;
+	c->used = 0;
+	a->head = c;
+
+	return c;
+}
+
+
+/* api functions */
+
+void arena_init(struct arena *a, enum mem_tag tag, size_t chunk_size)
+{
+	assert(a != NULL);
+	assert(chunk_size > 0);
+
+	a->head = NULL;
+	a->chunk_size = chunk_size;
+	a->tag = tag;
+}
+
+/* size bytes aligned to align, which must be a power of two */
+void *arena_alloc_aligned(struct arena *a, size_t size, size_t align)
+{
+	struct arena_chunk *c = a->head;
+	size_t offset;
+
+	assert(a != NULL);
+	assert(align > 0 && (align & (align - 1)) == 0);
+
+	if (c) {
+		offset = align_up(c, align);
+		if (offset <= c->size && size <= c->size - offset) {
+			c->used = offset + size;
+			return chunk_data(c) + offset;
+		}
+	}
+
+	/* chunk data starts max aligned, so only larger aligns need slack */
+	c = new_chunk(a, size + (align > ARENA_ALIGN ? align : 0));
+	if (!c)
+		return NULL;
+
+	offset = align_up(c, align);
+	c->used = offset + size;
+	return chunk_data(c) + offset;
+}
+
+void *arena_alloc(struct arena *a, size_t size)
+{
+	return arena_alloc_aligned(a, size, ARENA_ALIGN);
+}
+
+void *arena_calloc(struct arena *a, size_t n, size_t size)
+{
+	void *p;
+
+	if (size && n > (size_t)-1 / size)
+		return NULL;
+
+	p = arena_alloc(a, n * size);
+	if (p)
+		memset(p, 0, n * size);
+
+	return p;
+}
+
+char *arena_strdup(struct arena *a, const char *s)
+{
+	size_t len = strlen(s) + 1;
+	char *p;
+
+	p = arena_alloc_aligned(a, len, 1);
+	if (p)
+		memcpy(p, s, len);
+
+	return p;
+}
+
+/* remember the current end of the arena */
+void arena_mark(const struct arena *a, struct arena_mark *m)
+{
+	assert(a != NULL);
+
+	m->chunk = a->head;
+	m->used = a->head ? a->head->used : 0;
+}
+
+/* free everything allocated since the mark was taken */
+void arena_rollback(struct arena *a, const struct arena_mark *m)
+{
+	struct arena_chunk *prev;
+
+	assert(a != NULL);
+
+	while (a->head != m->chunk) {
+		assert(a->head != NULL);
+		prev = a->head->prev;
+		mem_free(a->head);
+		a->head = prev;
+	}
+
+	if (a->head)
+		a->head->used = m->used;
+}
+
+void arena_release(struct arena *a)
+{
+	struct arena_mark empty = { NULL, 0 };
+
+	arena_rollback(a, &empty);
+}
@@ -0,0 +1,39 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#include "mem.h"
+
+/*
+ * arena is a bump allocator over a chain of chunks; everything
+ * in it is freed at once by arena_release(), or back to a mark
+ * by arena_rollback()
+ */
+struct arena_chunk {
+	struct arena_chunk *prev;
+	size_t size;
+	size_t used;
+};
+
+struct arena {
+	struct arena_chunk *head;
+	size_t chunk_size;
+	enum mem_tag tag;
+};
+
+struct arena_mark {
+	struct arena_chunk *chunk;
+	size_t used;
+};
+
+extern void arena_init(struct arena *a, enum mem_tag tag, size_t chunk_size);
+extern void *arena_alloc(struct arena *a, size_t size);
+extern void *arena_alloc_aligned(struct arena *a, size_t size, size_t align);
+extern void *arena_calloc(struct arena *a, size_t n, size_t size);
+extern char *arena_strdup(struct arena *a, const char *s);
+extern void arena_mark(const struct arena *a, struct arena_mark *m);
+extern void arena_rollback(struct arena *a, const struct arena_mark *m);
+extern void arena_release(struct arena *a);
+
+#endif
@@ -0,0 +1,207 @@
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "bitset.h"
+
+/*
+ * with gcc or clang the set operations use vector types the
+ * size of the whole set, which come out as one or two wide
+ * register operations instead of a loop over words, and the
+ * counts are built twice on x86-64, with and without popcnt,
+ * so the popcnt instruction is used wherever the cpu has it
+ */
+#if defined(__GNUC__)
+#define BITSET_VECTOR
+typedef uint64_t bitset_vec __attribute__((vector_size(BITSET_MAX_BITS / 8)));
+#endif
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define BITSET_POPCNT  __attribute__((target_clones("popcnt", "default")))
+#else
+#define BITSET_POPCNT
+#endif
+
+
+/* helper functions */
+
+/*
+ * these are macros with gcc so that the builtins expand inside
+ * the popcnt clones of the functions using them
+ */
+#if defined(__GNUC__)
+#define POPCOUNT64(w)  ((unsigned int)__builtin_popcountll(w))
+#define CTZ64(w)       ((unsigned int)__builtin_ctzll(w))
+#else
+#define POPCOUNT64(w)  popcount64(w)
+#define CTZ64(w)       ctz64(w)
+
+static unsigned int popcount64(uint64_t w)
+{
+	unsigned int n = 0;
+
+	while (w) {
+		w &= w - 1;
+		n++;
+	}
+	return n;
+}
+
+static unsigned int ctz64(uint64_t w)
+{
+	unsigned int n = 0;
+
+	while (!(w & 1)) {
+		w >>= 1;
+		n++;
+	}
+	return n;
+}
+#endif
+
+
+/* api functions */
+
+void bitset_clear(struct bitset *b)
+{
+	memset(b->words, 0, sizeof(b->words));
+}
+
+/* the set { 0, ..., n - 1 } */
+void bitset_fill(struct bitset *b, unsigned int n)
+{
+	unsigned int i;
+
+	assert(n <= BITSET_MAX_BITS);
+
+	for (i = 0; i < BITSET_WORDS; i++) {
+		if (n >= 64 * (i + 1))
+			b->words[i] = ~(uint64_t)0;
+		else if (n > 64 * i)
+			b->words[i] = ((uint64_t)1 << (n - 64 * i)) - 1;
+		else
+			b->words[i] = 0;
+	}
+}
+
+void bitset_set(struct bitset *b, unsigned int i)
+{
+	assert(i < BITSET_MAX_BITS);
+
+	b->words[i / 64] |= (uint64_t)1 << (i % 64);
+}
+
+void bitset_reset(struct bitset *b, unsigned int i)
+{
+	assert(i < BITSET_MAX_BITS);
+
+	b->words[i / 64] &= ~((uint64_t)1 << (i % 64));
+}
+
+bool bitset_test(const struct bitset *b, unsigned int i)
+{
+	assert(i < BITSET_MAX_BITS);
+
+	return (b->words[i / 64] >> (i % 64)) & 1;
+}
+
+void bitset_and(struct bitset *out, const struct bitset *a,
+		const struct bitset *b)
+{
+#ifdef BITSET_VECTOR
+	*(bitset_vec *)out->words = *(const bitset_vec *)a->words &
+				    *(const bitset_vec *)b->words;
+#else
+	unsigned int i;
+
+	for (i = 0; i < BITSET_WORDS; i++)
+		out->words[i] = a->words[i] & b->words[i];
+#endif
+}
+
+void bitset_or(struct bitset *out, const struct bitset *a,
+	       const struct bitset *b)
+{
+#ifdef BITSET_VECTOR
+	*(bitset_vec *)out->words = *(const bitset_vec *)a->words |
+				    *(const bitset_vec *)b->words;
+#else
+	unsigned int i;
+
+	for (i = 0; i < BITSET_WORDS; i++)
+		out->words[i] = a->words[i] | b->words[i];
+#endif
+}
+
+/* out = a minus b */
+void bitset_andnot(struct bitset *out, const struct bitset *a,
+		   const struct bitset *b)
+{
+#ifdef BITSET_VECTOR
+	*(bitset_vec *)out->words = *(const bitset_vec *)a->words &
+				    ~*(const bitset_vec *)b->words;
+#else
+	unsigned int i;
+
+	for (i = 0; i < BITSET_WORDS; i++)
+		out->words[i] = a->words[i] & ~b->words[i];
+#endif
+}
+
+bool bitset_empty(const struct bitset *b)
+{
+	uint64_t any = 0;
+	unsigned int i;
+
+	for (i = 0; i < BITSET_WORDS; i++)
+		any |= b->words[i];
+
+	return any == 0;
+}
+
+bool bitset_equal(const struct bitset *a, const struct bitset *b)
+{
+	return memcmp(a->words, b->words, sizeof(a->words)) == 0;
+}
+
+BITSET_POPCNT
+unsigned int bitset_count(const struct bitset *b)
+{
+	unsigned int i, n = 0;
+
+	for (i = 0; i < BITSET_WORDS; i++)
+		n += POPCOUNT64(b->words[i]);
+
+	return n;
+}
+
+/* the size of the intersection of a and b, without building it */
+BITSET_POPCNT
+unsigned int bitset_count_and(const struct bitset *a, const struct bitset *b)
+{
+	unsigned int i, n = 0;
+
+	for (i = 0; i < BITSET_WORDS; i++)
+		n += POPCOUNT64(a->words[i] & b->words[i]);
+
+	return n;
+}
+
+/* the first member at or after from, or -1 */
+int bitset_next(const struct bitset *b, unsigned int from)
+{
+	unsigned int i = from / 64;
+	uint64_t w;
+
+	if (from >= BITSET_MAX_BITS)
+		return -1;
+
+	w = b->words[i] & (~(uint64_t)0 << (from % 64));
+	while (!w) {
+		if (++i == BITSET_WORDS)
+			return -1;
+		w = b->words[i];
+	}
+
+	return (int)(64 * i + CTZ64(w));
+}
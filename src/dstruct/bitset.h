@@ -0,0 +1,37 @@
+#ifndef BITSET_H
+#define BITSET_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * bitset is a fixed size set of small integers, such as team
+ * indices; the words are aligned so the whole set can be worked
+ * on a vector register at a time
+ */
+#define BITSET_MAX_BITS  256
+#define BITSET_WORDS     (BITSET_MAX_BITS / 64)
+
+struct bitset {
+	_Alignas(32) uint64_t words[BITSET_WORDS];
+};
+
+extern void bitset_clear(struct bitset *b);
+extern void bitset_fill(struct bitset *b, unsigned int n);
+extern void bitset_set(struct bitset *b, unsigned int i);
+extern void bitset_reset(struct bitset *b, unsigned int i);
+extern bool bitset_test(const struct bitset *b, unsigned int i);
+extern void bitset_and(struct bitset *out, const struct bitset *a,
+		       const struct bitset *b);
+extern void bitset_or(struct bitset *out, const struct bitset *a,
+		      const struct bitset *b);
+extern void bitset_andnot(struct bitset *out, const struct bitset *a,
+			  const struct bitset *b);
+extern bool bitset_empty(const struct bitset *b);
+extern bool bitset_equal(const struct bitset *a, const struct bitset *b);
+extern unsigned int bitset_count(const struct bitset *b);
+extern unsigned int bitset_count_and(const struct bitset *a,
+				     const struct bitset *b);
+extern int bitset_next(const struct bitset *b, unsigned int from);
+
+#endif
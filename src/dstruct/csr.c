@@ -0,0 +1,153 @@
+#include <stdlib.h>
+#include <assert.h>
+
+#include "csr.h"
+#include "mem.h"
+
+#define CSR_MIN_ROWS  16
+#define CSR_MIN_NNZ   64
+
+
+/* helper functions */
+
+static int grow_rows(struct csr *c, unsigned int rows)
+{
+	unsigned int *row_begin;
+
+	if (rows <= c->max_rows)
+		return 0;
+
+	/* one extra for the end of the last row */
+	row_begin = mem_realloc(c->tag, c->row_begin,
+				((size_t)rows + 1) * sizeof(unsigned int));
+	if (!row_begin)
+		return -1;
+
+	if (!c->row_begin)
+		row_begin[0] = 0;
+	c->row_begin = row_begin;
+	c->max_rows = rows;
+	return 0;
+}
+
+static int grow_nnz(struct csr *c, unsigned int nnz)
+{
+	unsigned int *cols;
+	double *values;
+
+	if (nnz <= c->max_nnz)
+		return 0;
+
+	cols = mem_realloc(c->tag, c->cols, (size_t)nnz * sizeof(unsigned int));
+	if (!cols)
+		return -1;
+	c->cols = cols;
+
+	values = mem_realloc(c->tag, c->values, (size_t)nnz * sizeof(double));
+	if (!values)
+		return -1;
+	c->values = values;
+
+	c->max_nnz = nnz;
+	return 0;
+}
+
+
+/* api functions */
+
+void csr_init(struct csr *c, enum mem_tag tag)
+{
+	c->num_rows = 0;
+	c->nnz = 0;
+	c->max_rows = 0;
+	c->max_nnz = 0;
+	c->row_begin = NULL;
+	c->cols = NULL;
+	c->values = NULL;
+	c->tag = tag;
+}
+
+void csr_free(struct csr *c)
+{
+	mem_free(c->row_begin);
+	mem_free(c->cols);
+	mem_free(c->values);
+	csr_init(c, c->tag);
+}
+
+/* back to no rows, keeping the allocations */
+void csr_clear(struct csr *c)
+{
+	c->num_rows = 0;
+	c->nnz = 0;
+	if (c->row_begin)
+		c->row_begin[0] = 0;
+}
+
+int csr_reserve(struct csr *c, unsigned int rows, unsigned int nnz)
+{
+	if (grow_rows(c, rows < CSR_MIN_ROWS ? CSR_MIN_ROWS : rows) < 0 ||
+	    grow_nnz(c, nnz < CSR_MIN_NNZ ? CSR_MIN_NNZ : nnz) < 0)
+		return -1;
+
+	return 0;
+}
+
+/* add an entry to the open row */
+int csr_push(struct csr *c, unsigned int col, double value)
+{
+	if (c->nnz == c->max_nnz &&
+	    grow_nnz(c, c->max_nnz ? c->max_nnz * 2 : CSR_MIN_NNZ) < 0)
+		return -1;
+
+	c->cols[c->nnz] = col;
+	c->values[c->nnz] = value;
+	c->nnz++;
+	return 0;
+}
+
+/* close the open row; an empty row is fine */
+int csr_end_row(struct csr *c)
+{
+	if (c->num_rows == c->max_rows &&
+	    grow_rows(c, c->max_rows ? c->max_rows * 2 : CSR_MIN_ROWS) < 0)
+		return -1;
+
+	c->num_rows++;
+	c->row_begin[c->num_rows] = c->nnz;
+	return 0;
+}
+
+/*
+ * y = c x for rows [begin, end)
+ *
+ * four independent sums per row so the gathers and adds
+ * overlap instead of waiting on one dependency chain
+ */
+void csr_spmv(const struct csr *c, const double *x, double *y,
+	      unsigned int begin, unsigned int end)
+{
+	const unsigned int *cols = c->cols;
+	const double *values = c->values;
+	unsigned int i, k, k_end;
+	double s0, s1, s2, s3;
+
+	assert(end <= c->num_rows);
+
+	for (i = begin; i < end; i++) {
+		k = c->row_begin[i];
+		k_end = c->row_begin[i+1];
+		s0 = s1 = s2 = s3 = 0.0;
+
+		for (; k + 4 <= k_end; k += 4) {
+			s0 += values[k] * x[cols[k]];
+			s1 += values[k+1] * x[cols[k+1]];
+			s2 += values[k+2] * x[cols[k+2]];
+			s3 += values[k+3] * x[cols[k+3]];
+		}
+		for (; k < k_end; k++)
+			s0 += values[k] * x[cols[k]];
+
+		y[i] = (s0 + s1) + (s2 + s3);
+	}
+}
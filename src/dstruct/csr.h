@@ -0,0 +1,33 @@
+#ifndef CSR_H
+#define CSR_H
+
+#include "mem.h"
+
+/*
+ * csr is a sparse matrix of doubles in compressed sparse row form,
+ * built a row at a time: csr_push() adds an entry to the open row
+ * and csr_end_row() closes it
+ *
+ * row i is cols/values [row_begin[i], row_begin[i+1])
+ */
+struct csr {
+	unsigned int num_rows;
+	unsigned int nnz;
+	unsigned int max_rows;
+	unsigned int max_nnz;
+	unsigned int *row_begin;
+	unsigned int *cols;
+	double *values;
+	enum mem_tag tag;
+};
+
+extern void csr_init(struct csr *c, enum mem_tag tag);
+extern void csr_free(struct csr *c);
+extern void csr_clear(struct csr *c);
+extern int csr_reserve(struct csr *c, unsigned int rows, unsigned int nnz);
+extern int csr_push(struct csr *c, unsigned int col, double value);
+extern int csr_end_row(struct csr *c);
+extern void csr_spmv(const struct csr *c, const double *x, double *y,
+		     unsigned int begin, unsigned int end);
+
+#endif
@@ -0,0 +1,222 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "intern.h"
+#include "mem.h"
+#include "vector.h"
+
+#define INTERN_MIN_SLOTS  64
+#define INTERN_MIN_POOL   1024
+#define INTERN_MAX_POOL   UINT32_MAX
+
+
+/* helper functions */
+
+/* 32 bit FNV-1a */
+static uint32_t hash_bytes(const char *s, size_t len)
+{
+	uint32_t h = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		h ^= (unsigned char)s[i];
+		h *= 16777619u;
+	}
+
+	return h;
+}
+
+static const struct intern_entry *entry_at(const struct intern *t,
+					   unsigned int id)
+{
+	return vector_at(&t->entries, id);
+}
+
+/* the slot holding s, or the empty slot where it would go */
+static unsigned int find_slot(const struct intern *t, const char *s,
+			      size_t len, uint32_t hash)
+{
+	const struct intern_entry *e;
+	unsigned int mask = t->num_slots - 1;
+	unsigned int i = hash & mask;
+
+	while (t->slots[i]) {
+		e = entry_at(t, t->slots[i] - 1);
+		if (e->hash == hash && e->len == len &&
+		    memcmp(t->pool + e->offset, s, len) == 0)
+			break;
+		i = (i + 1) & mask;
+	}
+
+	return i;
+}
+
+/* resize the slot table to num_slots and put every id back */
+static int rehash(struct intern *t, unsigned int num_slots)
+{
+	const struct intern_entry *e;
+	unsigned int mask, i, j;
+	uint32_t *slots;
+
+	slots = mem_calloc(t->tag, num_slots, sizeof(uint32_t));
+	if (!slots)
+		return -1;
+
+	mask = num_slots - 1;
+	for (i = 0; i < t->entries.length; i++) {
+		e = entry_at(t, i);
+		j = e->hash & mask;
+		while (slots[j])
+			j = (j + 1) & mask;
+		slots[j] = i + 1;
+	}
+
+	mem_free(t->slots);
+	t->slots = slots;
+	t->num_slots = num_slots;
+	return 0;
+}
+
+static int grow_slots(struct intern *t)
+{
+	return rehash(t, t->num_slots ? t->num_slots * 2 : INTERN_MIN_SLOTS);
+}
+
+static int grow_pool(struct intern *t, size_t need)
+{
+	size_t pool_max = t->pool_max ? t->pool_max : INTERN_MIN_POOL;
+	char *p;
+
+	while (pool_max < t->pool_len + need)
+		pool_max *= 2;
+
+	if (pool_max > INTERN_MAX_POOL)
+		return -1;
+
+	p = mem_realloc(t->tag, t->pool, pool_max);
+	if (!p)
+		return -1;
+
+	t->pool = p;
+	t->pool_max = pool_max;
+	return 0;
+}
+
+
+/* api functions */
+
+void intern_init(struct intern *t, enum mem_tag tag)
+{
+	assert(t != NULL);
+
+	t->pool = NULL;
+	t->pool_len = 0;
+	t->pool_max = 0;
+	vector_init(&t->entries, sizeof(struct intern_entry));
+	t->slots = NULL;
+	t->num_slots = 0;
+	t->tag = tag;
+}
+
+void intern_free(struct intern *t)
+{
+	assert(t != NULL);
+
+	mem_free(t->pool);
+	mem_free(t->slots);
+	vector_free(&t->entries);
+	intern_init(t, t->tag);
+}
+
+/* make room for count strings of bytes total length up front */
+int intern_reserve(struct intern *t, unsigned int count, size_t bytes)
+{
+	unsigned int num_slots = t->num_slots ? t->num_slots : INTERN_MIN_SLOTS;
+
+	assert(t != NULL);
+
+	while (num_slots < 2 * count)
+		num_slots *= 2;
+
+	if (num_slots > t->num_slots && rehash(t, num_slots) < 0)
+		return -1;
+
+	if (vector_reserve(&t->entries, count) < 0)
+		return -2;
+
+	/* every string takes a nul too */
+	bytes += count;
+	if (bytes > t->pool_max - t->pool_len &&
+	    grow_pool(t, bytes) < 0)
+		return -3;
+
+	return 0;
+}
+
+/* the id of the len bytes at s, adding them if they are new */
+int intern_add(struct intern *t, const char *s, size_t len)
+{
+	struct intern_entry e;
+	uint32_t hash = hash_bytes(s, len);
+	unsigned int slot;
+
+	assert(t != NULL);
+
+	/* keep the table at most half full */
+	if (2 * (t->entries.length + 1) > t->num_slots &&
+	    grow_slots(t) < 0)
+		return -1;
+
+	slot = find_slot(t, s, len, hash);
+	if (t->slots[slot])
+		return (int)(t->slots[slot] - 1);
+
+	/* copy it into the pool, nul terminated */
+	if (t->pool_len + len + 1 > t->pool_max &&
+	    grow_pool(t, len + 1) < 0)
+		return -2;
+
+	e.offset = (uint32_t)t->pool_len;
+	e.len = (uint32_t)len;
+	e.hash = hash;
+	if (vector_push_back(&t->entries, &e) < 0)
+		return -3;
+
+	memcpy(t->pool + t->pool_len, s, len);
+	t->pool[t->pool_len + len] = '\0';
+	t->pool_len += len + 1;
+
+	t->slots[slot] = t->entries.length;
+	return (int)(t->entries.length - 1);
+}
+
+/* the id of the len bytes at s, or -1 if they were never added */
+int intern_find(const struct intern *t, const char *s, size_t len)
+{
+	unsigned int slot;
+
+	assert(t != NULL);
+
+	if (t->num_slots == 0)
+		return -1;
+
+	slot = find_slot(t, s, len, hash_bytes(s, len));
+	return (int)t->slots[slot] - 1;
+}
+
+const char *intern_str(const struct intern *t, unsigned int id)
+{
+	return t->pool + entry_at(t, id)->offset;
+}
+
+size_t intern_len(const struct intern *t, unsigned int id)
+{
+	return entry_at(t, id)->len;
+}
+
+unsigned int intern_count(const struct intern *t)
+{
+	return t->entries.length;
+}
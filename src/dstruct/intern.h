@@ -0,0 +1,45 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mem.h"
+#include "vector.h"
+
+/*
+ * intern keeps one copy of each distinct string in a single
+ * pool and names it by a compact id; ids are handed out in
+ * order from 0, so two strings are equal exactly when their
+ * ids are
+ *
+ * the id is stable for the life of the table, but the pointer
+ * from intern_str() is only good until the next intern_add()
+ */
+struct intern_entry {
+	uint32_t offset;
+	uint32_t len;
+	uint32_t hash;
+};
+
+struct intern {
+	char *pool;
+	size_t pool_len;
+	size_t pool_max;
+	struct vector entries;
+	/* open addressed table of id + 1, 0 is empty */
+	uint32_t *slots;
+	unsigned int num_slots;
+	enum mem_tag tag;
+};
+
+extern void intern_init(struct intern *t, enum mem_tag tag);
+extern void intern_free(struct intern *t);
+extern int intern_reserve(struct intern *t, unsigned int count, size_t bytes);
+extern int intern_add(struct intern *t, const char *s, size_t len);
+extern int intern_find(const struct intern *t, const char *s, size_t len);
+extern const char *intern_str(const struct intern *t, unsigned int id);
+extern size_t intern_len(const struct intern *t, unsigned int id);
+extern unsigned int intern_count(const struct intern *t);
+
+#endif
@@ -2,7 +2,8 @@
 #include <assert.h>
 #include <stdio.h>
 
-#include "../spreden.h"
+#include "list.h"
+#include "mem.h"
 
 void list_init(struct list *l)
 {
@@ -19,7 +20,7 @@ void list_add_front(struct list *l, void *data)
 
 	assert(l != NULL);
 
-	node = malloc(sizeof(struct list_node));
+	node = mem_alloc(MEM_DSTRUCT, sizeof(struct list_node));
 	if (!node) {
 		perror("list_add_front");
 		exit(EXIT_FAILURE);
@@ -45,7 +46,7 @@ void list_add_back(struct list *l, void *data)
 
 	assert(l != NULL);
 
-	node = malloc(sizeof(struct list_node));
+	node = mem_alloc(MEM_DSTRUCT, sizeof(struct list_node));
 	if (!node) {
 		perror("list_add_back");
 		exit(EXIT_FAILURE);
@@ -75,7 +76,7 @@ void list_clear(struct list *l)
 	node = l->head;
 	while (node) {
 		next = node->next;
-		free(node);
+		mem_free(node);
 		node = next;
 		removed++;
 	}
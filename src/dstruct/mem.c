@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <assert.h>
+
+#include "mem.h"
+
+/*
+ * tagged allocation
+ *
+ * each block carries a small header with its size and tag so
+ * that mem_free() can take the bytes back off the right tag;
+ * the header is max_align_t sized so user pointers keep
+ * malloc's alignment
+ */
+
+union mem_header {
+	struct {
+		size_t size;
+		enum mem_tag tag;
+	} h;
+	max_align_t align;
+};
+
+struct tag_stats {
+	atomic_ullong live;
+	atomic_ullong peak;
+	atomic_ullong allocs;
+	atomic_ullong reallocs;
+	atomic_ullong frees;
+};
+
+static const char *tag_names[MEM_NUM_TAGS] = {
+	"db",
+	"scan",
+	"parse",
+	"hash",
+	"rc",
+	"dstruct",
+	"algorithms",
+	"profile"
+};
+
+static struct tag_stats stats[MEM_NUM_TAGS];
+
+
+/* helper functions */
+
+static void charge(enum mem_tag tag, size_t size)
+{
+	struct tag_stats *s = &stats[tag];
+	unsigned long long live, peak;
+
+	live = atomic_fetch_add_explicit(&s->live, size,
+					 memory_order_relaxed) + size;
+	peak = atomic_load_explicit(&s->peak, memory_order_relaxed);
+	while (live > peak &&
+	       !atomic_compare_exchange_weak(&s->peak, &peak, live))
+		;
+}
+
+static void credit(enum mem_tag tag, size_t size)
+{
+	atomic_fetch_sub_explicit(&stats[tag].live, size,
+				  memory_order_relaxed);
+}
+
+static void *user_ptr(union mem_header *hdr)
+{
+	return hdr + 1;
+}
+
+static union mem_header *header(void *p)
+{
+	return (union mem_header *)p - 1;
+}
+
+
+/* api functions */
+
+void *mem_alloc(enum mem_tag tag, size_t size)
+{
+	union mem_header *hdr;
+
+	assert(tag < MEM_NUM_TAGS);
+
+	hdr = malloc(sizeof(union mem_header) + size);
+	if (!hdr)
+		return NULL;
+
+	hdr->h.size = size;
+	hdr->h.tag = tag;
+	charge(tag, size);
+	atomic_fetch_add_explicit(&stats[tag].allocs, 1, memory_order_relaxed);
+
+	return user_ptr(hdr);
+}
+
+void *mem_calloc(enum mem_tag tag, size_t n, size_t size)
+{
+	void *p;
+
+	if (size && n > (size_t)-1 / size)
+		return NULL;
+
+	p = mem_alloc(tag, n * size);
+	if (p)
+		memset(p, 0, n * size);
+
+	return p;
+}
+
+void *mem_realloc(enum mem_tag tag, void *p, size_t size)
+{
+	union mem_header *hdr;
+	size_t old;
+
+	if (!p)
+		return mem_alloc(tag, size);
+
+	hdr = header(p);
+	assert(hdr->h.tag == tag);
+	old = hdr->h.size;
+
+	hdr = realloc(hdr, sizeof(union mem_header) + size);
+	if (!hdr)
+		return NULL;
+
+	hdr->h.size = size;
+	if (size > old)
+		charge(tag, size - old);
+	else
+		credit(tag, old - size);
+	atomic_fetch_add_explicit(&stats[tag].reallocs, 1,
+				  memory_order_relaxed);
+
+	return user_ptr(hdr);
+}
+
+char *mem_strdup(enum mem_tag tag, const char *s)
+{
+	size_t len = strlen(s) + 1;
+	char *p;
+
+	p = mem_alloc(tag, len);
+	if (p)
+		memcpy(p, s, len);
+
+	return p;
+}
+
+void mem_free(void *p)
+{
+	union mem_header *hdr;
+
+	if (!p)
+		return;
+
+	hdr = header(p);
+	credit(hdr->h.tag, hdr->h.size);
+	atomic_fetch_add_explicit(&stats[hdr->h.tag].frees, 1,
+				  memory_order_relaxed);
+	free(hdr);
+}
+
+void mem_get_stats(enum mem_tag tag, struct mem_stats *out)
+{
+	const struct tag_stats *s = &stats[tag];
+
+	assert(tag < MEM_NUM_TAGS);
+
+	out->live = atomic_load(&s->live);
+	out->peak = atomic_load(&s->peak);
+	out->allocs = atomic_load(&s->allocs);
+	out->reallocs = atomic_load(&s->reallocs);
+	out->frees = atomic_load(&s->frees);
+}
+
+const char *mem_tag_name(enum mem_tag tag)
+{
+	assert(tag < MEM_NUM_TAGS);
+
+	return tag_names[tag];
+}
+
+void mem_print(FILE *stream)
+{
+	struct mem_stats s, total;
+	unsigned int i;
+
+	memset(&total, 0, sizeof(struct mem_stats));
+
+	fputs("***** memory *****\n", stream);
+	fprintf(stream, "%-12s %12s %12s %10s %10s %10s\n", "tag",
+		"live bytes", "peak bytes", "allocs", "reallocs", "frees");
+	for (i = 0; i < MEM_NUM_TAGS; i++) {
+		mem_get_stats(i, &s);
+		fprintf(stream, "%-12s %12llu %12llu %10llu %10llu %10llu\n",
+			tag_names[i], s.live, s.peak, s.allocs,
+			s.reallocs, s.frees);
+		total.live += s.live;
+		total.allocs += s.allocs;
+		total.reallocs += s.reallocs;
+		total.frees += s.frees;
+	}
+	fprintf(stream, "%-12s %12llu %12s %10llu %10llu %10llu\n", "total",
+		total.live, "-", total.allocs, total.reallocs, total.frees);
+	fputs("******************\n", stream);
+}
@@ -0,0 +1,37 @@
+#ifndef MEM_H
+#define MEM_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+/* every allocation is charged to one of these */
+enum mem_tag {
+	MEM_DB,
+	MEM_SCAN,
+	MEM_PARSE,
+	MEM_HASH,
+	MEM_RC,
+	MEM_DSTRUCT,
+	MEM_ALGORITHMS,
+	MEM_PROFILE,
+	MEM_NUM_TAGS
+};
+
+struct mem_stats {
+	unsigned long long live;
+	unsigned long long peak;
+	unsigned long long allocs;
+	unsigned long long reallocs;
+	unsigned long long frees;
+};
+
+extern void *mem_alloc(enum mem_tag tag, size_t size);
+extern void *mem_calloc(enum mem_tag tag, size_t n, size_t size);
+extern void *mem_realloc(enum mem_tag tag, void *p, size_t size);
+extern char *mem_strdup(enum mem_tag tag, const char *s);
+extern void mem_free(void *p);
+extern void mem_get_stats(enum mem_tag tag, struct mem_stats *out);
+extern const char *mem_tag_name(enum mem_tag tag);
+extern void mem_print(FILE *stream);
+
+#endif
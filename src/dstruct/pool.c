@@ -0,0 +1,432 @@
+#include <stdlib.h>
+#include <assert.h>
+#include <stdatomic.h>
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "pool.h"
+#include "mem.h"
+
+#define POOL_MIN_DEQUE  64
+
+/* a parallel for with no grain is cut into about this many pieces per thread */
+#define POOL_PIECES_PER_THREAD  8
+
+/* the pool and deque of the current thread, if it is a pool worker */
+static _Thread_local struct pool *self_pool;
+static _Thread_local unsigned int self_index;
+
+/*
+ * pool_for is one running parallel for
+ *
+ * a range splits off its upper half as a new task while it is
+ * bigger than the grain and the pool looks short of work, so
+ * ranges only get cut up as far as idle threads need them
+ */
+struct pool_for {
+	struct pool_group group;
+	pool_range_fn fn;
+	void *arg;
+	unsigned int grain;
+	/* ranges - the split off halves; every split takes the next one */
+	struct pool_range *ranges;
+	unsigned int max_ranges;
+	atomic_uint num_ranges;
+};
+
+struct pool_range {
+	struct pool_for *pf;
+	unsigned int begin;
+	unsigned int end;
+};
+
+static void range_task(void *arg);
+
+
+/* deque functions */
+
+static int deque_init(struct pool_deque *d)
+{
+	d->tasks = NULL;
+	d->top = 0;
+	d->count = 0;
+	d->capacity = 0;
+
+	return pthread_mutex_init(&d->lock, NULL) ? -1 : 0;
+}
+
+static void deque_destroy(struct pool_deque *d)
+{
+	assert(d->count == 0);
+
+	mem_free(d->tasks);
+	pthread_mutex_destroy(&d->lock);
+}
+
+/* double the ring and unwrap it to start at 0; called with the lock held */
+static int deque_grow(struct pool_deque *d)
+{
+	unsigned int capacity = d->capacity ? d->capacity * 2 : POOL_MIN_DEQUE;
+	struct pool_task *tasks;
+	unsigned int i;
+
+	tasks = mem_alloc(MEM_DSTRUCT, capacity * sizeof(struct pool_task));
+	if (!tasks)
+		return -1;
+
+	for (i = 0; i < d->count; i++)
+		tasks[i] = d->tasks[(d->top + i) & (d->capacity - 1)];
+
+	mem_free(d->tasks);
+	d->tasks = tasks;
+	d->top = 0;
+	d->capacity = capacity;
+	return 0;
+}
+
+static int deque_push_bottom(struct pool_deque *d, const struct pool_task *t)
+{
+	int err = 0;
+
+	pthread_mutex_lock(&d->lock);
+	if (d->count == d->capacity && deque_grow(d) < 0) {
+		err = -1;
+	} else {
+		d->tasks[(d->top + d->count) & (d->capacity - 1)] = *t;
+		d->count++;
+	}
+	pthread_mutex_unlock(&d->lock);
+
+	return err;
+}
+
+/* the owner takes its newest task */
+static bool deque_pop_bottom(struct pool_deque *d, struct pool_task *t)
+{
+	bool found = false;
+
+	pthread_mutex_lock(&d->lock);
+	if (d->count > 0) {
+		d->count--;
+		*t = d->tasks[(d->top + d->count) & (d->capacity - 1)];
+		found = true;
+	}
+	pthread_mutex_unlock(&d->lock);
+
+	return found;
+}
+
+/* thieves take the oldest task, which tends to be the biggest */
+static bool deque_steal_top(struct pool_deque *d, struct pool_task *t)
+{
+	bool found = false;
+
+	pthread_mutex_lock(&d->lock);
+	if (d->count > 0) {
+		*t = d->tasks[d->top];
+		d->top = (d->top + 1) & (d->capacity - 1);
+		d->count--;
+		found = true;
+	}
+	pthread_mutex_unlock(&d->lock);
+
+	return found;
+}
+
+
+/* helper functions */
+
+static unsigned int current_index(const struct pool *p)
+{
+	return (self_pool == p) ? self_index : 0;
+}
+
+/* run one task from our own deque, or steal one */
+static bool run_one(struct pool *p, unsigned int me)
+{
+	struct pool_task t;
+	unsigned int i;
+
+	if (deque_pop_bottom(&p->deques[me], &t))
+		goto found;
+
+	for (i = 1; i < p->num_threads; i++) {
+		if (deque_steal_top(&p->deques[(me + i) % p->num_threads], &t))
+			goto found;
+	}
+
+	return false;
+
+found:
+	atomic_fetch_sub(&p->queued, 1);
+	t.fn(t.arg);
+	atomic_fetch_sub(&t.group->pending, 1);
+	return true;
+}
+
+static void *worker_main(void *arg)
+{
+	struct pool_worker *w = arg;
+	struct pool *p = w->pool;
+
+	self_pool = p;
+	self_index = w->index;
+	if (p->thread_start)
+		p->thread_start(w->index);
+
+	while (!atomic_load(&p->stop)) {
+		if (run_one(p, w->index))
+			continue;
+
+		/*
+		 * pushers bump queued before they look at sleeping, and
+		 * we bump sleeping before we look at queued, so one of
+		 * us always sees the other and no wakeup is lost
+		 */
+		pthread_mutex_lock(&p->sleep_lock);
+		atomic_fetch_add(&p->sleeping, 1);
+		while (atomic_load(&p->queued) == 0 && !atomic_load(&p->stop))
+			pthread_cond_wait(&p->wake, &p->sleep_lock);
+		atomic_fetch_sub(&p->sleeping, 1);
+		pthread_mutex_unlock(&p->sleep_lock);
+	}
+
+	return NULL;
+}
+
+static void stop_workers(struct pool *p)
+{
+	unsigned int i;
+
+	pthread_mutex_lock(&p->sleep_lock);
+	atomic_store(&p->stop, true);
+	pthread_cond_broadcast(&p->wake);
+	pthread_mutex_unlock(&p->sleep_lock);
+
+	for (i = 0; i < p->num_started; i++)
+		pthread_join(p->workers[i].thread, NULL);
+	p->num_started = 0;
+}
+
+/* split while a range is big enough and the pool could use the work */
+static bool should_split(struct pool_for *pf, unsigned int begin,
+			 unsigned int end)
+{
+	struct pool *p = pf->group.pool;
+
+	return end - begin > pf->grain &&
+	       atomic_load(&p->queued) < p->num_threads;
+}
+
+static void run_range(struct pool_for *pf, unsigned int begin, unsigned int end)
+{
+	struct pool_range *r;
+	unsigned int mid;
+	unsigned int i;
+
+	while (should_split(pf, begin, end)) {
+		i = atomic_fetch_add(&pf->num_ranges, 1);
+		if (i >= pf->max_ranges)
+			break;
+
+		mid = begin + (end - begin) / 2;
+		r = &pf->ranges[i];
+		r->pf = pf;
+		r->begin = mid;
+		r->end = end;
+		pool_group_spawn(&pf->group, range_task, r);
+		end = mid;
+	}
+
+	pf->fn(pf->arg, begin, end);
+}
+
+static void range_task(void *arg)
+{
+	struct pool_range *r = arg;
+
+	run_range(r->pf, r->begin, r->end);
+}
+
+
+/* api functions */
+
+/* one thread per online cpu */
+unsigned int pool_default_threads(void)
+{
+	long ncpu;
+
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	if (ncpu < 1)
+		return 1;
+	if (ncpu > POOL_MAX_THREADS)
+		return POOL_MAX_THREADS;
+
+	return (unsigned int)ncpu;
+}
+
+/*
+ * start a pool of num_threads threads, counting the caller, or
+ * one per cpu for 0. thread_start, if set, is called first thing
+ * on each new thread with its index
+ */
+int pool_init(struct pool *p, unsigned int num_threads,
+	      void (*thread_start)(unsigned int index))
+{
+	struct pool_worker *w;
+	unsigned int i;
+
+	if (num_threads == 0)
+		num_threads = pool_default_threads();
+	if (num_threads > POOL_MAX_THREADS)
+		num_threads = POOL_MAX_THREADS;
+
+	p->num_threads = num_threads;
+	p->num_started = 0;
+	p->thread_start = thread_start;
+	atomic_init(&p->queued, 0);
+	atomic_init(&p->sleeping, 0);
+	atomic_init(&p->stop, false);
+
+	if (pthread_mutex_init(&p->sleep_lock, NULL))
+		return -1;
+	if (pthread_cond_init(&p->wake, NULL)) {
+		pthread_mutex_destroy(&p->sleep_lock);
+		return -1;
+	}
+
+	for (i = 0; i < num_threads; i++) {
+		if (deque_init(&p->deques[i]) < 0) {
+			while (i-- > 0)
+				deque_destroy(&p->deques[i]);
+			pthread_cond_destroy(&p->wake);
+			pthread_mutex_destroy(&p->sleep_lock);
+			return -1;
+		}
+	}
+
+	/* the caller is thread 0, so start one less */
+	for (i = 1; i < num_threads; i++) {
+		w = &p->workers[p->num_started];
+		w->pool = p;
+		w->index = i;
+		if (pthread_create(&w->thread, NULL, worker_main, w)) {
+			pool_destroy(p);
+			return -2;
+		}
+		p->num_started++;
+	}
+
+	return 0;
+}
+
+void pool_destroy(struct pool *p)
+{
+	unsigned int i;
+
+	stop_workers(p);
+
+	for (i = 0; i < p->num_threads; i++)
+		deque_destroy(&p->deques[i]);
+	pthread_cond_destroy(&p->wake);
+	pthread_mutex_destroy(&p->sleep_lock);
+}
+
+void pool_group_init(struct pool_group *g, struct pool *p)
+{
+	g->pool = p;
+	atomic_init(&g->pending, 0);
+}
+
+/*
+ * queue fn(arg) on the calling thread's deque; if the task
+ * cannot be queued it is run right here instead
+ */
+void pool_group_spawn(struct pool_group *g, void (*fn)(void *arg), void *arg)
+{
+	struct pool *p = g->pool;
+	struct pool_task t;
+
+	t.fn = fn;
+	t.arg = arg;
+	t.group = g;
+
+	if (p->num_threads == 1) {
+		fn(arg);
+		return;
+	}
+
+	/* count it first so a thief can never take it below zero */
+	atomic_fetch_add(&g->pending, 1);
+	atomic_fetch_add(&p->queued, 1);
+	if (deque_push_bottom(&p->deques[current_index(p)], &t) < 0) {
+		atomic_fetch_sub(&p->queued, 1);
+		atomic_fetch_sub(&g->pending, 1);
+		fn(arg);
+		return;
+	}
+
+	if (atomic_load(&p->sleeping) > 0) {
+		pthread_mutex_lock(&p->sleep_lock);
+		pthread_cond_signal(&p->wake);
+		pthread_mutex_unlock(&p->sleep_lock);
+	}
+}
+
+/* wait for every task in the group, running tasks until then */
+void pool_group_wait(struct pool_group *g)
+{
+	struct pool *p = g->pool;
+	unsigned int me = current_index(p);
+
+	while (atomic_load(&g->pending) > 0) {
+		if (!run_one(p, me))
+			sched_yield();
+	}
+}
+
+/*
+ * call fn on pieces of [begin, end) across the pool and wait
+ * for all of them; pieces are never smaller than grain unless
+ * the whole range is, and a grain of 0 picks one
+ */
+void pool_parallel_for(struct pool *p, unsigned int begin, unsigned int end,
+		       unsigned int grain, pool_range_fn fn, void *arg)
+{
+	struct pool_for pf;
+	unsigned int n;
+
+	if (begin >= end)
+		return;
+
+	n = end - begin;
+	if (grain == 0)
+		grain = n / (p->num_threads * POOL_PIECES_PER_THREAD);
+	if (grain == 0)
+		grain = 1;
+
+	if (p->num_threads == 1 || n <= grain) {
+		fn(arg, begin, end);
+		return;
+	}
+
+	/* halving stops at the grain, so there are at most 2n/grain pieces */
+	pool_group_init(&pf.group, p);
+	pf.fn = fn;
+	pf.arg = arg;
+	pf.grain = grain;
+	pf.max_ranges = 2 * (n / grain);
+	atomic_init(&pf.num_ranges, 0);
+	pf.ranges = mem_alloc(MEM_DSTRUCT,
+			      pf.max_ranges * sizeof(struct pool_range));
+	if (!pf.ranges) {
+		fn(arg, begin, end);
+		return;
+	}
+
+	run_range(&pf, begin, end);
+	pool_group_wait(&pf.group);
+	mem_free(pf.ranges);
+}
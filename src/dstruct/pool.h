@@ -0,0 +1,80 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include <pthread.h>
+
+#define POOL_MAX_THREADS  64
+
+/*
+ * pool is a work stealing task pool
+ *
+ * every thread owns a deque, pushes and pops its own tasks at the
+ * bottom and steals the oldest task from another deque when its
+ * own is empty. deque 0 belongs to the thread that made the pool
+ * and is shared by any other thread that is not a pool worker
+ */
+struct pool;
+struct pool_group;
+
+struct pool_task {
+	void (*fn)(void *arg);
+	void *arg;
+	struct pool_group *group;
+};
+
+/* ring of tasks; capacity is zero or a power of two */
+struct pool_deque {
+	pthread_mutex_t lock;
+	struct pool_task *tasks;
+	unsigned int top;
+	unsigned int count;
+	unsigned int capacity;
+};
+
+struct pool_worker {
+	struct pool *pool;
+	unsigned int index;
+	pthread_t thread;
+};
+
+struct pool {
+	unsigned int num_threads;
+	struct pool_deque deques[POOL_MAX_THREADS];
+	/* workers - the started threads, which own deques 1 and up */
+	struct pool_worker workers[POOL_MAX_THREADS];
+	unsigned int num_started;
+	void (*thread_start)(unsigned int index);
+	/* queued - tasks sitting in any deque */
+	atomic_uint queued;
+	atomic_uint sleeping;
+	atomic_bool stop;
+	pthread_mutex_t sleep_lock;
+	pthread_cond_t wake;
+};
+
+/* group is a set of tasks that are waited on together */
+struct pool_group {
+	struct pool *pool;
+	atomic_uint pending;
+};
+
+/* body of a parallel for, called on pieces of [begin, end) */
+typedef void (*pool_range_fn)(void *arg, unsigned int begin, unsigned int end);
+
+/* api functions */
+extern unsigned int pool_default_threads(void);
+extern int pool_init(struct pool *p, unsigned int num_threads,
+		     void (*thread_start)(unsigned int index));
+extern void pool_destroy(struct pool *p);
+extern void pool_group_init(struct pool_group *g, struct pool *p);
+extern void pool_group_spawn(struct pool_group *g, void (*fn)(void *arg),
+			     void *arg);
+extern void pool_group_wait(struct pool_group *g);
+extern void pool_parallel_for(struct pool *p, unsigned int begin,
+			      unsigned int end, unsigned int grain,
+			      pool_range_fn fn, void *arg);
+
+#endif
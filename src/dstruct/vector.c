@@ -0,0 +1,115 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "vector.h"
+#include "mem.h"
+
+#define VECTOR_MIN_CAPACITY  8
+
+void vector_init(struct vector *v, size_t elem_size)
+{
+	assert(v != NULL);
+	assert(elem_size > 0);
+
+	v->data = NULL;
+	v->elem_size = elem_size;
+	v->length = 0;
+	v->capacity = 0;
+}
+
+void vector_free(struct vector *v)
+{
+	assert(v != NULL);
+
+	mem_free(v->data);
+	vector_init(v, v->elem_size);
+}
+
+/* drop the elements but keep the memory */
+void vector_clear(struct vector *v)
+{
+	assert(v != NULL);
+
+	v->length = 0;
+}
+
+/* make room for at least capacity elements */
+int vector_reserve(struct vector *v, unsigned int capacity)
+{
+	void *p;
+
+	assert(v != NULL);
+
+	if (capacity <= v->capacity)
+		return 0;
+
+	p = mem_realloc(MEM_DSTRUCT, v->data, (size_t)capacity * v->elem_size);
+	if (!p)
+		return -1;
+
+	v->data = p;
+	v->capacity = capacity;
+	return 0;
+}
+
+/* copy elem onto the end, doubling the capacity when full */
+int vector_push_back(struct vector *v, const void *elem)
+{
+	unsigned int capacity;
+
+	assert(v != NULL);
+	assert(elem != NULL);
+
+	if (v->length == v->capacity) {
+		capacity = v->capacity ? v->capacity * 2 : VECTOR_MIN_CAPACITY;
+		if (vector_reserve(v, capacity) < 0)
+			return -1;
+	}
+
+	memcpy((char *)v->data + (size_t)v->length * v->elem_size, elem,
+	       v->elem_size);
+	v->length++;
+	return 0;
+}
+
+void *vector_at(const struct vector *v, unsigned int i)
+{
+	assert(v != NULL);
+	assert(i < v->length);
+
+	return (char *)v->data + (size_t)i * v->elem_size;
+}
+
+/* remove element i by moving the last element into its place */
+void vector_swap_remove(struct vector *v, unsigned int i)
+{
+	assert(v != NULL);
+	assert(i < v->length);
+
+	v->length--;
+	if (i != v->length)
+		memcpy(vector_at(v, i),
+		       (char *)v->data + (size_t)v->length * v->elem_size,
+		       v->elem_size);
+}
+
+void vector_sort(struct vector *v, int (*compare)(const void *, const void *))
+{
+	assert(v != NULL);
+
+	if (v->length > 1)
+		qsort(v->data, v->length, v->elem_size, compare);
+}
+
+/* find key in a vector sorted with the same compare */
+void *vector_bsearch(const struct vector *v, const void *key,
+		     int (*compare)(const void *, const void *))
+{
+	assert(v != NULL);
+
+	if (v->length == 0)
+		return NULL;
+
+	return bsearch(key, v->data, v->length, v->elem_size, compare);
+}
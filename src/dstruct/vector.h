@@ -0,0 +1,31 @@
+#ifndef VECTOR_H
+#define VECTOR_H
+
+#include <stddef.h>
+
+/*
+ * vector is a contiguous, growable array of fixed size elements;
+ * VECTOR_AT() gives typed access to an element
+ */
+struct vector {
+	void *data;
+	size_t elem_size;
+	unsigned int length;
+	unsigned int capacity;
+};
+
+#define VECTOR_AT(v, type, i)  (((type *)(v)->data)[i])
+
+extern void vector_init(struct vector *v, size_t elem_size);
+extern void vector_free(struct vector *v);
+extern void vector_clear(struct vector *v);
+extern int vector_reserve(struct vector *v, unsigned int capacity);
+extern int vector_push_back(struct vector *v, const void *elem);
+extern void *vector_at(const struct vector *v, unsigned int i);
+extern void vector_swap_remove(struct vector *v, unsigned int i);
+extern void vector_sort(struct vector *v,
+			int (*compare)(const void *, const void *));
+extern void *vector_bsearch(const struct vector *v, const void *key,
+			    int (*compare)(const void *, const void *));
+
+#endif
@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "profile.h"
+
+/*
+ * timers and counters are process wide and updated with
+ * atomics, since the scan and the sports load on several
+ * threads; timer totals are the sum over all threads
+ */
+
+struct timer {
+	atomic_ullong ns;
+	atomic_ullong calls;
+};
+
+static const char *timer_names[PROF_NUM_TIMERS] = {
+	"load",
+	"parse teams",
+	"scan",
+	"scan year",
+	"load games",
+	"parse games",
+	"finish games",
+	"algorithms"
+};
+
+static const char *counter_names[PROF_NUM_COUNTERS] = {
+	"files scanned",
+	"bytes read",
+	"teams parsed",
+	"games parsed",
+	"hash probes",
+	"algorithm runs",
+	"algorithm iterations",
+	"full solves",
+	"rank-one updates"
+};
+
+bool prof_enabled = false;
+
+static struct timer timers[PROF_NUM_TIMERS];
+static atomic_ullong counters[PROF_NUM_COUNTERS];
+
+/* largest solver residual seen, as the bits of a double */
+static atomic_ullong max_residual;
+
+
+static unsigned long long elapsed_ns(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (unsigned long long)(now.tv_sec - start->tv_sec) * 1000000000ULL +
+		(unsigned long long)(now.tv_nsec - start->tv_nsec);
+}
+
+void prof_begin(struct prof_scope *scope, enum prof_timer timer)
+{
+	scope->timer = timer;
+	if (prof_enabled)
+		clock_gettime(CLOCK_MONOTONIC, &scope->start);
+}
+
+void prof_end(const struct prof_scope *scope)
+{
+	struct timer *t;
+
+	if (!prof_enabled)
+		return;
+
+	t = &timers[scope->timer];
+	atomic_fetch_add_explicit(&t->ns, elapsed_ns(&scope->start),
+				  memory_order_relaxed);
+	atomic_fetch_add_explicit(&t->calls, 1, memory_order_relaxed);
+}
+
+void prof_count(enum prof_counter counter, unsigned long n)
+{
+	if (prof_enabled)
+		atomic_fetch_add_explicit(&counters[counter], n,
+					  memory_order_relaxed);
+}
+
+void prof_residual(double residual)
+{
+	union {
+		double d;
+		unsigned long long u;
+	} cur, next;
+
+	if (!prof_enabled)
+		return;
+
+	/* non-negative doubles order the same as their bits */
+	next.d = residual;
+	cur.u = atomic_load(&max_residual);
+	while (cur.d < next.d &&
+	       !atomic_compare_exchange_weak(&max_residual, &cur.u, next.u))
+		;
+}
+
+void prof_print(FILE *stream)
+{
+	unsigned long long ns, calls;
+	union {
+		double d;
+		unsigned long long u;
+	} residual;
+	unsigned int i;
+
+	fputs("***** profile *****\n", stream);
+
+	fprintf(stream, "%-22s %10s %12s %12s\n",
+		"timer", "calls", "total ms", "mean us");
+	for (i = 0; i < PROF_NUM_TIMERS; i++) {
+		ns = atomic_load(&timers[i].ns);
+		calls = atomic_load(&timers[i].calls);
+		if (calls == 0)
+			continue;
+		fprintf(stream, "%-22s %10llu %12.3f %12.3f\n",
+			timer_names[i], calls, ns / 1e6, ns / 1e3 / calls);
+	}
+
+	fprintf(stream, "%-22s %10s\n", "counter", "value");
+	for (i = 0; i < PROF_NUM_COUNTERS; i++) {
+		fprintf(stream, "%-22s %10llu\n", counter_names[i],
+			(unsigned long long)atomic_load(&counters[i]));
+	}
+
+	residual.u = atomic_load(&max_residual);
+	fprintf(stream, "%-22s %10.3g\n", "max solver residual", residual.d);
+
+	fputs("*******************\n", stream);
+}
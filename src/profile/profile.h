@@ -0,0 +1,69 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <time.h>
+
+#define TRACE_NAME_MAX  64
+
+enum prof_timer {
+	PROF_LOAD,
+	PROF_PARSE_TEAMS,
+	PROF_SCAN,
+	PROF_SCAN_YEAR,
+	PROF_LOAD_GAMES,
+	PROF_PARSE_GAMES,
+	PROF_FINISH_GAMES,
+	PROF_ALGORITHMS,
+	PROF_NUM_TIMERS
+};
+
+enum prof_counter {
+	PROF_FILES_SCANNED,
+	PROF_BYTES_READ,
+	PROF_TEAMS_PARSED,
+	PROF_GAMES_PARSED,
+	PROF_HASH_PROBES,
+	PROF_ALGORITHM_RUNS,
+	PROF_ALGORITHM_ITERATIONS,
+	PROF_FULL_SOLVES,
+	PROF_RANK_ONE_UPDATES,
+	PROF_NUM_COUNTERS
+};
+
+/* a timer that is running; see prof_begin() */
+struct prof_scope {
+	enum prof_timer timer;
+	struct timespec start;
+};
+
+/* a trace span that is running; see trace_begin() */
+struct trace_span {
+	const char *cat;
+	char name[TRACE_NAME_MAX];
+	struct timespec start;
+};
+
+/* set by --profile; the prof_ functions are no-ops without it */
+extern bool prof_enabled;
+
+/* set by --trace; the trace_ functions are no-ops without it */
+extern bool trace_enabled;
+
+/* profile.c */
+extern void prof_begin(struct prof_scope *scope, enum prof_timer timer);
+extern void prof_end(const struct prof_scope *scope);
+extern void prof_count(enum prof_counter counter, unsigned long n);
+extern void prof_residual(double residual);
+extern void prof_print(FILE *stream);
+
+/* trace.c */
+extern int trace_open(const char *path);
+extern void trace_thread_name(const char *fmt, ...);
+extern void trace_begin(struct trace_span *span, const char *cat,
+			const char *fmt, ...);
+extern void trace_end(const struct trace_span *span);
+extern int trace_write(void);
+
+#endif
@@ -0,0 +1,247 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include <pthread.h>
+
+#include "../spreden.h"
+#include "../dstruct/mem.h"
+#include "profile.h"
+
+#define TRACE_MIN_EVENTS  1024
+
+/*
+ * trace events are collected in memory and written out as
+ * trace-event JSON (chrome://tracing, perfetto) at exit
+ *
+ * spans are "X" complete events; thread names are "M" events
+ */
+
+struct trace_event {
+	char ph;
+	unsigned int tid;
+	double ts;
+	double dur;
+	const char *cat;
+	char name[TRACE_NAME_MAX];
+};
+
+bool trace_enabled = false;
+
+static FILE *trace_file;
+static const char *trace_path;
+static struct timespec trace_start;
+
+static pthread_mutex_t events_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct trace_event *events;
+static unsigned int num_events;
+static unsigned int max_events;
+/* dropped_events - left out for want of memory */
+static unsigned int dropped_events;
+
+static atomic_uint next_tid = 1;
+static _Thread_local unsigned int thread_tid;
+
+
+/* helper functions */
+
+static unsigned int current_tid(void)
+{
+	if (thread_tid == 0)
+		thread_tid = atomic_fetch_add(&next_tid, 1);
+
+	return thread_tid;
+}
+
+static double since_start_us(const struct timespec *t)
+{
+	return (t->tv_sec - trace_start.tv_sec) * 1e6 +
+		(t->tv_nsec - trace_start.tv_nsec) / 1e3;
+}
+
+static void add_event(const struct trace_event *ev)
+{
+	struct trace_event *p;
+	unsigned int max;
+
+	pthread_mutex_lock(&events_lock);
+
+	if (num_events == max_events) {
+		max = max_events ? max_events * 2 : TRACE_MIN_EVENTS;
+		p = mem_realloc(MEM_PROFILE, events,
+				max * sizeof(struct trace_event));
+		if (!p) {
+			/* drop the event rather than fail the run */
+			dropped_events++;
+			pthread_mutex_unlock(&events_lock);
+			return;
+		}
+		events = p;
+		max_events = max;
+	}
+
+	events[num_events++] = *ev;
+	pthread_mutex_unlock(&events_lock);
+}
+
+/* keep the end of long names, which is where paths differ */
+static void set_name(char *dst, const char *fmt, va_list ap)
+{
+	char buf[TRACE_NAME_MAX * 4];
+	size_t len;
+
+	vsnprintf(buf, sizeof(buf), fmt, ap);
+	len = strlen(buf);
+	if (len >= TRACE_NAME_MAX)
+		memcpy(dst, buf + len - (TRACE_NAME_MAX - 1), TRACE_NAME_MAX);
+	else
+		memcpy(dst, buf, len + 1);
+}
+
+static void write_string(FILE *f, const char *s)
+{
+	fputc('"', f);
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\')
+			fputc('\\', f);
+		if ((unsigned char)*s < 0x20)
+			fprintf(f, "\\u%04x", *s);
+		else
+			fputc(*s, f);
+	}
+	fputc('"', f);
+}
+
+
+/* api functions */
+
+/* open the trace file now so a bad path fails early */
+int trace_open(const char *path)
+{
+	trace_file = fopen(path, "w");
+	if (!trace_file)
+		return -1;
+
+	trace_path = path;
+	clock_gettime(CLOCK_MONOTONIC, &trace_start);
+	trace_enabled = true;
+	trace_thread_name("main");
+
+	return 0;
+}
+
+void trace_thread_name(const char *fmt, ...)
+{
+	struct trace_event ev;
+	va_list ap;
+
+	if (!trace_enabled)
+		return;
+
+	ev.ph = 'M';
+	ev.tid = current_tid();
+	ev.ts = 0.0;
+	ev.dur = 0.0;
+	ev.cat = "";
+	va_start(ap, fmt);
+	set_name(ev.name, fmt, ap);
+	va_end(ap);
+
+	add_event(&ev);
+}
+
+void trace_begin(struct trace_span *span, const char *cat,
+		 const char *fmt, ...)
+{
+	va_list ap;
+
+	if (!trace_enabled)
+		return;
+
+	span->cat = cat;
+	va_start(ap, fmt);
+	set_name(span->name, fmt, ap);
+	va_end(ap);
+	clock_gettime(CLOCK_MONOTONIC, &span->start);
+}
+
+void trace_end(const struct trace_span *span)
+{
+	struct trace_event ev;
+	struct timespec now;
+
+	if (!trace_enabled)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	ev.ph = 'X';
+	ev.tid = current_tid();
+	ev.ts = since_start_us(&span->start);
+	ev.dur = since_start_us(&now) - ev.ts;
+	ev.cat = span->cat;
+	memcpy(ev.name, span->name, TRACE_NAME_MAX);
+
+	add_event(&ev);
+}
+
+int trace_write(void)
+{
+	const struct trace_event *ev;
+	unsigned int i;
+	int err = 0;
+
+	if (!trace_enabled)
+		return 0;
+
+	pthread_mutex_lock(&events_lock);
+
+	fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", trace_file);
+	for (i = 0; i < num_events; i++) {
+		ev = &events[i];
+		if (ev->ph == 'M') {
+			fprintf(trace_file,
+				"{\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+				"\"name\":\"thread_name\",\"args\":{\"name\":",
+				ev->tid);
+			write_string(trace_file, ev->name);
+			fputs("}}", trace_file);
+		} else {
+			fprintf(trace_file,
+				"{\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+				"\"ts\":%.3f,\"dur\":%.3f,\"cat\":",
+				ev->tid, ev->ts, ev->dur);
+			write_string(trace_file, ev->cat);
+			fputs(",\"name\":", trace_file);
+			write_string(trace_file, ev->name);
+			fputc('}', trace_file);
+		}
+		fputs((i + 1 < num_events) ? ",\n" : "\n", trace_file);
+	}
+	fputs("]}\n", trace_file);
+
+	if (fclose(trace_file) != 0) {
+		fprintf(stderr, "%s: error writing '%s'\n", progname, trace_path);
+		err = -1;
+	}
+
+	/* a trace with holes in it would look like idle time */
+	if (dropped_events) {
+		fprintf(stderr, "%s: out of memory; %u events left out of '%s'\n",
+			progname, dropped_events, trace_path);
+		err = -2;
+	}
+
+	trace_file = NULL;
+	trace_enabled = false;
+	mem_free(events);
+	events = NULL;
+	num_events = max_events = 0;
+	pthread_mutex_unlock(&events_lock);
+
+	return err;
+}
@@ -3,17 +3,25 @@
 #include <string.h>
 #include <alloca.h>
 #include <stdbool.h>
+#include <errno.h>
 
 #include <getopt.h>
 
 #include "../spreden.h"
-#include "../dstruct/list.h"
+#include "../dstruct/arena.h"
+#include "../dstruct/vector.h"
+#include "../dstruct/mem.h"
+#include "../profile/profile.h"
 
 enum command {
 	COMMAND_ANALYZE = 1,
 	COMMAND_HELP,
+	COMMAND_HISTORY,
+	COMMAND_MOVERS,
 	COMMAND_PREDICT,
 	COMMAND_RANK,
+	COMMAND_TREND,
+	COMMAND_TUNE,
 	COMMAND_VERSION,
 	/* error */
 	COMMAND_ERROR
@@ -22,8 +30,22 @@ enum command {
 enum options {
 	OPTION_DATA = 1,
 	OPTION_DATA_START,
+	OPTION_GRID,
+	OPTION_HISTORY,
+	OPTION_MATRIX,
+	OPTION_MATRIX_CSV,
+	OPTION_MEMORY,
+	OPTION_PACK,
+	OPTION_PROFILE,
+	OPTION_RANDOM,
 	OPTION_SCRIPTS,
-	OPTION_VERBOSE
+	OPTION_TEAM,
+	OPTION_THREADS,
+	OPTION_TOP,
+	OPTION_TRACE,
+	OPTION_VERBOSE,
+	OPTION_WEIGHTS,
+	OPTION_WHAT_IF
 };
 
 
@@ -33,6 +55,9 @@ const char *progname = "spreden";
 /* verbose mode from the command line */
 bool verbose = false;
 
+/* memory report from the command line */
+bool memory_report = false;
+
 
 /* week_id functions */
 
@@ -209,6 +234,7 @@ static bool validate_rc(const struct rc *rc)
 static void print_rc(const struct rc *rc)
 {
 	const char *action = "unknown";
+	unsigned int i;
 
 	/*
 	 * map action to string
@@ -218,12 +244,24 @@ static void print_rc(const struct rc *rc)
 	case ACTION_ANALYZE:
 		action = "analyze";
 		break;
+	case ACTION_HISTORY:
+		action = "history";
+		break;
+	case ACTION_MOVERS:
+		action = "movers";
+		break;
 	case ACTION_PREDICT:
 		action = "predict";
 		break;
 	case ACTION_RANK:
 		action = "rank";
 		break;
+	case ACTION_TREND:
+		action = "trend";
+		break;
+	case ACTION_TUNE:
+		action = "tune";
+		break;
 	default:
 		return;
 	}
@@ -234,8 +272,11 @@ static void print_rc(const struct rc *rc)
 	/* print action */
 	fprintf(stderr, "action:       %s\n", action);
 
-	/* print sport */
-	fprintf(stderr, "sport:        %s\n", rc->sport);
+	/* print sports */
+	fputs("sports:       [ ", stderr);
+	for (i = 0; i < rc->sports.length; i++)
+		fprintf(stderr, "%s ", VECTOR_AT(&rc->sports, char *, i));
+	fputs("]\n", stderr);
 
 	/* print data-begin week */
 	fputs("data-begin:   ", stderr);
@@ -258,16 +299,52 @@ static void print_rc(const struct rc *rc)
 
 	/* print algos */
 	fputs("algos:        [ ", stderr);
-	struct list_iter iter;
-	char *algo;
-	list_iter_begin(&rc->user_algorithms, &iter);
-	while (!list_iter_end(&iter)) {
-		algo = list_iter_data(&iter);
-		fprintf(stderr, "%s ", algo);
-		list_iter_next(&iter);
-	}
+	for (i = 0; i < rc->user_algorithms.length; i++)
+		fprintf(stderr, "%s ", VECTOR_AT(&rc->user_algorithms, char *, i));
 	fputs("]\n", stderr);
 
+	/* print thread count */
+	if (rc->threads)
+		fprintf(stderr, "threads:      %u\n", rc->threads);
+	else
+		fputs("threads:      one per cpu\n", stderr);
+
+	/* print ensemble weights file */
+	if (rc->weights_file)
+		fprintf(stderr, "weights:      %s\n", rc->weights_file);
+
+	/* print all pairs matrix files */
+	if (rc->matrix_file)
+		fprintf(stderr, "matrix:       %s\n", rc->matrix_file);
+	if (rc->matrix_csv_file)
+		fprintf(stderr, "matrix-csv:   %s\n", rc->matrix_csv_file);
+
+	/* print rating history and query settings */
+	if (rc->history_dir)
+		fprintf(stderr, "history:      %s\n", rc->history_dir);
+	if (rc->team)
+		fprintf(stderr, "team:         %s\n", rc->team);
+	if (rc->action == ACTION_MOVERS)
+		fprintf(stderr, "top:          %u\n", rc->top);
+
+	/* print game storage */
+	if (rc->pack_games)
+		fputs("pack:         games packed by week\n", stderr);
+
+	/* print what-if games */
+	if (rc->what_if_file)
+		fprintf(stderr, "what-if:      %s\n", rc->what_if_file);
+
+	/* print tune search */
+	if (rc->action == ACTION_TUNE) {
+		fputs("grid:         [ ", stderr);
+		for (i = 0; i < rc->tune_grid.length; i++)
+			fprintf(stderr, "%s ", VECTOR_AT(&rc->tune_grid, char *, i));
+		fputs("]\n", stderr);
+		if (rc->tune_random)
+			fprintf(stderr, "random:       %u points\n", rc->tune_random);
+	}
+
 	/* footer */
 	fputs("***********************\n", stderr);
 }
@@ -275,14 +352,81 @@ static void print_rc(const struct rc *rc)
 
 /* command line parsing */
 
+/* a thread count from 1 to POOL_MAX_THREADS, or 0 for one per cpu */
+static int parse_threads(const char *str, unsigned int *out)
+{
+	char *endptr;
+	long n;
+
+	n = strtol(str, &endptr, 10);
+	if (*str == '\0' || *endptr != '\0' || n < 0 || n > POOL_MAX_THREADS) {
+		fprintf(stderr, "%s: '%s' is not a valid thread count (0 to %d)\n",
+			progname, str, POOL_MAX_THREADS);
+		return -1;
+	}
+
+	*out = (unsigned int)n;
+	return 0;
+}
+
+/* a random search size from 1 to TUNE_MAX_POINTS */
+static int parse_random(const char *str, unsigned int *out)
+{
+	char *endptr;
+	long n;
+
+	n = strtol(str, &endptr, 10);
+	if (*str == '\0' || *endptr != '\0' || n < 1 || n > TUNE_MAX_POINTS) {
+		fprintf(stderr, "%s: '%s' is not a valid number of points (1 to %d)\n",
+			progname, str, TUNE_MAX_POINTS);
+		return -1;
+	}
+
+	*out = (unsigned int)n;
+	return 0;
+}
+
+/* a movers list length of at least 1 */
+static int parse_top(const char *str, unsigned int *out)
+{
+	char *endptr;
+	long n;
+
+	n = strtol(str, &endptr, 10);
+	if (*str == '\0' || *endptr != '\0' || n < 1 || n > INT_MAX) {
+		fprintf(stderr, "%s: '%s' is not a valid number of teams\n",
+			progname, str);
+		return -1;
+	}
+
+	*out = (unsigned int)n;
+	return 0;
+}
+
 static int parse_options(struct rc *rc, int argc, char **argv)
 {
 	static struct option options[] = {
 		{ "data",       required_argument, NULL, OPTION_DATA },
 		{ "data-begin", required_argument, NULL, OPTION_DATA_START },
+		{ "grid",       required_argument, NULL, OPTION_GRID },
+		{ "history",    required_argument, NULL, OPTION_HISTORY },
+		{ "matrix",     required_argument, NULL, OPTION_MATRIX },
+		{ "matrix-csv", required_argument, NULL, OPTION_MATRIX_CSV },
+		{ "memory",     no_argument,       NULL, OPTION_MEMORY },
+		{ "pack",       no_argument,       NULL, OPTION_PACK },
+		{ "profile",    no_argument,       NULL, OPTION_PROFILE },
+		{ "random",     required_argument, NULL, OPTION_RANDOM },
 		{ "scripts",    required_argument, NULL, OPTION_SCRIPTS },
-		{ "verbose",    no_argument,       NULL, OPTION_VERBOSE }
+		{ "team",       required_argument, NULL, OPTION_TEAM },
+		{ "threads",    required_argument, NULL, OPTION_THREADS },
+		{ "top",        required_argument, NULL, OPTION_TOP },
+		{ "trace",      required_argument, NULL, OPTION_TRACE },
+		{ "verbose",    no_argument,       NULL, OPTION_VERBOSE },
+		{ "weights",    required_argument, NULL, OPTION_WEIGHTS },
+		{ "what-if",    required_argument, NULL, OPTION_WHAT_IF },
+		{ NULL,         0,                 NULL, 0 }
 	};
+	char *copy;
 	int c;
 	int index = 0;
 	int err;
@@ -297,7 +441,7 @@ static int parse_options(struct rc *rc, int argc, char **argv)
 
 		switch (c) {
 		case OPTION_DATA:
-			rc->data_dir = strdup(optarg);
+			rc->data_dir = arena_strdup(&rc->arena, optarg);
 			break;
 		case OPTION_DATA_START:
 			err = parse_week(optarg, &rc->data_begin);
@@ -307,12 +451,65 @@ static int parse_options(struct rc *rc, int argc, char **argv)
 			if (rc->data_begin.week == WEEK_ID_NONE)
 				rc->data_begin.week = WEEK_ID_BEGIN;
 			break;
+		case OPTION_GRID:
+			copy = arena_strdup(&rc->arena, optarg);
+			if (!copy || vector_push_back(&rc->tune_grid, &copy) < 0) {
+				fprintf(stderr, "%s: malloc failed\n", progname);
+				return -1;
+			}
+			break;
+		case OPTION_HISTORY:
+			rc->history_dir = arena_strdup(&rc->arena, optarg);
+			break;
+		case OPTION_MATRIX:
+			rc->matrix_file = arena_strdup(&rc->arena, optarg);
+			break;
+		case OPTION_MATRIX_CSV:
+			rc->matrix_csv_file = arena_strdup(&rc->arena, optarg);
+			break;
+		case OPTION_MEMORY:
+			memory_report = true;
+			break;
+		case OPTION_PACK:
+			rc->pack_games = true;
+			break;
+		case OPTION_PROFILE:
+			prof_enabled = true;
+			break;
+		case OPTION_RANDOM:
+			if (parse_random(optarg, &rc->tune_random) < 0)
+				return -1;
+			break;
 		case OPTION_SCRIPTS:
-			rc->scripts_dir = strdup(optarg);
+			rc->scripts_dir = arena_strdup(&rc->arena, optarg);
+			break;
+		case OPTION_TEAM:
+			rc->team = arena_strdup(&rc->arena, optarg);
+			break;
+		case OPTION_THREADS:
+			if (parse_threads(optarg, &rc->threads) < 0)
+				return -1;
+			break;
+		case OPTION_TOP:
+			if (parse_top(optarg, &rc->top) < 0)
+				return -1;
+			break;
+		case OPTION_TRACE:
+			if (trace_open(optarg) < 0) {
+				fprintf(stderr, "%s: could not open '%s' for writing: %s\n",
+					progname, optarg, strerror(errno));
+				return -1;
+			}
 			break;
 		case OPTION_VERBOSE:
 			verbose = true;
 			break;
+		case OPTION_WEIGHTS:
+			rc->weights_file = arena_strdup(&rc->arena, optarg);
+			break;
+		case OPTION_WHAT_IF:
+			rc->what_if_file = arena_strdup(&rc->arena, optarg);
+			break;
 		case '?':
 			break;
 		}
@@ -333,10 +530,18 @@ static enum command get_command(const char *cmd)
 		ret = COMMAND_ANALYZE;
 	else if (strcmp(cmd, "help") == 0)
 		ret = COMMAND_HELP;
+	else if (strcmp(cmd, "history") == 0)
+		ret = COMMAND_HISTORY;
+	else if (strcmp(cmd, "movers") == 0)
+		ret = COMMAND_MOVERS;
 	else if (strcmp(cmd, "predict") == 0)
 		ret = COMMAND_PREDICT;
 	else if (strcmp(cmd, "rank") == 0)
 		ret = COMMAND_RANK;
+	else if (strcmp(cmd, "trend") == 0)
+		ret = COMMAND_TREND;
+	else if (strcmp(cmd, "tune") == 0)
+		ret = COMMAND_TUNE;
 	else if (strcmp(cmd, "version") == 0)
 		ret = COMMAND_VERSION;
 	else
@@ -346,29 +551,46 @@ static enum command get_command(const char *cmd)
 	return ret;
 }
 
-static int parse_algorithms(const char *algos, struct list *list)
+/* split a comma separated string into a vector of copies */
+static int parse_list(const char *str, struct vector *list, struct arena *arena)
 {
 	static const char *delim = ",";
 	size_t len;
 	char *saveptr;
 	char *local;
 	char *a;
+	char *copy;
 	int i = 0;
 
-	/* make local copy of algos string */
-	len = strlen(algos);
+	/* make local copy of the string */
+	len = strlen(str);
 	local = alloca(len + 1);
-	strcpy(local, algos);
+	strcpy(local, str);
 
 	/* tokenize into list */
 	a = strtok_r(local, delim, &saveptr);
 	while (a) {
-		list_add_back(list, strdup(a));
+		copy = arena_strdup(arena, a);
+		if (!copy || vector_push_back(list, &copy) < 0) {
+			fprintf(stderr, "%s: malloc failed\n", progname);
+			return -1;
+		}
 		a = strtok_r(NULL, delim, &saveptr);
 		i++;
 	}
 
-	if (i == 0) {
+	return i;
+}
+
+static int parse_algorithms(const char *algos, struct vector *list,
+			    struct arena *arena)
+{
+	int n;
+
+	n = parse_list(algos, list, arena);
+	if (n < 0)
+		return -1;
+	if (n == 0) {
 		fprintf(stderr, "%s: no algorithms provided in run control\n",
 			progname);
 		return -1;
@@ -377,13 +599,48 @@ static int parse_algorithms(const char *algos, struct list *list)
 	return 0;
 }
 
-/* handle <sport> <target week(s)> <algorithms> argument chain */
+static int parse_sports(const char *sports, struct vector *list,
+			struct arena *arena)
+{
+	const char *sport;
+	unsigned int i, j;
+	int n;
+
+	n = parse_list(sports, list, arena);
+	if (n < 0)
+		return -1;
+	if (n == 0) {
+		fprintf(stderr, "%s: no sport provided in run control\n",
+			progname);
+		return -1;
+	} else if (n > RC_MAX_SPORTS) {
+		fprintf(stderr, "%s: too many sports; RC_MAX_SPORTS is %d\n",
+			progname, RC_MAX_SPORTS);
+		return -2;
+	}
+
+	/* each sport gets one db, so no repeats */
+	for (i = 0; i < list->length; i++) {
+		sport = VECTOR_AT(list, char *, i);
+		for (j = i + 1; j < list->length; j++) {
+			if (strcmp(sport, VECTOR_AT(list, char *, j)) == 0) {
+				fprintf(stderr, "%s: sport '%s' given more than once\n",
+					progname, sport);
+				return -3;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/* handle <sport[,sport...]> <target week(s)> <algorithms> argument chain */
 static int parse_rc_args(struct rc *rc, int argc, char **argv)
 {
 	int err;
-	const char *sport;
 	struct week_id begin_date, end_date;
-	struct list algorithm_list;
+	struct vector sport_list;
+	struct vector algorithm_list;
 
 	/* make sure there are enough arguments */
 	if (argc < 3) {
@@ -392,8 +649,11 @@ static int parse_rc_args(struct rc *rc, int argc, char **argv)
 		return -1;
 	}
 
-	/* the first argument is sport; just copy it */
-	sport = strdup(argv[0]);
+	/* the first argument is one or more sports */
+	vector_init(&sport_list, sizeof(char *));
+	err = parse_sports(argv[0], &sport_list, &rc->arena);
+	if (err)
+		return -2;
 
 	/* parse action range */
 	err = parse_week_range(argv[1], &begin_date, &end_date);
@@ -405,13 +665,13 @@ static int parse_rc_args(struct rc *rc, int argc, char **argv)
 		end_date = begin_date;
 
 	/* parse algortihm list */
-	list_init(&algorithm_list);
-	err = parse_algorithms(argv[2], &algorithm_list);
+	vector_init(&algorithm_list, sizeof(char *));
+	err = parse_algorithms(argv[2], &algorithm_list, &rc->arena);
 	if (err)
 		return -2;
 
 	/* update rc */
-	rc->sport = strdup(sport);
+	rc->sports = sport_list;
 	rc->target_begin = begin_date;
 	rc->target_end = end_date;
 	rc->user_algorithms = algorithm_list;
@@ -450,14 +710,25 @@ void rc_init(struct rc *rc)
 	};
 
 	rc->action = ACTION_NONE;
-	rc->sport = NULL;
+	vector_init(&rc->sports, sizeof(char *));
 	rc->data_begin = BEGIN_WEEK;
 	rc->data_end = END_WEEK;
 	rc->target_begin = NONE_WEEK;
 	rc->target_end = NONE_WEEK;
-	list_init(&rc->user_algorithms);
+	vector_init(&rc->user_algorithms, sizeof(char *));
 	rc->scripts_dir = DEFAULT_SCRIPTS_DIR;
 	rc->data_dir = DEFAULT_DATA_DIR;
+	rc->threads = 0;
+	rc->weights_file = NULL;
+	rc->matrix_file = NULL;
+	rc->matrix_csv_file = NULL;
+	vector_init(&rc->tune_grid, sizeof(char *));
+	rc->tune_random = 0;
+	rc->history_dir = NULL;
+	rc->team = NULL;
+	rc->top = MOVERS_DEFAULT_TOP;
+	rc->what_if_file = NULL;
+	arena_init(&rc->arena, MEM_RC, RC_ARENA_CHUNK);
 }
 
 int rc_read_options(struct state *s, int argc, char **argv)
@@ -495,12 +766,24 @@ int rc_read_options(struct state *s, int argc, char **argv)
 	case COMMAND_HELP:
 		rc->action = ACTION_USAGE;
 		break;
+	case COMMAND_HISTORY:
+		rc->action = ACTION_HISTORY;
+		break;
+	case COMMAND_MOVERS:
+		rc->action = ACTION_MOVERS;
+		break;
 	case COMMAND_PREDICT:
 		rc->action = ACTION_PREDICT;
 		break;
 	case COMMAND_RANK:
 		rc->action = ACTION_RANK;
 		break;
+	case COMMAND_TREND:
+		rc->action = ACTION_TREND;
+		break;
+	case COMMAND_TUNE:
+		rc->action = ACTION_TUNE;
+		break;
 	case COMMAND_VERSION:
 		rc->action = ACTION_VERSION;
 		break;
@@ -510,8 +793,12 @@ int rc_read_options(struct state *s, int argc, char **argv)
 
 	/* handle <sport> <target week(s)> <algorithms> */
 	if (rc->action == ACTION_ANALYZE ||
+	    rc->action == ACTION_HISTORY ||
+	    rc->action == ACTION_MOVERS ||
 	    rc->action == ACTION_PREDICT ||
-	    rc->action == ACTION_RANK) {
+	    rc->action == ACTION_RANK ||
+	    rc->action == ACTION_TREND ||
+	    rc->action == ACTION_TUNE) {
 		/*
 		 * calculate new argc from cmd_index to the
 		 * end of the argument vector
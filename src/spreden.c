@@ -5,6 +5,8 @@
 #include <assert.h>
 
 #include "spreden.h"
+#include "profile/profile.h"
+#include "dstruct/mem.h"
 
 static void display_version(void)
 {
@@ -20,21 +22,61 @@ static void display_usage(void)
 		"    commands:\n"
 		"        analyze\n"
 		"        help\n"
+		"        history\n"
+		"        movers\n"
 		"        predict\n"
 		"        rank\n"
+		"        trend\n"
+		"        tune\n"
 		"        version\n";
 	fputs(usage, stdout);
 }
 
+static void print_profile(void)
+{
+	prof_print(stderr);
+}
+
+static void print_memory(void)
+{
+	mem_print(stderr);
+}
+
+/* pool workers show up in the trace as "worker N" */
+static void name_worker(unsigned int index)
+{
+	trace_thread_name("worker %u", index);
+}
+
+static void write_trace(void)
+{
+	if (trace_write() < 0)
+		fprintf(stderr, "%s: error writing trace\n", progname);
+}
+
 int main(int argc, char **argv)
 {
 	struct state state;
+	int status = EXIT_SUCCESS;
 
 	memset(&state, 0, sizeof(struct state));
 
 	if (rc_read_options(&state, argc, argv) < 0)
 		return EXIT_FAILURE;
 
+	if (pool_init(&state.pool, state.rc.threads, name_worker) < 0) {
+		fprintf(stderr, "%s: could not start threads\n", progname);
+		return EXIT_FAILURE;
+	}
+
+	/* print the reports and write the trace however we exit */
+	if (memory_report)
+		atexit(print_memory);
+	if (prof_enabled)
+		atexit(print_profile);
+	if (trace_enabled)
+		atexit(write_trace);
+
 	switch (state.rc.action) {
 	case ACTION_NONE:
 		/* this should never happen... */
@@ -47,11 +89,36 @@ int main(int argc, char **argv)
 		display_version();
 		break;
 	case ACTION_ANALYZE:
-	case ACTION_RANK:
+		if (db_load(&state) < 0 || algo_analyze(&state) < 0)
+			status = EXIT_FAILURE;
+		break;
 	case ACTION_PREDICT:
-		db_load(&state);
+		if (db_load(&state) < 0 || algo_predict(&state) < 0)
+			status = EXIT_FAILURE;
+		break;
+	case ACTION_RANK:
+		if (db_load(&state) < 0 || algo_rank(&state) < 0)
+			status = EXIT_FAILURE;
+		break;
+	case ACTION_TUNE:
+		if (db_load(&state) < 0 || algo_tune(&state) < 0)
+			status = EXIT_FAILURE;
+		break;
+	/* the queries read the rating history, not the games */
+	case ACTION_HISTORY:
+		if (query_history(&state) < 0)
+			status = EXIT_FAILURE;
+		break;
+	case ACTION_MOVERS:
+		if (query_movers(&state) < 0)
+			status = EXIT_FAILURE;
+		break;
+	case ACTION_TREND:
+		if (query_trend(&state) < 0)
+			status = EXIT_FAILURE;
 		break;
 	}
 
-	return EXIT_SUCCESS;
+	pool_destroy(&state.pool);
+	return status;
 }
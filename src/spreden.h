@@ -6,7 +6,9 @@
 
 #include <uuid/uuid.h>
 
-#include "dstruct/list.h"
+#include "dstruct/arena.h"
+#include "dstruct/pool.h"
+#include "dstruct/vector.h"
 
 #define SPREDEN_VERSION_MAJOR 0
 #define SPREDEN_VERSION_MINOR 1
@@ -21,11 +23,24 @@
 #define TEAM_NAME_MAX    32
 #define TEAM_SCHED_MAX  256
 
+#define RC_MAX_SPORTS     8
+#define RC_ARENA_CHUNK 1024
+
+/* most parameter settings one tune run tries */
+#define TUNE_MAX_POINTS  65536
+
+/* teams movers lists each way unless told otherwise */
+#define MOVERS_DEFAULT_TOP  5
+
 enum action {
 	ACTION_ANALYZE,
+	ACTION_HISTORY,
+	ACTION_MOVERS,
 	ACTION_NONE,
 	ACTION_PREDICT,
 	ACTION_RANK,
+	ACTION_TREND,
+	ACTION_TUNE,
 	ACTION_USAGE,
 	ACTION_VERSION
 };
@@ -36,7 +51,8 @@ struct week_id {
 };
 
 struct team {
-	char name[TEAM_NAME_MAX];
+	/* name - id in the db's interned team names */
+	unsigned int name;
 	int sched[TEAM_SCHED_MAX];
 	int sched_len;
 };
@@ -52,21 +68,48 @@ struct game {
 /* rc contains user-defined parameters */
 struct rc {
 	enum action action;
-	const char *sport;
+	struct vector sports;
 	struct week_id data_begin;
 	struct week_id data_end;
 	struct week_id target_begin;
 	struct week_id target_end;
-	struct list user_algorithms;
+	struct vector user_algorithms;
 	const char *scripts_dir;
 	const char *data_dir;
+	/* threads - size of the task pool, 0 for one per cpu */
+	unsigned int threads;
+	/* weights_file - ensemble weights written by analyze, read by predict */
+	const char *weights_file;
+	/* matrix_file, matrix_csv_file - predict's all pairs output */
+	const char *matrix_file;
+	const char *matrix_csv_file;
+	/* tune_grid - tune's name=lo:hi:step parameter ranges */
+	struct vector tune_grid;
+	/* tune_random - random points to try in the ranges, 0 for the grid */
+	unsigned int tune_random;
+	/* history_dir - where rank keeps ratings and the queries read them */
+	const char *history_dir;
+	/* team - the team a query is about */
+	const char *team;
+	/* top - teams movers lists each way */
+	unsigned int top;
+	/* what_if_file - games rank and predict rate as if played */
+	const char *what_if_file;
+	/* pack_games - also keep each db's games packed by week */
+	bool pack_games;
+	/* arena - the strings above, which live for the whole run */
+	struct arena arena;
 };
 
 struct db;
 
+/* state holds one db per sport in the rc, in the same order */
 struct state {
 	struct rc rc;
-	struct db *db;
+	struct db *dbs[RC_MAX_SPORTS];
+	unsigned int num_dbs;
+	/* pool - runs the parallel parts of loading and rating */
+	struct pool pool;
 };
 
 
@@ -75,6 +118,7 @@ struct state {
 /* rc.c */
 extern const char *progname;
 extern bool verbose;
+extern bool memory_report;
 
 
 /* functions */
@@ -85,4 +129,19 @@ extern int rc_read_options(struct state *s, int argc, char **argv);
 /* db.c */
 extern int db_load(struct state *s);
 
+/* algorithms.c */
+extern int algo_rank(struct state *s);
+
+/* ensemble.c */
+extern int algo_analyze(struct state *s);
+extern int algo_predict(struct state *s);
+
+/* tune.c */
+extern int algo_tune(struct state *s);
+
+/* query.c */
+extern int query_history(struct state *s);
+extern int query_movers(struct state *s);
+extern int query_trend(struct state *s);
+
 #endif
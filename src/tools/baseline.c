@@ -0,0 +1,249 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include <yajl/yajl_parse.h>
+
+#include "baseline.h"
+
+#define BUF_SIZE  4096
+
+/*
+ * a baseline is the --json output of spreden-bench; only the
+ * objects in the "benchmarks" array are read, everything else
+ * is skipped
+ */
+
+enum field {
+	FIELD_NONE,
+	FIELD_NAME,
+	FIELD_NS_PER_OP,
+	FIELD_ALLOCS,
+	FIELD_INSTRUCTIONS
+};
+
+struct context {
+	struct baseline *b;
+	struct baseline_entry *entry;
+	unsigned int depth;
+	bool in_benchmarks;
+	bool benchmarks_key;
+	enum field field;
+	bool error;
+};
+
+
+/* yajl callbacks */
+
+static int handle_number(void *ctx, const char *str, size_t len)
+{
+	struct context *c = ctx;
+	char buf[64];
+	double v;
+
+	if (!c->entry || c->field == FIELD_NONE)
+		return 1;
+
+	if (len >= sizeof(buf) || c->field == FIELD_NAME) {
+		c->error = true;
+		return 0;
+	}
+
+	memcpy(buf, str, len);
+	buf[len] = '\0';
+	v = strtod(buf, NULL);
+
+	switch (c->field) {
+	case FIELD_NS_PER_OP:
+		c->entry->ns_per_op = v;
+		break;
+	case FIELD_ALLOCS:
+		c->entry->allocs_per_run = v;
+		break;
+	case FIELD_INSTRUCTIONS:
+		c->entry->instructions_per_op = v;
+		break;
+	default:
+		break;
+	}
+
+	c->field = FIELD_NONE;
+	return 1;
+}
+
+static int handle_null(void *ctx)
+{
+	struct context *c = ctx;
+
+	/* a null metric was not measured */
+	c->field = FIELD_NONE;
+	return 1;
+}
+
+static int handle_string(void *ctx, const unsigned char *str, size_t len)
+{
+	struct context *c = ctx;
+
+	if (!c->entry || c->field != FIELD_NAME)
+		return 1;
+
+	if (len >= BASELINE_NAME_MAX) {
+		c->error = true;
+		return 0;
+	}
+
+	memcpy(c->entry->name, str, len);
+	c->entry->name[len] = '\0';
+	c->field = FIELD_NONE;
+	return 1;
+}
+
+static int handle_map_key(void *ctx, const unsigned char *key, size_t len)
+{
+	struct context *c = ctx;
+
+#define KEY_IS(s) (len == strlen(s) && memcmp(key, s, len) == 0)
+
+	c->field = FIELD_NONE;
+	c->benchmarks_key = false;
+
+	if (c->depth == 1)
+		c->benchmarks_key = KEY_IS("benchmarks");
+	else if (c->entry) {
+		if (KEY_IS("name"))
+			c->field = FIELD_NAME;
+		else if (KEY_IS("ns_per_op_min"))
+			c->field = FIELD_NS_PER_OP;
+		else if (KEY_IS("allocs_per_run"))
+			c->field = FIELD_ALLOCS;
+		else if (KEY_IS("instructions_per_op"))
+			c->field = FIELD_INSTRUCTIONS;
+	}
+
+#undef KEY_IS
+
+	return 1;
+}
+
+static int handle_start_map(void *ctx)
+{
+	struct context *c = ctx;
+	struct baseline *b = c->b;
+
+	c->depth++;
+
+	if (c->in_benchmarks && c->depth == 3) {
+		if (b->num_entries == BASELINE_MAX_ENTRIES) {
+			c->error = true;
+			return 0;
+		}
+		c->entry = &b->entries[b->num_entries++];
+		memset(c->entry, 0, sizeof(struct baseline_entry));
+		c->entry->instructions_per_op = -1.0;
+	}
+
+	return 1;
+}
+
+static int handle_end_map(void *ctx)
+{
+	struct context *c = ctx;
+
+	if (c->entry && c->depth == 3)
+		c->entry = NULL;
+	c->depth--;
+
+	return 1;
+}
+
+static int handle_start_array(void *ctx)
+{
+	struct context *c = ctx;
+
+	if (c->benchmarks_key)
+		c->in_benchmarks = true;
+	c->depth++;
+
+	return 1;
+}
+
+static int handle_end_array(void *ctx)
+{
+	struct context *c = ctx;
+
+	c->depth--;
+	if (c->depth == 1)
+		c->in_benchmarks = false;
+
+	return 1;
+}
+
+static yajl_callbacks callbacks = {
+	handle_null,
+	NULL,
+	NULL,
+	NULL,
+	handle_number,
+	handle_string,
+	handle_start_map,
+	handle_map_key,
+	handle_end_map,
+	handle_start_array,
+	handle_end_array
+};
+
+
+/* api functions */
+
+int baseline_read(struct baseline *b, const char *filename)
+{
+	unsigned char buf[BUF_SIZE];
+	struct context context;
+	yajl_handle handle;
+	yajl_status status;
+	size_t read;
+	FILE *f;
+
+	memset(b, 0, sizeof(struct baseline));
+	memset(&context, 0, sizeof(struct context));
+	context.b = b;
+
+	f = fopen(filename, "r");
+	if (!f)
+		return -1;
+
+	handle = yajl_alloc(&callbacks, NULL, &context);
+	if (!handle) {
+		fclose(f);
+		return -2;
+	}
+
+	status = yajl_status_ok;
+	while (status == yajl_status_ok && (read = fread(buf, 1, BUF_SIZE, f)))
+		status = yajl_parse(handle, buf, read);
+
+	if (status == yajl_status_ok)
+		status = yajl_complete_parse(handle);
+
+	yajl_free(handle);
+	fclose(f);
+
+	if (status != yajl_status_ok || context.error)
+		return -3;
+
+	return 0;
+}
+
+const struct baseline_entry *baseline_find(const struct baseline *b,
+					   const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < b->num_entries; i++) {
+		if (strcmp(b->entries[i].name, name) == 0)
+			return &b->entries[i];
+	}
+
+	return NULL;
+}
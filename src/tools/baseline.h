@@ -0,0 +1,27 @@
+#ifndef BASELINE_H
+#define BASELINE_H
+
+#include <stdbool.h>
+
+#define BASELINE_MAX_ENTRIES  32
+#define BASELINE_NAME_MAX     64
+
+/* the metrics of one benchmark from a checked in baseline */
+struct baseline_entry {
+	char name[BASELINE_NAME_MAX];
+	double ns_per_op;
+	double allocs_per_run;
+	/* negative when the baseline machine had no counter */
+	double instructions_per_op;
+};
+
+struct baseline {
+	struct baseline_entry entries[BASELINE_MAX_ENTRIES];
+	unsigned int num_entries;
+};
+
+extern int baseline_read(struct baseline *b, const char *filename);
+extern const struct baseline_entry *baseline_find(const struct baseline *b,
+						  const char *name);
+
+#endif
@@ -0,0 +1,983 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <math.h>
+
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "../spreden.h"
+#include "../dstruct/list.h"
+#include "../dstruct/pool.h"
+#include "../dstruct/vector.h"
+#include "../database/database.h"
+#include "../algorithms/algorithms.h"
+#include "../dstruct/mem.h"
+#include "baseline.h"
+
+#define BENCH_MAX_RUNS      1000
+#define BENCH_MAX_RESULTS     32
+#define BENCH_HASH_ROUNDS    256
+#define BENCH_LIST_ELEMENTS  100000
+
+/* default regression thresholds, as fractions over the baseline */
+#define BENCH_TIME_TOLERANCE   0.50
+#define BENCH_COUNT_TOLERANCE  0.02
+
+enum options {
+	OPTION_REPEAT = 1,
+	OPTION_WARMUP,
+	OPTION_JSON,
+	OPTION_BASELINE,
+	OPTION_TIME_TOLERANCE,
+	OPTION_COUNT_TOLERANCE
+};
+
+/*
+ * sample is what one benchmark iteration measures: wall time,
+ * heap allocations and, where the kernel allows it, user space
+ * instructions retired
+ */
+struct sample {
+	double start_ns;
+	unsigned long long start_allocs;
+	long long start_instructions;
+	double ns;
+	unsigned long long allocs;
+	long long instructions;
+};
+
+/* one benchmark iteration; measures its own work into *s */
+typedef long (*bench_fn)(void *arg, struct sample *s);
+
+struct result {
+	const char *name;
+	const char *unit;
+	long ops;
+	unsigned int runs;
+	double min_ns;
+	double median_ns;
+	double mean_ns;
+	double allocs;
+	/* negative without an instruction counter */
+	double instructions;
+};
+
+/*
+ * bench holds everything shared between benchmarks: the rc,
+ * a fully loaded reference db and the week files read into
+ * memory so that parsing can be timed without the I/O
+ */
+struct bench {
+	struct state state;
+	const char *sport;
+	char teams_path[DB_MAX_PATH];
+	struct db *db;
+	unsigned char **week_bufs;
+	size_t *week_lens;
+	const char **week_paths;
+	const char **uuids;
+	const struct algorithm *algo;
+	struct ratings ratings;
+	/* pack - the db's games packed, for decoding */
+	struct game_pack pack;
+	/* margins, chances - the pool bench's input and output */
+	double *margins;
+	double *chances;
+	/* options */
+	unsigned int repeat;
+	unsigned int warmup;
+	bool json;
+	const char *baseline;
+	double time_tolerance;
+	double count_tolerance;
+	/* results */
+	struct result results[BENCH_MAX_RESULTS];
+	unsigned int num_results;
+};
+
+static const char *bench_name = "spreden-bench";
+
+/* perf event counting instructions, or -1 */
+static int instructions_fd = -1;
+
+
+/* timing helpers */
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+/*
+ * count instructions in user space for this thread and every
+ * thread it starts, so the scan and load threads are included
+ */
+static void open_instruction_counter(void)
+{
+	struct perf_event_attr attr;
+	long fd;
+
+	memset(&attr, 0, sizeof(struct perf_event_attr));
+	attr.size = sizeof(struct perf_event_attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.inherit = 1;
+
+	fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+	instructions_fd = (fd < 0) ? -1 : (int)fd;
+}
+
+static long long read_instructions(void)
+{
+	long long count;
+
+	if (instructions_fd < 0 ||
+	    read(instructions_fd, &count, sizeof(count)) != sizeof(count))
+		return -1;
+
+	return count;
+}
+
+/*
+ * allocations made by spreden itself; yajl's internal buffers
+ * (MEM_PARSE) depend on the yajl build and are left out
+ */
+static unsigned long long count_allocs(void)
+{
+	struct mem_stats ms;
+	unsigned long long n = 0;
+	unsigned int i;
+
+	for (i = 0; i < MEM_NUM_TAGS; i++) {
+		if (i == MEM_PARSE)
+			continue;
+		mem_get_stats(i, &ms);
+		n += ms.allocs + ms.reallocs;
+	}
+
+	return n;
+}
+
+static void sample_start(struct sample *s)
+{
+	s->start_allocs = count_allocs();
+	s->start_instructions = read_instructions();
+	s->start_ns = now_ns();
+}
+
+static void sample_stop(struct sample *s)
+{
+	long long instructions;
+
+	s->ns = now_ns() - s->start_ns;
+	instructions = read_instructions();
+	s->allocs = count_allocs() - s->start_allocs;
+
+	if (instructions < 0 || s->start_instructions < 0)
+		s->instructions = -1;
+	else
+		s->instructions = instructions - s->start_instructions;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+	double da = *(const double *)a;
+	double db = *(const double *)b;
+
+	return (da > db) - (da < db);
+}
+
+static double median(double *v, unsigned int n)
+{
+	qsort(v, n, sizeof(double), compare_doubles);
+	return v[n / 2];
+}
+
+static int run_bench(struct bench *b, const char *name, const char *unit,
+		     bench_fn fn, void *arg)
+{
+	double times[BENCH_MAX_RUNS];
+	double allocs[BENCH_MAX_RUNS];
+	double instructions[BENCH_MAX_RUNS];
+	struct sample s;
+	struct result *r;
+	double sum = 0.0;
+	bool counted = true;
+	long ops = 0;
+	unsigned int i;
+
+	if (b->num_results == BENCH_MAX_RESULTS)
+		return -1;
+
+	for (i = 0; i < b->warmup; i++) {
+		if (fn(arg, &s) < 0)
+			return -2;
+	}
+
+	for (i = 0; i < b->repeat; i++) {
+		ops = fn(arg, &s);
+		if (ops < 0)
+			return -3;
+		times[i] = s.ns;
+		allocs[i] = (double)s.allocs;
+		instructions[i] = (double)s.instructions;
+		if (s.instructions < 0)
+			counted = false;
+		sum += times[i];
+	}
+
+	r = &b->results[b->num_results++];
+	r->name = name;
+	r->unit = unit;
+	r->ops = ops;
+	r->runs = b->repeat;
+	r->median_ns = median(times, b->repeat);
+	r->min_ns = times[0];
+	r->mean_ns = sum / b->repeat;
+	r->allocs = median(allocs, b->repeat);
+	r->instructions = counted ?
+		median(instructions, b->repeat) / ops : -1.0;
+
+	return 0;
+}
+
+
+/* benchmarks */
+
+/* a db with its teams parsed and weeks scanned, but no games */
+static struct db *scanned_db(struct bench *b)
+{
+	struct db *db;
+
+	db = db_init(b->sport);
+	if (!db)
+		return NULL;
+
+	if (db_parse_teams(db, b->teams_path) < 0 ||
+	    db_scan(&b->state.rc, &b->state.pool, db) < 0) {
+		db_free(db);
+		return NULL;
+	}
+
+	return db;
+}
+
+static long bench_scan(void *arg, struct sample *s)
+{
+	struct bench *b = arg;
+	struct db *db;
+	long ops;
+
+	db = db_init(b->sport);
+	if (!db)
+		return -1;
+
+	sample_start(s);
+	if (db_scan(&b->state.rc, &b->state.pool, db) < 0) {
+		db_free(db);
+		return -2;
+	}
+	sample_stop(s);
+
+	ops = db->num_weeks;
+	db_free(db);
+	return ops;
+}
+
+static long bench_parse_teams(void *arg, struct sample *s)
+{
+	struct bench *b = arg;
+	struct db *db;
+	long ops;
+
+	db = db_init(b->sport);
+	if (!db)
+		return -1;
+
+	sample_start(s);
+	if (db_parse_teams(db, b->teams_path) < 0) {
+		db_free(db);
+		return -2;
+	}
+	sample_stop(s);
+
+	ops = db->num_teams;
+	db_free(db);
+	return ops;
+}
+
+static long bench_parse_games(void *arg, struct sample *s)
+{
+	struct bench *b = arg;
+	struct db *db;
+	unsigned int w;
+	long ops;
+
+	db = scanned_db(b);
+	if (!db)
+		return -1;
+
+	sample_start(s);
+	for (w = 0; w < db->num_weeks; w++) {
+		if (db_parse_games(db, w, b->week_paths[w], b->week_bufs[w],
+				   b->week_lens[w]) < 0) {
+			db_free(db);
+			return -2;
+		}
+	}
+	sample_stop(s);
+
+	ops = db->num_games;
+	db_free(db);
+	return ops;
+}
+
+static long bench_load_games(void *arg, struct sample *s)
+{
+	struct bench *b = arg;
+	struct db *db;
+	long ops;
+
+	db = scanned_db(b);
+	if (!db)
+		return -1;
+
+	sample_start(s);
+	if (db_load_games(db) < 0) {
+		db_free(db);
+		return -2;
+	}
+	sample_stop(s);
+
+	ops = db->num_games;
+	db_free(db);
+	return ops;
+}
+
+static long bench_h2h(void *arg, struct sample *s)
+{
+	struct bench *b = arg;
+	struct h2h h;
+
+	h2h_init(&h);
+
+	sample_start(s);
+	if (h2h_build(&h, b->db, b->db->num_weeks) < 0)
+		return -1;
+	sample_stop(s);
+
+	h2h_free(&h);
+	return b->db->num_games;
+}
+
+static long bench_pack_build(void *arg, struct sample *s)
+{
+	struct bench *b = arg;
+	struct game_pack p;
+
+	pack_init(&p);
+
+	sample_start(s);
+	if (pack_build(&p, b->db, b->db->num_weeks) < 0)
+		return -1;
+	sample_stop(s);
+
+	pack_free(&p);
+	return b->db->num_games;
+}
+
+static long bench_pack_iter(void *arg, struct sample *s)
+{
+	struct bench *b = arg;
+	struct pack_iter iter;
+	long n = 0;
+
+	sample_start(s);
+	for (pack_iter_begin(&b->pack, 0, b->pack.num_weeks - 1, &iter);
+	     !pack_iter_end(&iter); pack_iter_next(&iter))
+		n++;
+	sample_stop(s);
+
+	return (n == (long)b->db->num_games) ? n : -1;
+}
+
+static long bench_matrix(void *arg, struct sample *s)
+{
+	struct bench *b = arg;
+	struct pair_matrix m;
+
+	if (massey_rate(b->db, b->db->num_weeks - 1, &b->ratings) < 0 ||
+	    matrix_init(&m, b->db->num_teams, false) < 0)
+		return -1;
+
+	sample_start(s);
+	matrix_compute(&m, &b->state.pool, b->db, &b->ratings, 1.0);
+	sample_stop(s);
+
+	matrix_free(&m);
+	return (long)b->db->num_teams * b->db->num_teams;
+}
+
+static long bench_hash_get(void *arg, struct sample *s)
+{
+	struct bench *b = arg;
+	unsigned int i, j;
+	long found = 0;
+
+	sample_start(s);
+	for (i = 0; i < BENCH_HASH_ROUNDS; i++) {
+		for (j = 0; j < b->db->num_teams; j++)
+			found += (hash_get(b->db, b->uuids[j]) >= 0);
+	}
+	sample_stop(s);
+
+	if (found != (long)BENCH_HASH_ROUNDS * b->db->num_teams)
+		return -1;
+
+	return found;
+}
+
+/* common opponent counts for every pair of teams */
+static long bench_common_opponents(void *arg, struct sample *s)
+{
+	struct bench *b = arg;
+	unsigned int n = b->db->num_teams;
+	unsigned int i, j;
+	long total = 0;
+
+	sample_start(s);
+	for (i = 0; i < n; i++) {
+		for (j = i + 1; j < n; j++)
+			total += db_common_opponents(b->db, i, j, NULL);
+	}
+	sample_stop(s);
+
+	if (total < 0)
+		return -1;
+
+	return (long)n * (n - 1) / 2;
+}
+
+static long bench_list(void *arg, struct sample *s)
+{
+	static int data;
+	struct list l;
+	struct list_iter iter;
+	long i, n = 0;
+	(void)arg;
+
+	list_init(&l);
+
+	sample_start(s);
+	for (i = 0; i < BENCH_LIST_ELEMENTS; i++)
+		list_add_back(&l, &data);
+
+	list_iter_begin(&l, &iter);
+	while (!list_iter_end(&iter)) {
+		n += (list_iter_data(&iter) != NULL);
+		list_iter_next(&iter);
+	}
+
+	list_clear(&l);
+	sample_stop(s);
+
+	return (n == BENCH_LIST_ELEMENTS) ? n : -1;
+}
+
+static long bench_vector(void *arg, struct sample *s)
+{
+	static int data;
+	const int *p = &data;
+	struct vector v;
+	long i, n = 0;
+	(void)arg;
+
+	vector_init(&v, sizeof(const int *));
+
+	sample_start(s);
+	for (i = 0; i < BENCH_LIST_ELEMENTS; i++) {
+		if (vector_push_back(&v, &p) < 0)
+			return -1;
+	}
+
+	for (i = 0; i < v.length; i++)
+		n += (VECTOR_AT(&v, const int *, i) != NULL);
+
+	vector_free(&v);
+	sample_stop(s);
+
+	return (n == BENCH_LIST_ELEMENTS) ? n : -1;
+}
+
+/* one piece of the pool bench; the win chance of each margin */
+static void chance_range(void *arg, unsigned int begin, unsigned int end)
+{
+	struct bench *b = arg;
+	unsigned int i;
+
+	for (i = begin; i < end; i++)
+		b->chances[i] = 1.0 / (1.0 + exp(-b->margins[i] / 7.0));
+}
+
+static long bench_pool(void *arg, struct sample *s)
+{
+	struct bench *b = arg;
+	long i, n = 0;
+
+	for (i = 0; i < BENCH_LIST_ELEMENTS; i++)
+		b->chances[i] = -1.0;
+
+	sample_start(s);
+	pool_parallel_for(&b->state.pool, 0, BENCH_LIST_ELEMENTS, 0,
+			  chance_range, b);
+	sample_stop(s);
+
+	for (i = 0; i < BENCH_LIST_ELEMENTS; i++)
+		n += (b->chances[i] >= 0.0);
+
+	return (n == BENCH_LIST_ELEMENTS) ? n : -1;
+}
+
+static long bench_algorithm(void *arg, struct sample *s)
+{
+	struct bench *b = arg;
+	unsigned int last = b->db->num_weeks - 1;
+
+	sample_start(s);
+	if (b->algo->rate(b->db, last, &b->ratings) < 0)
+		return -1;
+	sample_stop(s);
+
+	return b->db->weeks[last].game_end;
+}
+
+
+/* setup */
+
+static int read_file(const char *path, unsigned char **buf, size_t *len)
+{
+	FILE *f;
+	long size;
+
+	f = fopen(path, "rb");
+	if (!f)
+		return -1;
+
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	*buf = malloc(size > 0 ? size : 1);
+	if (!*buf || fread(*buf, 1, size, f) != (size_t)size) {
+		fclose(f);
+		return -2;
+	}
+
+	*len = (size_t)size;
+	fclose(f);
+	return 0;
+}
+
+static int setup(struct bench *b)
+{
+	const struct game *g;
+	struct db *db;
+	unsigned int i;
+
+	b->sport = VECTOR_AT(&b->state.rc.sports, char *, 0);
+	snprintf(b->teams_path, DB_MAX_PATH, "%s/%s/teams.json",
+		 b->state.rc.data_dir, b->sport);
+
+	/* the reference db is loaded the normal way */
+	if (db_load(&b->state) < 0)
+		return -1;
+	db = b->db = b->state.dbs[0];
+
+	if (db->num_weeks == 0 || db->num_teams == 0) {
+		fprintf(stderr, "%s: no data to benchmark\n", bench_name);
+		return -2;
+	}
+
+	b->week_bufs = calloc(db->num_weeks, sizeof(unsigned char *));
+	b->week_lens = calloc(db->num_weeks, sizeof(size_t));
+	b->week_paths = calloc(db->num_weeks, sizeof(const char *));
+	b->uuids = calloc(db->num_teams, sizeof(const char *));
+	b->margins = calloc(BENCH_LIST_ELEMENTS, sizeof(double));
+	b->chances = calloc(BENCH_LIST_ELEMENTS, sizeof(double));
+	if (!b->week_bufs || !b->week_lens || !b->week_paths || !b->uuids ||
+	    !b->margins || !b->chances) {
+		fprintf(stderr, "%s: malloc failed\n", bench_name);
+		return -3;
+	}
+
+	for (i = 0; i < db->game_files.length; i++) {
+		b->week_paths[i] = VECTOR_AT(&db->game_files, const char *, i);
+		if (read_file(b->week_paths[i], &b->week_bufs[i],
+			      &b->week_lens[i]) < 0) {
+			fprintf(stderr, "%s: could not read '%s'\n",
+				bench_name, b->week_paths[i]);
+			return -4;
+		}
+	}
+
+	for (i = 0; i < db->num_teams; i++)
+		b->uuids[i] = intern_str(&db->uuids, i);
+
+	/* the pool bench goes over the home margins again and again */
+	for (i = 0; i < BENCH_LIST_ELEMENTS; i++) {
+		g = &db->games[i % db->num_games];
+		b->margins[i] = g->home_score - g->away_score;
+	}
+
+	pack_init(&b->pack);
+	if (pack_build(&b->pack, db, db->num_weeks) < 0)
+		return -5;
+
+	return 0;
+}
+
+
+/* output */
+
+static long peak_rss_kb(void)
+{
+	struct rusage ru;
+
+	if (getrusage(RUSAGE_SELF, &ru) < 0)
+		return -1;
+
+	/* linux reports ru_maxrss in KiB */
+	return ru.ru_maxrss;
+}
+
+static void print_text(const struct bench *b)
+{
+	const struct result *r;
+	unsigned int i;
+
+	printf("%-22s %8s %6s %12s %12s %10s %12s %14s\n", "benchmark",
+	       "ops", "runs", "ns/op min", "ns/op med", "allocs/run",
+	       "insns/op", "ops/s");
+	for (i = 0; i < b->num_results; i++) {
+		r = &b->results[i];
+		printf("%-22s %8ld %6u %12.1f %12.1f %10.0f ",
+		       r->name, r->ops, r->runs,
+		       r->min_ns / r->ops, r->median_ns / r->ops, r->allocs);
+		if (r->instructions < 0)
+			printf("%12s ", "-");
+		else
+			printf("%12.1f ", r->instructions);
+		printf("%14.0f %s/s\n", r->ops * 1e9 / r->median_ns, r->unit);
+	}
+	printf("peak rss: %ld KiB\n", peak_rss_kb());
+	printf("packed games: %.2f bytes/game (struct game is %zu)\n",
+	       b->db->num_games ? (double)b->pack.num_bytes / b->db->num_games
+				: 0.0, sizeof(struct game));
+}
+
+static void print_json(const struct bench *b)
+{
+	const struct result *r;
+	unsigned int i;
+
+	printf("{\n  \"sport\": \"%s\",\n", b->sport);
+	printf("  \"teams\": %u,\n  \"games\": %u,\n  \"weeks\": %u,\n",
+	       b->db->num_teams, b->db->num_games, b->db->num_weeks);
+	printf("  \"repeat\": %u,\n  \"warmup\": %u,\n", b->repeat, b->warmup);
+	printf("  \"peak_rss_kb\": %ld,\n", peak_rss_kb());
+	printf("  \"benchmarks\": [\n");
+	for (i = 0; i < b->num_results; i++) {
+		r = &b->results[i];
+		printf("    { \"name\": \"%s\", \"unit\": \"%s\", "
+		       "\"ops\": %ld, \"runs\": %u, "
+		       "\"ns_per_op_min\": %.3f, \"ns_per_op_median\": %.3f, "
+		       "\"ns_per_op_mean\": %.3f, \"ops_per_sec\": %.1f, "
+		       "\"allocs_per_run\": %.0f",
+		       r->name, r->unit, r->ops, r->runs,
+		       r->min_ns / r->ops, r->median_ns / r->ops,
+		       r->mean_ns / r->ops, r->ops * 1e9 / r->median_ns,
+		       r->allocs);
+		/* only where the kernel could count them */
+		if (r->instructions >= 0)
+			printf(", \"instructions_per_op\": %.3f", r->instructions);
+		printf(" }%s\n", (i + 1 < b->num_results) ? "," : "");
+	}
+	printf("  ]\n}\n");
+}
+
+
+/* regression checks */
+
+/* print one metric against the baseline; true if it regressed */
+static bool check_metric(const char *name, const char *metric,
+			 double base, double value, double tolerance)
+{
+	double change;
+	const char *status = "ok";
+	bool regressed = false;
+
+	if (base > 0.0)
+		change = (value - base) / base;
+	else
+		change = (value > 0.0) ? INFINITY : 0.0;
+
+	if (change > tolerance) {
+		status = "REGRESSED";
+		regressed = true;
+	} else if (change < -tolerance) {
+		status = "improved";
+	}
+
+	printf("%-22s %-20s %14.1f %14.1f %+8.1f%%  %s\n", name, metric,
+	       base, value, 100.0 * change, status);
+
+	return regressed;
+}
+
+/*
+ * compare every result with the baseline; wall time gets the
+ * loose tolerance, since it depends on the machine and its load,
+ * and the allocation and instruction counts get the strict one
+ *
+ * wall time is compared on the fastest run, which is the least
+ * disturbed by other work on the machine
+ */
+static int check_baseline(const struct bench *b)
+{
+	struct baseline base;
+	const struct baseline_entry *e;
+	const struct result *r;
+	unsigned int i, regressions = 0;
+
+	if (baseline_read(&base, b->baseline) < 0) {
+		fprintf(stderr, "%s: could not read baseline '%s'\n",
+			bench_name, b->baseline);
+		return -1;
+	}
+
+	printf("%-22s %-20s %14s %14s %9s  %s\n", "benchmark", "metric",
+	       "baseline", "current", "change", "status");
+	for (i = 0; i < b->num_results; i++) {
+		r = &b->results[i];
+		e = baseline_find(&base, r->name);
+		if (!e) {
+			printf("%-22s not in baseline\n", r->name);
+			continue;
+		}
+
+		regressions += check_metric(r->name, "ns/op", e->ns_per_op,
+					    r->min_ns / r->ops,
+					    b->time_tolerance);
+		regressions += check_metric(r->name, "allocs/run",
+					    e->allocs_per_run, r->allocs,
+					    b->count_tolerance);
+
+		/* only when both machines could count instructions */
+		if (e->instructions_per_op >= 0.0 && r->instructions >= 0.0)
+			regressions += check_metric(r->name, "instructions/op",
+						    e->instructions_per_op,
+						    r->instructions,
+						    b->count_tolerance);
+		else
+			printf("%-22s %-20s %14s %14s %9s  %s\n", r->name,
+			       "instructions/op", "-", "-", "-", "no counter");
+	}
+
+	if (regressions) {
+		fflush(stdout);
+		fprintf(stderr, "%s: %u metric(s) regressed against '%s'\n",
+			bench_name, regressions, b->baseline);
+		return -2;
+	}
+
+	return 0;
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: %s [options] -- "
+		"[spreden options] <command> <sport> <target week(s)> <algorithms>\n"
+		"    options:\n"
+		"        --repeat N              measured runs (default 10)\n"
+		"        --warmup N              unmeasured runs (default 1)\n"
+		"        --json                  print the results as json\n"
+		"        --baseline FILE         fail on regressions against a --json file\n"
+		"        --time-tolerance F      allowed ns/op increase (default %.2f)\n"
+		"        --count-tolerance F     allowed allocation and instruction count increase (default %.2f)\n",
+		bench_name, BENCH_TIME_TOLERANCE, BENCH_COUNT_TOLERANCE);
+}
+
+static int parse_count(const char *str, unsigned int *out,
+		       unsigned int min, unsigned int max)
+{
+	char *endptr;
+	long n;
+
+	n = strtol(str, &endptr, 10);
+	if (*endptr != '\0' || n < (long)min || n > (long)max) {
+		fprintf(stderr, "%s: '%s' must be a number from %u to %u\n",
+			bench_name, str, min, max);
+		return -1;
+	}
+
+	*out = (unsigned int)n;
+	return 0;
+}
+
+static int parse_tolerance(const char *str, double *out)
+{
+	char *endptr;
+	double t;
+
+	t = strtod(str, &endptr);
+	if (*endptr != '\0' || !(t >= 0.0)) {
+		fprintf(stderr, "%s: '%s' is not a valid tolerance\n",
+			bench_name, str);
+		return -1;
+	}
+
+	*out = t;
+	return 0;
+}
+
+static int parse_options(struct bench *b, int argc, char **argv)
+{
+	static struct option options[] = {
+		{ "repeat",          required_argument, NULL, OPTION_REPEAT },
+		{ "warmup",          required_argument, NULL, OPTION_WARMUP },
+		{ "json",            no_argument,       NULL, OPTION_JSON },
+		{ "baseline",        required_argument, NULL, OPTION_BASELINE },
+		{ "time-tolerance",  required_argument, NULL, OPTION_TIME_TOLERANCE },
+		{ "count-tolerance", required_argument, NULL, OPTION_COUNT_TOLERANCE },
+		{ NULL,              0,                 NULL, 0 }
+	};
+	int c;
+
+	while ((c = getopt_long(argc, argv, "", options, NULL)) != -1) {
+		switch (c) {
+		case OPTION_REPEAT:
+			if (parse_count(optarg, &b->repeat, 1, BENCH_MAX_RUNS) < 0)
+				return -1;
+			break;
+		case OPTION_WARMUP:
+			if (parse_count(optarg, &b->warmup, 0, BENCH_MAX_RUNS) < 0)
+				return -1;
+			break;
+		case OPTION_JSON:
+			b->json = true;
+			break;
+		case OPTION_BASELINE:
+			b->baseline = optarg;
+			break;
+		case OPTION_TIME_TOLERANCE:
+			if (parse_tolerance(optarg, &b->time_tolerance) < 0)
+				return -1;
+			break;
+		case OPTION_COUNT_TOLERANCE:
+			if (parse_tolerance(optarg, &b->count_tolerance) < 0)
+				return -1;
+			break;
+		default:
+			return -1;
+		}
+	}
+
+	return optind;
+}
+
+int main(int argc, char **argv)
+{
+	struct bench *b;
+	const struct algorithm *algo;
+	int rest;
+	unsigned int i;
+
+	bench_name = argv[0];
+
+	b = calloc(1, sizeof(struct bench));
+	if (!b) {
+		fprintf(stderr, "%s: malloc failed\n", bench_name);
+		return EXIT_FAILURE;
+	}
+
+	b->repeat = 10;
+	b->warmup = 1;
+	b->time_tolerance = BENCH_TIME_TOLERANCE;
+	b->count_tolerance = BENCH_COUNT_TOLERANCE;
+
+	rest = parse_options(b, argc, argv);
+	if (rest < 0 || rest >= argc) {
+		usage();
+		return EXIT_FAILURE;
+	}
+
+	/* the rest is a normal spreden command line */
+	argv[rest - 1] = argv[0];
+	optind = 0;
+	if (rc_read_options(&b->state, argc - rest + 1, argv + rest - 1) < 0)
+		return EXIT_FAILURE;
+
+	if (b->state.rc.sports.length == 0) {
+		usage();
+		return EXIT_FAILURE;
+	}
+
+	if (pool_init(&b->state.pool, b->state.rc.threads, NULL) < 0) {
+		fprintf(stderr, "%s: could not start threads\n", bench_name);
+		return EXIT_FAILURE;
+	}
+
+	if (setup(b) < 0)
+		return EXIT_FAILURE;
+
+	open_instruction_counter();
+
+	if (run_bench(b, "db_scan", "week", bench_scan, b) < 0 ||
+	    run_bench(b, "db_parse_teams", "team", bench_parse_teams, b) < 0 ||
+	    run_bench(b, "db_parse_games", "game", bench_parse_games, b) < 0 ||
+	    run_bench(b, "db_load_games", "game", bench_load_games, b) < 0 ||
+	    run_bench(b, "h2h_build", "game", bench_h2h, b) < 0 ||
+	    run_bench(b, "pack_build", "game", bench_pack_build, b) < 0 ||
+	    run_bench(b, "pack_iter", "game", bench_pack_iter, b) < 0 ||
+	    run_bench(b, "hash_get", "lookup", bench_hash_get, b) < 0 ||
+	    run_bench(b, "common_opponents", "pair",
+		      bench_common_opponents, b) < 0 ||
+	    run_bench(b, "list", "element", bench_list, b) < 0 ||
+	    run_bench(b, "vector", "element", bench_vector, b) < 0 ||
+	    run_bench(b, "pool", "element", bench_pool, b) < 0 ||
+	    run_bench(b, "pair_matrix", "cell", bench_matrix, b) < 0) {
+		fprintf(stderr, "%s: benchmark failed\n", bench_name);
+		return EXIT_FAILURE;
+	}
+
+	for (i = 0; (algo = algo_builtin(i)); i++) {
+		b->algo = algo;
+		if (run_bench(b, algo->name, "game", bench_algorithm, b) < 0) {
+			fprintf(stderr, "%s: benchmark '%s' failed\n",
+				bench_name, algo->name);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (b->baseline)
+		return (check_baseline(b) < 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+
+	if (b->json)
+		print_json(b);
+	else
+		print_text(b);
+
+	return EXIT_SUCCESS;
+}
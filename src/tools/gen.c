@@ -0,0 +1,423 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <math.h>
+
+#include <getopt.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "../spreden.h"
+#include "../database/database.h"
+
+/*
+ * spreden-gen writes a synthetic data_dir tree:
+ *
+ *   <dir>/<sport>/teams.json
+ *   <dir>/<sport>/<year>/weekNN.json
+ *
+ * each team gets a hidden strength and the scores are drawn
+ * around the strength difference plus a home advantage, so
+ * the rating algorithms have something real to find
+ */
+
+#define GEN_HOME_ADV      3.0
+#define GEN_STRENGTH_SD   7.0
+#define GEN_MARGIN_SD    13.0
+#define GEN_MEAN_SCORE   24.0
+
+enum options {
+	OPTION_TEAMS = 1,
+	OPTION_SEASONS,
+	OPTION_FIRST_YEAR,
+	OPTION_WEEKS,
+	OPTION_GAMES,
+	OPTION_NEUTRAL,
+	OPTION_SEED,
+	OPTION_SPORT
+};
+
+struct gen {
+	const char *dir;
+	const char *sport;
+	unsigned int teams;
+	unsigned int seasons;
+	unsigned int first_year;
+	unsigned int weeks;
+	unsigned int games;
+	double neutral;
+	uint64_t seed;
+	/* state */
+	uint64_t rng;
+	char (*uuids)[UUID_LENGTH+1];
+	double *strength;
+	unsigned int *order;
+};
+
+static const char *gen_name = "spreden-gen";
+
+
+/* random numbers */
+
+/* splitmix64 */
+static uint64_t next_u64(struct gen *g)
+{
+	uint64_t z = (g->rng += 0x9e3779b97f4a7c15ULL);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+static double next_uniform(struct gen *g)
+{
+	return (next_u64(g) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double next_normal(struct gen *g)
+{
+	double u1, u2;
+
+	do {
+		u1 = next_uniform(g);
+	} while (u1 <= 0.0);
+	u2 = next_uniform(g);
+
+	return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+static unsigned int next_below(struct gen *g, unsigned int n)
+{
+	return (unsigned int)(next_u64(g) % n);
+}
+
+/* a version 4 uuid from the generator so the output is repeatable */
+static void next_uuid(struct gen *g, char *out)
+{
+	uint64_t hi = next_u64(g), lo = next_u64(g);
+
+	hi = (hi & ~0xf000ULL) | 0x4000ULL;
+	lo = (lo & ~(0x3ULL << 62)) | (0x2ULL << 62);
+
+	sprintf(out, "%08x-%04x-%04x-%04x-%012llx",
+		(unsigned int)(hi >> 32),
+		(unsigned int)((hi >> 16) & 0xffff),
+		(unsigned int)(hi & 0xffff),
+		(unsigned int)(lo >> 48),
+		(unsigned long long)(lo & 0xffffffffffffULL));
+}
+
+
+/* output */
+
+/* snprintf() put n chars of a path in path; fail if it was cut short */
+static int check_path(int n, const char *path)
+{
+	if (n < 0 || n >= DB_MAX_PATH) {
+		fprintf(stderr, "%s: path too long: '%s...'\n", gen_name, path);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int make_dir(const char *path)
+{
+	if (mkdir(path, 0755) < 0 && errno != EEXIST) {
+		fprintf(stderr, "%s: could not create '%s': %s\n",
+			gen_name, path, strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+static int write_teams(struct gen *g)
+{
+	char path[DB_MAX_PATH];
+	FILE *f;
+	unsigned int i;
+
+	if (check_path(snprintf(path, DB_MAX_PATH, "%s/%s/teams.json",
+				g->dir, g->sport), path) < 0)
+		return -1;
+
+	f = fopen(path, "w");
+	if (!f) {
+		fprintf(stderr, "%s: could not open '%s' for writing: %s\n",
+			gen_name, path, strerror(errno));
+		return -1;
+	}
+
+	fputs("[\n", f);
+	for (i = 0; i < g->teams; i++) {
+		next_uuid(g, g->uuids[i]);
+		g->strength[i] = GEN_STRENGTH_SD * next_normal(g);
+		fprintf(f, "  { \"name\": \"Team %u\", \"uuid\": \"%s\" }%s\n",
+			i + 1, g->uuids[i], (i + 1 < g->teams) ? "," : "");
+	}
+	fputs("]\n", f);
+
+	if (fclose(f) != 0) {
+		fprintf(stderr, "%s: error writing '%s'\n", gen_name, path);
+		return -2;
+	}
+
+	return 0;
+}
+
+static int score(double points)
+{
+	return (points < 0.0) ? 0 : (int)lround(points);
+}
+
+/*
+ * pair teams off from a shuffled order so that nobody plays
+ * twice in a week until every team has played once
+ */
+static void pick_teams(struct gen *g, unsigned int game,
+		       unsigned int *home, unsigned int *away)
+{
+	unsigned int per_round = g->teams / 2;
+	unsigned int slot = game % per_round;
+	unsigned int i, j, t;
+
+	/* reshuffle at the start of every round */
+	if (slot == 0) {
+		for (i = g->teams - 1; i > 0; i--) {
+			j = next_below(g, i + 1);
+			t = g->order[i];
+			g->order[i] = g->order[j];
+			g->order[j] = t;
+		}
+	}
+
+	*home = g->order[2 * slot];
+	*away = g->order[2 * slot + 1];
+}
+
+static int write_week(struct gen *g, const char *year_dir, unsigned int week)
+{
+	char path[DB_MAX_PATH];
+	unsigned int i, home, away;
+	double margin, total;
+	int neutral;
+	FILE *f;
+
+	if (check_path(snprintf(path, DB_MAX_PATH, "%s/week%02u.json",
+				year_dir, week), path) < 0)
+		return -1;
+
+	f = fopen(path, "w");
+	if (!f) {
+		fprintf(stderr, "%s: could not open '%s' for writing: %s\n",
+			gen_name, path, strerror(errno));
+		return -1;
+	}
+
+	fputs("[\n", f);
+	for (i = 0; i < g->games; i++) {
+		pick_teams(g, i, &home, &away);
+		neutral = next_uniform(g) < g->neutral;
+
+		margin = g->strength[home] - g->strength[away] +
+			(neutral ? 0.0 : GEN_HOME_ADV) +
+			GEN_MARGIN_SD * next_normal(g);
+		total = 2.0 * GEN_MEAN_SCORE + 10.0 * next_normal(g);
+
+		fprintf(f, "  { \"home\": \"%s\", \"home_score\": %d, "
+			"\"away\": \"%s\", \"away_score\": %d, "
+			"\"neutral\": %s }%s\n",
+			g->uuids[home], score((total + margin) / 2.0),
+			g->uuids[away], score((total - margin) / 2.0),
+			neutral ? "true" : "false",
+			(i + 1 < g->games) ? "," : "");
+	}
+	fputs("]\n", f);
+
+	if (fclose(f) != 0) {
+		fprintf(stderr, "%s: error writing '%s'\n", gen_name, path);
+		return -2;
+	}
+
+	return 0;
+}
+
+static int generate(struct gen *g)
+{
+	char path[DB_MAX_PATH];
+	unsigned int s, w;
+
+	g->rng = g->seed;
+	g->uuids = calloc(g->teams, sizeof(*g->uuids));
+	g->strength = calloc(g->teams, sizeof(double));
+	g->order = calloc(g->teams, sizeof(unsigned int));
+	if (!g->uuids || !g->strength || !g->order) {
+		fprintf(stderr, "%s: malloc failed\n", gen_name);
+		return -1;
+	}
+
+	for (s = 0; s < g->teams; s++)
+		g->order[s] = s;
+
+	if (check_path(snprintf(path, DB_MAX_PATH, "%s/%s", g->dir, g->sport),
+		       path) < 0 ||
+	    make_dir(g->dir) < 0 || make_dir(path) < 0)
+		return -2;
+
+	if (write_teams(g) < 0)
+		return -3;
+
+	for (s = 0; s < g->seasons; s++) {
+		if (check_path(snprintf(path, DB_MAX_PATH, "%s/%s/%u",
+					g->dir, g->sport, g->first_year + s),
+			       path) < 0 ||
+		    make_dir(path) < 0)
+			return -4;
+
+		/* strengths drift a little between seasons */
+		for (w = 0; w < g->teams; w++)
+			g->strength[w] = 0.8 * g->strength[w] +
+				0.6 * GEN_STRENGTH_SD * next_normal(g);
+
+		for (w = 1; w <= g->weeks; w++) {
+			if (write_week(g, path, w) < 0)
+				return -5;
+		}
+	}
+
+	return 0;
+}
+
+
+/* command line */
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: %s [options] <data dir>\n"
+		"    options:\n"
+		"        --sport NAME        sport directory name (default ncaaf)\n"
+		"        --teams N           number of teams (default 128)\n"
+		"        --seasons N         number of seasons (default 10)\n"
+		"        --first-year YEAR   first season (default 2000)\n"
+		"        --weeks N           weeks per season (default 15)\n"
+		"        --games N           games per week (default teams/2)\n"
+		"        --neutral RATE      fraction of neutral site games (default 0.05)\n"
+		"        --seed N            random seed (default 1)\n",
+		gen_name);
+}
+
+static int parse_uint(const char *str, unsigned int *out, unsigned int min)
+{
+	char *endptr;
+	unsigned long n;
+
+	n = strtoul(str, &endptr, 10);
+	if (*endptr != '\0' || n < min || n > SHRT_MAX) {
+		fprintf(stderr, "%s: '%s' must be a number from %u to %d\n",
+			gen_name, str, min, SHRT_MAX);
+		return -1;
+	}
+
+	*out = (unsigned int)n;
+	return 0;
+}
+
+static int parse_options(struct gen *g, int argc, char **argv)
+{
+	static struct option options[] = {
+		{ "teams",      required_argument, NULL, OPTION_TEAMS },
+		{ "seasons",    required_argument, NULL, OPTION_SEASONS },
+		{ "first-year", required_argument, NULL, OPTION_FIRST_YEAR },
+		{ "weeks",      required_argument, NULL, OPTION_WEEKS },
+		{ "games",      required_argument, NULL, OPTION_GAMES },
+		{ "neutral",    required_argument, NULL, OPTION_NEUTRAL },
+		{ "seed",       required_argument, NULL, OPTION_SEED },
+		{ "sport",      required_argument, NULL, OPTION_SPORT },
+		{ NULL,         0,                 NULL, 0 }
+	};
+	char *endptr;
+	int c, err = 0;
+
+	while ((c = getopt_long(argc, argv, "", options, NULL)) != -1) {
+		switch (c) {
+		case OPTION_TEAMS:
+			err = parse_uint(optarg, &g->teams, 2);
+			break;
+		case OPTION_SEASONS:
+			err = parse_uint(optarg, &g->seasons, 1);
+			break;
+		case OPTION_FIRST_YEAR:
+			err = parse_uint(optarg, &g->first_year, 0);
+			break;
+		case OPTION_WEEKS:
+			err = parse_uint(optarg, &g->weeks, 1);
+			break;
+		case OPTION_GAMES:
+			err = parse_uint(optarg, &g->games, 0);
+			break;
+		case OPTION_NEUTRAL:
+			g->neutral = strtod(optarg, &endptr);
+			if (*endptr != '\0' || g->neutral < 0.0 || g->neutral > 1.0) {
+				fprintf(stderr, "%s: neutral rate must be from 0 to 1\n",
+					gen_name);
+				err = -1;
+			}
+			break;
+		case OPTION_SEED:
+			g->seed = strtoull(optarg, &endptr, 10);
+			if (*endptr != '\0') {
+				fprintf(stderr, "%s: '%s' is not a valid seed\n",
+					gen_name, optarg);
+				err = -1;
+			}
+			break;
+		case OPTION_SPORT:
+			g->sport = optarg;
+			break;
+		default:
+			err = -1;
+			break;
+		}
+
+		if (err)
+			return -1;
+	}
+
+	return optind;
+}
+
+int main(int argc, char **argv)
+{
+	struct gen g;
+	int rest;
+
+	gen_name = argv[0];
+
+	memset(&g, 0, sizeof(struct gen));
+	g.sport = "ncaaf";
+	g.teams = 128;
+	g.seasons = 10;
+	g.first_year = 2000;
+	g.weeks = 15;
+	g.neutral = 0.05;
+	g.seed = 1;
+
+	rest = parse_options(&g, argc, argv);
+	if (rest < 0 || argc - rest != 1) {
+		usage();
+		return EXIT_FAILURE;
+	}
+	g.dir = argv[rest];
+
+	if (g.games == 0)
+		g.games = g.teams / 2;
+
+	if (generate(&g) < 0)
+		return EXIT_FAILURE;
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "fixture.h"
+
+/*
+ * every test is run as test-NAME <data dir>, where the data dir
+ * holds the data set made by spreden-gen for the test fixture
+ */
+
+static unsigned int failures;
+
+
+/* api functions */
+
+/* load the fixture's db the way spreden rank would */
+struct db *fixture_load(struct state *s, int argc, char **argv)
+{
+	char *args[] = {
+		argv[0], "--data", NULL, "--threads", "1",
+		"rank", FIXTURE_SPORT, FIXTURE_YEARS, "massey"
+	};
+
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s <data dir>\n", argv[0]);
+		return NULL;
+	}
+	args[2] = argv[1];
+
+	memset(s, 0, sizeof(struct state));
+	if (rc_read_options(s, sizeof(args) / sizeof(args[0]), args) < 0)
+		return NULL;
+
+	if (pool_init(&s->pool, s->rc.threads, NULL) < 0) {
+		fprintf(stderr, "%s: could not start threads\n", progname);
+		return NULL;
+	}
+
+	if (db_load(s) < 0)
+		return NULL;
+
+	if (s->dbs[0]->num_weeks < 2 || s->dbs[0]->num_games == 0) {
+		fprintf(stderr, "%s: no data in '%s'\n", progname, argv[1]);
+		return NULL;
+	}
+
+	return s->dbs[0];
+}
+
+void fixture_check(bool ok, const char *what, const char *file, int line)
+{
+	if (ok)
+		return;
+
+	fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what);
+	failures++;
+}
+
+/* a and b agree to tolerance, relative to the larger of them and 1 */
+bool fixture_close(double a, double b, double tolerance)
+{
+	double scale = fmax(1.0, fmax(fabs(a), fabs(b)));
+
+	return fabs(a - b) <= tolerance * scale;
+}
+
+/* a and b are the same game */
+bool fixture_same_game(const struct game *a, const struct game *b)
+{
+	return a->home_team == b->home_team && a->away_team == b->away_team &&
+	       a->home_score == b->home_score &&
+	       a->away_score == b->away_score && a->neutral == b->neutral;
+}
+
+/* the exit status of a test */
+int fixture_done(void)
+{
+	if (failures) {
+		fprintf(stderr, "%s: %u checks failed\n", progname, failures);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,24 @@
+#ifndef FIXTURE_H
+#define FIXTURE_H
+
+#include <stdbool.h>
+
+#include "../src/spreden.h"
+#include "../src/database/database.h"
+
+/* sport and seasons of the data set the tests are run on */
+#define FIXTURE_SPORT  "nfl"
+#define FIXTURE_YEARS  "2010-2012"
+
+/* record a failure unless cond holds */
+#define CHECK(cond) fixture_check((cond), #cond, __FILE__, __LINE__)
+
+/* fixture.c */
+extern struct db *fixture_load(struct state *s, int argc, char **argv);
+extern void fixture_check(bool ok, const char *what, const char *file,
+			  int line);
+extern bool fixture_close(double a, double b, double tolerance);
+extern bool fixture_same_game(const struct game *a, const struct game *b);
+extern int fixture_done(void);
+
+#endif
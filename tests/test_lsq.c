@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fixture.h"
+#include "../src/algorithms/algorithms.h"
+
+/*
+ * least squares updates: adding, removing and changing games one
+ * at a time against a full solve of the games they leave, a
+ * window of weeks walked forward against a rebuild of the weeks
+ * in it, and massey through an overlay with more changes than
+ * unknowns
+ */
+
+/* agreement between an updated solution and a full solve */
+#define LSQ_TEST_TOLERANCE  1e-7
+
+
+/* helper functions */
+
+/* a full solve of games [0, n) with games[changed] replaced by g */
+static void solve_games(struct lsq *l, const struct db *db, unsigned int n,
+			int changed, const struct game *g)
+{
+	unsigned int i;
+
+	lsq_reset(l);
+	for (i = 0; i < n; i++)
+		lsq_accumulate(l, (int)i == changed ? g : &db->games[i], 1.0);
+	CHECK(lsq_solve(l) == 0);
+}
+
+/* a full solve of the weeks in win, each weighted decay^age */
+static void solve_window(struct lsq *l, const struct db *db,
+			 const struct lsq_window *win)
+{
+	double weight = 1.0;
+	unsigned int w;
+	int k;
+
+	lsq_reset(l);
+	for (w = win->end; w-- > win->begin;) {
+		for (k = db->weeks[w].game_begin; k < db->weeks[w].game_end; k++)
+			lsq_accumulate(l, &db->games[k], weight);
+		weight *= win->decay;
+	}
+	CHECK(lsq_solve(l) == 0);
+}
+
+static void check_same(const struct lsq *got, const struct lsq *want,
+		       const char *what)
+{
+	unsigned int i, n = 0;
+
+	for (i = 0; i < got->dim; i++)
+		n += !fixture_close(got->x[i], want->x[i], LSQ_TEST_TOLERANCE);
+
+	if (n)
+		fprintf(stderr, "%s: %s differs in %u unknowns\n", progname,
+			what, n);
+	CHECK(n == 0);
+}
+
+
+/* tests */
+
+static void test_add(const struct db *db, struct lsq *l, struct lsq *full)
+{
+	const unsigned int half = db->num_games / 2;
+	unsigned int i;
+
+	solve_games(l, db, half, -1, NULL);
+	for (i = half; i < db->num_games; i++)
+		CHECK(lsq_add(l, &db->games[i], 1.0) == 0);
+	CHECK(l->rank_one_updates > 0);
+
+	solve_games(full, db, db->num_games, -1, NULL);
+	check_same(l, full, "lsq_add");
+}
+
+static void test_remove(const struct db *db, struct lsq *l, struct lsq *full)
+{
+	const unsigned int keep = db->num_games - db->num_games / 4;
+	unsigned int i;
+
+	solve_games(l, db, db->num_games, -1, NULL);
+	for (i = db->num_games; i-- > keep;)
+		CHECK(lsq_remove(l, &db->games[i], 1.0) == 0);
+
+	solve_games(full, db, keep, -1, NULL);
+	check_same(l, full, "lsq_remove");
+}
+
+static void test_modify(const struct db *db, struct lsq *l, struct lsq *full)
+{
+	const unsigned int k = db->num_games / 3;
+	struct game g = db->games[k];
+	struct game swapped;
+
+	/* a new score only moves the solution */
+	solve_games(l, db, db->num_games, -1, NULL);
+	g.home_score += 28;
+	CHECK(lsq_modify(l, &db->games[k], &g, 1.0) == 0);
+	CHECK(lsq_refresh(l) == 0);
+	solve_games(full, db, db->num_games, k, &g);
+	check_same(l, full, "lsq_modify score");
+
+	/* the same game with the teams the other way round */
+	swapped = g;
+	swapped.home_team = g.away_team;
+	swapped.away_team = g.home_team;
+	CHECK(lsq_modify(l, &g, &swapped, 1.0) == 0);
+	solve_games(full, db, db->num_games, k, &swapped);
+	check_same(l, full, "lsq_modify teams");
+}
+
+static void test_refresh(const struct db *db, struct lsq *l)
+{
+	unsigned int i;
+
+	/* an unsolved system gets a full solve */
+	lsq_reset(l);
+	for (i = 0; i < db->num_games / 2; i++)
+		lsq_accumulate(l, &db->games[i], 1.0);
+	CHECK(lsq_refresh(l) == 0);
+	CHECK(l->solved);
+
+	for (; i < db->num_games; i++)
+		CHECK(lsq_add(l, &db->games[i], 1.0) == 0);
+	CHECK(lsq_refresh(l) == 0);
+	CHECK(lsq_residual(l) <= l->tolerance);
+}
+
+/*
+ * weeks pushed through a window, scaled, added and dropped in
+ * place, against the system rebuilt each week; a window with no
+ * size or decay only adds, by rank-one updates
+ */
+static void test_window(const struct db *db, struct lsq *full,
+			unsigned int size, double decay)
+{
+	struct lsq_window win;
+	struct ratings r;
+	char what[64];
+	unsigned int w;
+
+	if (window_init(&win, db->num_teams, size, decay) < 0) {
+		CHECK(false);
+		return;
+	}
+
+	snprintf(what, sizeof(what), "window of %u weeks, decay %g", size,
+		 decay);
+	for (w = 0; w < db->num_weeks; w++) {
+		CHECK(window_push(&win, db, w) == 0);
+		CHECK(win.end == w + 1);
+		CHECK(!size || win.end - win.begin <= size);
+		if (w < db->num_weeks / 4)
+			continue;
+
+		CHECK(window_ratings(&win, &r) == 0);
+		solve_window(full, db, &win);
+		check_same(&win.lsq, full, what);
+	}
+	if (!size && decay == 1.0)
+		CHECK(win.lsq.rank_one_updates > 0);
+
+	window_free(&win);
+}
+
+/* more what-if games than unknowns, so massey builds the system anew */
+static void test_many_changes(const struct db *db, struct lsq *full)
+{
+	const unsigned int last = db->num_weeks - 1;
+	struct overlay_iter iter;
+	struct db_overlay o;
+	struct ratings r;
+	struct game g;
+	unsigned int i, n = 0;
+
+	overlay_init(&o, db);
+	for (i = 0; i < 2 * db->num_teams; i++) {
+		g = db->games[i];
+		g.home_score = g.away_score + 3;
+		CHECK(overlay_add_game(&o, last, &g) == 0);
+		CHECK(overlay_set_score(&o, i, 0, (int)i % 17) == 0);
+	}
+
+	CHECK(massey_rate_overlay(&o, last, last, &r) == 0);
+
+	lsq_reset(full);
+	for (overlay_iter_begin(&o, 0, last, &iter); !overlay_iter_end(&iter);
+	     overlay_iter_next(&iter))
+		lsq_accumulate(full, overlay_iter_data(&iter), 1.0);
+	CHECK(lsq_solve(full) == 0);
+
+	for (i = 0; i < db->num_teams; i++)
+		n += !fixture_close(r.team[i], full->x[i], LSQ_TEST_TOLERANCE);
+	n += !fixture_close(r.home_adv, full->x[db->num_teams],
+			    LSQ_TEST_TOLERANCE);
+	CHECK(n == 0);
+
+	overlay_free(&o);
+}
+
+
+int main(int argc, char **argv)
+{
+	struct state s;
+	struct lsq l, full;
+	struct db *db;
+
+	if (!(db = fixture_load(&s, argc, argv)))
+		return EXIT_FAILURE;
+
+	if (lsq_init(&l, db->num_teams) < 0 ||
+	    lsq_init(&full, db->num_teams) < 0)
+		return EXIT_FAILURE;
+
+	test_add(db, &l, &full);
+	test_remove(db, &l, &full);
+	test_modify(db, &l, &full);
+	test_refresh(db, &l);
+	test_window(db, &full, 4, 0.9);
+	test_window(db, &full, 0, 0.9);
+	test_window(db, &full, 0, 1.0);
+	test_many_changes(db, &full);
+
+	lsq_free(&l);
+	lsq_free(&full);
+	pool_destroy(&s.pool);
+	return fixture_done();
+}
@@ -0,0 +1,314 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fixture.h"
+#include "../src/algorithms/algorithms.h"
+
+/*
+ * overlays: iterating the plain db, iterating with added games
+ * and new scores, reading a what-if file, and every algorithm
+ * that rates through an overlay against the same algorithm on
+ * a copy of the db with the changes made in it
+ */
+
+
+/* helper functions */
+
+/* put g at the end of week w of db, as if it had been played */
+static void insert_game(struct db *db, unsigned int w, const struct game *g)
+{
+	const unsigned int end = db->weeks[w].game_end;
+	unsigned int i;
+
+	memmove(&db->games[end + 1], &db->games[end],
+		(db->num_games - end) * sizeof(struct game));
+	db->games[end] = *g;
+	db->num_games++;
+
+	db->weeks[w].game_end++;
+	for (i = w + 1; i < db->num_weeks; i++) {
+		db->weeks[i].game_begin++;
+		db->weeks[i].game_end++;
+	}
+}
+
+/* the overlay's games of weeks first..last match db's exactly */
+static void check_iter(const struct db_overlay *o, const struct db *db,
+		       unsigned int first, unsigned int last)
+{
+	struct overlay_iter iter;
+	int k = db->weeks[first].game_begin;
+
+	for (overlay_iter_begin(o, first, last, &iter); !overlay_iter_end(&iter);
+	     overlay_iter_next(&iter)) {
+		CHECK(k < db->weeks[last].game_end);
+		if (k >= db->weeks[last].game_end)
+			return;
+		CHECK(fixture_same_game(overlay_iter_data(&iter),
+					&db->games[k]));
+		k++;
+	}
+
+	CHECK(overlay_iter_data(&iter) == NULL);
+	CHECK(k == db->weeks[last].game_end);
+}
+
+/* a home and away team that did not play each other in week w */
+static void unplayed_pair(const struct db *db, unsigned int w, int *home,
+			  int *away)
+{
+	int k;
+
+	for (*home = 0, *away = 1;; (*away)++) {
+		for (k = db->weeks[w].game_begin; k < db->weeks[w].game_end; k++) {
+			if (db->games[k].home_team == *home &&
+			    db->games[k].away_team == *away)
+				break;
+		}
+		if (k == db->weeks[w].game_end)
+			return;
+	}
+}
+
+static struct game make_game(int home, int away, int home_score,
+			     int away_score, bool neutral)
+{
+	struct game g;
+
+	g.home_team = home;
+	g.away_team = away;
+	g.home_score = home_score;
+	g.away_score = away_score;
+	g.neutral = neutral;
+
+	return g;
+}
+
+/*
+ * make the same changes in o and in copy: games added to a few
+ * weeks, one of them twice, and new scores for two played games
+ */
+static void make_changes(struct db_overlay *o, struct db *copy)
+{
+	const unsigned int last = copy->num_weeks - 1;
+	const struct game added[] = {
+		make_game(0, 1, 35, 0, false),
+		make_game(2, 3, 10, 13, true),
+		make_game(4, 5, 21, 20, false),
+		make_game(1, 6, 0, 7, false)
+	};
+	const unsigned int weeks[] = { 1, 0, 1, last };
+	unsigned int i, k;
+
+	/* added out of week order, to check they are kept sorted */
+	for (i = 0; i < sizeof(weeks) / sizeof(weeks[0]); i++) {
+		CHECK(overlay_add_game(o, weeks[i], &added[i]) == 0);
+		insert_game(copy, weeks[i], &added[i]);
+	}
+
+	/* the first game of week 1 and the last game before the end */
+	k = o->base->weeks[1].game_begin;
+	CHECK(overlay_set_score(o, k, 0, 42) == 0);
+	CHECK(overlay_set_score(o, k, 3, 42) == 0);
+	copy->games[copy->weeks[1].game_begin].home_score = 3;
+	copy->games[copy->weeks[1].game_begin].away_score = 42;
+
+	k = o->base->weeks[last].game_begin - 1;
+	CHECK(overlay_set_score(o, k, 17, 17) == 0);
+	copy->games[copy->weeks[last].game_begin - 1].home_score = 17;
+	copy->games[copy->weeks[last].game_begin - 1].away_score = 17;
+
+	/* bad changes leave the overlay alone */
+	CHECK(overlay_add_game(o, copy->num_weeks, &added[0]) < 0);
+	CHECK(overlay_set_score(o, o->base->num_games, 1, 0) < 0);
+}
+
+
+/* tests */
+
+static void test_plain(const struct db *db)
+{
+	struct db_overlay o;
+	struct game g;
+	unsigned int i;
+
+	overlay_init(&o, db);
+	CHECK(overlay_num_games(&o) == db->num_games);
+
+	check_iter(&o, db, 0, db->num_weeks - 1);
+	check_iter(&o, db, 1, 1);
+	check_iter(&o, db, 1, db->num_weeks - 2);
+
+	for (i = 0; i < db->num_games; i++) {
+		overlay_get_game(&o, i, &g);
+		CHECK(fixture_same_game(&g, &db->games[i]));
+	}
+
+	overlay_free(&o);
+}
+
+static void test_changes(const struct db *db, struct db *copy)
+{
+	struct db_overlay o;
+	unsigned int w;
+
+	memcpy(copy, db, sizeof(struct db));
+	overlay_init(&o, db);
+	make_changes(&o, copy);
+
+	CHECK(o.num_games == 4);
+	CHECK(o.num_overrides == 2);
+	CHECK(overlay_num_games(&o) == copy->num_games);
+
+	check_iter(&o, copy, 0, copy->num_weeks - 1);
+	for (w = 0; w < copy->num_weeks; w++)
+		check_iter(&o, copy, w, w);
+	check_iter(&o, copy, 1, copy->num_weeks - 1);
+
+	/* clearing keeps the memory but drops the changes */
+	overlay_clear(&o);
+	check_iter(&o, db, 0, db->num_weeks - 1);
+
+	overlay_free(&o);
+}
+
+static void test_read(const struct db *db, const char *dir)
+{
+	const struct week *week = &db->weeks[2];
+	const struct game *played = &db->games[week->game_begin];
+	char path[DB_MAX_PATH];
+	struct db_overlay o;
+	FILE *stream;
+	int home, away;
+
+	unplayed_pair(db, 2, &home, &away);
+	snprintf(path, sizeof(path), "%s/what-if.csv", dir);
+	stream = fopen(path, "w");
+	CHECK(stream != NULL);
+	if (!stream)
+		return;
+
+	fprintf(stream, "# a played game's new score, then a new game\n");
+	fprintf(stream, "%s,%d,%d,%s,%s,%d,%d\n", db->sport, week->id.year,
+		week->id.week, db_team_name(db, played->home_team),
+		db_team_name(db, played->away_team), 99, 0);
+	fprintf(stream, "%s,%d,%d,%s,%s,%d,%d,1\n\n", db->sport, week->id.year,
+		week->id.week, db_team_name(db, home), db_team_name(db, away),
+		14, 21);
+	fprintf(stream, "other,%d,%d,nobody,no one,1,0\n", week->id.year,
+		week->id.week);
+	fprintf(stream, "%s,1900,1,%s,%s,1,0\n", db->sport,
+		db_team_name(db, home), db_team_name(db, away));
+	fclose(stream);
+
+	overlay_init(&o, db);
+	CHECK(overlay_read(&o, path) == 0);
+	CHECK(o.num_overrides == 1);
+	CHECK(o.num_games == 1);
+	if (o.num_overrides == 1 && o.num_games == 1) {
+		CHECK(o.overrides[0].game == (unsigned int)week->game_begin);
+		CHECK(o.overrides[0].home_score == 99);
+		CHECK(o.games[0].home_team == home);
+		CHECK(o.games[0].away_team == away);
+		CHECK(o.games[0].neutral);
+		CHECK(o.game_weeks[0] == 2);
+	}
+	overlay_free(&o);
+
+	/* a team the db does not have, then a line that is not a game */
+	stream = fopen(path, "w");
+	fprintf(stream, "%s,%d,%d,nobody,%s,1,0\n", db->sport, week->id.year,
+		week->id.week, db_team_name(db, 0));
+	fclose(stream);
+	overlay_init(&o, db);
+	CHECK(overlay_read(&o, path) < 0);
+	overlay_free(&o);
+
+	stream = fopen(path, "w");
+	fprintf(stream, "%s,%d,x\n", db->sport, week->id.year);
+	fclose(stream);
+	overlay_init(&o, db);
+	CHECK(overlay_read(&o, path) < 0);
+	overlay_free(&o);
+
+	remove(path);
+}
+
+/*
+ * every algorithm that rates through an overlay, with and
+ * without changes, against rating a db that has them
+ */
+static void test_rate(struct state *s, const struct db *db, struct db *copy)
+{
+	const unsigned int first = 1, last = db->num_weeks - 1;
+	const struct algorithm *algo;
+	struct ratings *got, *want;
+	struct db_overlay o;
+	unsigned int i, n, w, t;
+
+	got = malloc((last - first + 1) * sizeof(struct ratings));
+	want = malloc(sizeof(struct ratings));
+	CHECK(got != NULL && want != NULL);
+	if (!got || !want)
+		return;
+
+	memcpy(copy, db, sizeof(struct db));
+	overlay_init(&o, db);
+	make_changes(&o, copy);
+	/* the copy's h2h and pack hold the games before the changes */
+	copy->h2h.num_weeks = 0;
+	copy->pack.num_weeks = 0;
+
+	for (i = 0; (algo = algo_builtin(i)); i++) {
+		if (!algo->rate_overlay) {
+			CHECK(algo_rate_overlay(&s->pool, &o, algo, first, last,
+						got) < 0);
+			continue;
+		}
+
+		CHECK(algo_rate_overlay(&s->pool, &o, algo, first, last,
+					got) == 0);
+		for (w = first, n = 0; w <= last; w++) {
+			CHECK(algo->rate(copy, w, want) == 0);
+			n += !fixture_close(got[w - first].home_adv,
+					    want->home_adv, 1e-6);
+			for (t = 0; t < db->num_teams; t++)
+				n += !fixture_close(got[w - first].team[t],
+						    want->team[t], 1e-6);
+		}
+		if (n)
+			fprintf(stderr, "%s: %s differs in %u ratings\n",
+				progname, algo->name, n);
+		CHECK(n == 0);
+	}
+
+	overlay_free(&o);
+	free(got);
+	free(want);
+}
+
+
+int main(int argc, char **argv)
+{
+	struct state s;
+	struct db *db, *copy;
+
+	if (!(db = fixture_load(&s, argc, argv)))
+		return EXIT_FAILURE;
+
+	copy = malloc(sizeof(struct db));
+	if (!copy) {
+		fprintf(stderr, "%s: malloc failed\n", progname);
+		return EXIT_FAILURE;
+	}
+
+	test_plain(db);
+	test_changes(db, copy);
+	test_read(db, argv[1]);
+	test_rate(&s, db, copy);
+
+	free(copy);
+	pool_destroy(&s.pool);
+	return fixture_done();
+}
@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fixture.h"
+#include "../src/algorithms/algorithms.h"
+
+/*
+ * game packs: building, appending and reading them back against
+ * the db's games, and massey's system built from the db's pack
+ * against one built from its games
+ */
+
+
+/* helper functions */
+
+/* p's games of weeks first..last, read both ways, match db's */
+static void check_pack(const struct game_pack *p, const struct db *db,
+		       unsigned int first, unsigned int last)
+{
+	struct pack_iter iter;
+	struct game *games;
+	unsigned int w, n, i;
+	int k = db->weeks[first].game_begin;
+
+	for (pack_iter_begin(p, first, last, &iter); !pack_iter_end(&iter);
+	     pack_iter_next(&iter)) {
+		CHECK(k < db->weeks[last].game_end);
+		if (k >= db->weeks[last].game_end)
+			return;
+		CHECK(fixture_same_game(pack_iter_data(&iter),
+					&db->games[k]));
+		k++;
+	}
+	CHECK(pack_iter_data(&iter) == NULL);
+	CHECK(k == db->weeks[last].game_end);
+
+	games = malloc(db->num_games * sizeof(struct game));
+	CHECK(games != NULL);
+	if (!games)
+		return;
+
+	for (w = first; w <= last; w++) {
+		n = pack_decode_week(p, w, games);
+		CHECK(n == (unsigned int)(db->weeks[w].game_end -
+					  db->weeks[w].game_begin));
+		for (i = 0; i < n; i++)
+			CHECK(fixture_same_game(&games[i], &db->games[
+					db->weeks[w].game_begin + i]));
+	}
+
+	free(games);
+}
+
+
+/* tests */
+
+static void test_build(const struct db *db)
+{
+	const unsigned int last = db->num_weeks - 1;
+	struct game_pack p;
+
+	pack_init(&p);
+	CHECK(pack_build(&p, db, db->num_weeks) == 0);
+	CHECK(p.num_weeks == db->num_weeks);
+	CHECK(p.num_games == db->num_games);
+	CHECK(p.num_bytes < db->num_games * sizeof(struct game));
+
+	check_pack(&p, db, 0, last);
+	check_pack(&p, db, 1, 1);
+	check_pack(&p, db, 2, last - 1);
+
+	/* a rebuild reuses the memory and packs the same bytes */
+	CHECK(pack_build(&p, db, 3) == 0);
+	CHECK(p.num_weeks == 3);
+	check_pack(&p, db, 0, 2);
+
+	pack_free(&p);
+}
+
+static void test_append(const struct db *db)
+{
+	struct game_pack p;
+
+	pack_init(&p);
+	CHECK(pack_append_weeks(&p, db, db->num_weeks / 2) == 0);
+	CHECK(pack_append_weeks(&p, db, db->num_weeks / 2) == 0);
+	CHECK(pack_append_weeks(&p, db, db->num_weeks) == 0);
+	CHECK(p.num_games == db->num_games);
+	check_pack(&p, db, 0, db->num_weeks - 1);
+
+	pack_free(&p);
+}
+
+/*
+ * the db is only packed with --pack; packed, massey reads the pack
+ * for a past week
+ */
+static void test_db_pack(struct db *db)
+{
+	const unsigned int w = db->num_weeks / 2;
+	struct lsq l, want;
+	struct ratings r;
+	unsigned int i, n = 0;
+	int k;
+
+	CHECK(db->pack.num_weeks == 0);
+	CHECK(pack_build(&db->pack, db, db->num_weeks) == 0);
+	CHECK(db->pack.num_weeks == db->num_weeks);
+	check_pack(&db->pack, db, 0, db->num_weeks - 1);
+
+	if (lsq_init(&l, db->num_teams) < 0 ||
+	    lsq_init(&want, db->num_teams) < 0) {
+		CHECK(false);
+		return;
+	}
+
+	lsq_accumulate_pack(&l, &db->pack, 0, w, 1.0);
+	for (k = 0; k < db->weeks[w].game_end; k++)
+		lsq_accumulate(&want, &db->games[k], 1.0);
+	CHECK(lsq_solve(&l) == 0);
+	CHECK(lsq_solve(&want) == 0);
+	for (i = 0; i < l.dim; i++)
+		n += l.x[i] != want.x[i];
+
+	/* a week before the last goes through the pack, not the h2h */
+	CHECK(massey_rate(db, w, &r) == 0);
+	for (i = 0; i < db->num_teams; i++)
+		n += r.team[i] != want.x[i];
+	n += r.home_adv != want.x[db->num_teams];
+	CHECK(n == 0);
+
+	lsq_free(&l);
+	lsq_free(&want);
+}
+
+
+int main(int argc, char **argv)
+{
+	struct state s;
+	struct db *db;
+
+	if (!(db = fixture_load(&s, argc, argv)))
+		return EXIT_FAILURE;
+
+	test_build(db);
+	test_append(db);
+	test_db_pack(db);
+
+	pool_destroy(&s.pool);
+	return fixture_done();
+}